@@ -8,9 +8,10 @@ LDLIBS="-ldl -lpthread"
 
 echo "[1/4] Build perf_backend.o"
 $CC $CFLAGS -c perf_backend.c -o perf_backend.o
+$CC $CFLAGS -c topology.c -o topology.o
 
 echo "[2/4] Build libmonitor.so"
-$CC $CFLAGS $LDFLAGS_SO -o libmonitor.so libmonitor.c perf_backend.o $LDLIBS
+$CC $CFLAGS $LDFLAGS_SO -o libmonitor.so libmonitor.c perf_backend.o topology.o $LDLIBS
 
 echo "[3/4] Build a tiny pthread test workload"
 cat > test_workload.c <<'EOF'
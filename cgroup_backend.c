@@ -0,0 +1,107 @@
+#define _GNU_SOURCE
+// cgroup_backend.c - cgroup v2 cpuset actuation, one leaf per managed process
+#include "cgroup_backend.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+static char g_root[512];
+
+// O_CREAT lets a plain directory stand in for cgroupfs; on a real cgroupfs
+// the interface files already exist and the flag is ignored.
+static int write_file(const char *path, const char *value)
+{
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) return -1;
+    size_t len = strlen(value);
+    ssize_t rc = write(fd, value, len);
+    int saved = errno;
+    close(fd);
+    if (rc != (ssize_t)len) {
+        errno = rc < 0 ? saved : EIO;
+        return -1;
+    }
+    return 0;
+}
+
+static int leaf_path(pid_t pid, const char *file, char *out, size_t len)
+{
+    int n = file ? snprintf(out, len, "%s/%d/%s", g_root, (int)pid, file)
+                 : snprintf(out, len, "%s/%d", g_root, (int)pid);
+    if (n < 0 || (size_t)n >= len) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    return 0;
+}
+
+int cgroup_backend_init(const char *root)
+{
+    if (!root || !*root) root = getenv("SCHED_CGROUP_ROOT");
+    if (!root || !*root) root = CGROUP_DEFAULT_ROOT;
+    if (strlen(root) >= sizeof(g_root) - 32) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    snprintf(g_root, sizeof(g_root), "%s", root);
+
+    if (mkdir(g_root, 0755) != 0 && errno != EEXIST) return -1;
+
+    // cpuset must be enabled on the way down: parent -> root -> leaves.
+    // The parent may already delegate it (or be a stand-in), so only the
+    // root's own subtree_control decides success.
+    char path[600];
+    snprintf(path, sizeof(path), "%s/../cgroup.subtree_control", g_root);
+    (void)write_file(path, "+cpuset");
+    snprintf(path, sizeof(path), "%s/cgroup.subtree_control", g_root);
+    return write_file(path, "+cpuset");
+}
+
+const char *cgroup_backend_root(void)
+{
+    return g_root;
+}
+
+int cgroup_attach_process(pid_t pid)
+{
+    char path[600];
+    if (leaf_path(pid, NULL, path, sizeof(path)) != 0) return -1;
+    if (mkdir(path, 0755) != 0 && errno != EEXIST) return -1;
+
+    // writing the tgid to cgroup.procs migrates every thread at once
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%d", (int)pid);
+    if (leaf_path(pid, "cgroup.procs", path, sizeof(path)) != 0) return -1;
+    return write_file(path, buf);
+}
+
+int cgroup_set_cpus(pid_t pid, const char *coreset)
+{
+    char path[600];
+    if (leaf_path(pid, "cpuset.cpus", path, sizeof(path)) != 0) return -1;
+    return write_file(path, coreset);
+}
+
+void cgroup_release_process(pid_t pid)
+{
+    char path[600];
+    if (leaf_path(pid, NULL, path, sizeof(path)) != 0) return;
+    if (rmdir(path) == 0) return;
+
+    if (errno == EBUSY) {
+        // still populated: leave it running on the root's CPUs
+        (void)cgroup_set_cpus(pid, "");
+    } else if (errno == ENOTEMPTY) {
+        // a stand-in directory keeps the files we created in it
+        static const char *files[] = { "cgroup.procs", "cpuset.cpus" };
+        for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+            char f[600];
+            if (leaf_path(pid, files[i], f, sizeof(f)) == 0) unlink(f);
+        }
+        (void)rmdir(path);
+    }
+}
@@ -0,0 +1,34 @@
+#ifndef CGROUP_BACKEND_H
+#define CGROUP_BACKEND_H
+
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CGROUP_DEFAULT_ROOT "/sys/fs/cgroup/hybrid-scheduler"
+
+// Prepare the parent cgroup every managed process gets a leaf under.
+// root == NULL uses $SCHED_CGROUP_ROOT, else CGROUP_DEFAULT_ROOT.
+// The root may also be a plain directory standing in for cgroupfs.
+// Returns 0 on success, -1 if the root cannot be created or delegated.
+int cgroup_backend_init(const char *root);
+const char *cgroup_backend_root(void);
+
+// Move the whole process (all threads, present and future) into
+// <root>/<pid>. Returns 0 on success, -1 on error.
+int cgroup_attach_process(pid_t pid);
+
+// One write of cpuset.cpus for the process's leaf. Returns 0 or -1.
+int cgroup_set_cpus(pid_t pid, const char *coreset);
+
+// Remove the leaf of an exited process. A live process keeps its leaf but
+// has cpuset.cpus cleared, so it inherits every CPU of the root.
+void cgroup_release_process(pid_t pid);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CGROUP_BACKEND_H
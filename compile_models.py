@@ -0,0 +1,228 @@
+import argparse
+import json
+import math
+import os
+import struct
+
+# Feature order of the MonitorData vector built by libclassifier.c
+FOREST_FEATURES = [
+    "P-Threads", "P-Cores", "E-Cores", "IPC", "Cache_Miss_Ratio", "Uop_per_Cycle",
+    "MemStallCycle_per_Mem_Inst", "MemStallCycle_per_Inst", "Fault_Rate_per_mem_instr",
+    "RChar_per_Cycle", "WChar_per_Cycle", "RBytes_per_Cycle", "WBytes_per_Cycle",
+]
+FOREST_CLASSES = 3
+
+# Weight order of compiled_linear_P/E, after the intercept (see LinearModel5)
+LINEAR_FEATURES = [
+    "cycles_per_ms", "IPC", "Cache_Miss_Ratio", "MemStall_per_Mem", "MemStall_per_Inst",
+]
+
+
+def c_float(v):
+    # thresholds are compared in float, like the runtime engine and sklearn
+    f = struct.unpack("f", struct.pack("f", v))[0]
+    if not math.isfinite(f):
+        raise ValueError(f"non-finite threshold {v}")
+    s = f"{f:.9g}"
+    if "." not in s and "e" not in s:
+        s += ".0"
+    return s + "f"
+
+
+def c_double(v):
+    return repr(float(v))
+
+
+def load(path):
+    with open(path, "r") as f:
+        return json.load(f)
+
+
+def emit_tree(out, tree, names, leaf):
+    """Nested comparisons for one tree; leaf(value, indent) emits a leaf body."""
+    nodes = tree["nodes"]
+
+    def walk(i, ind):
+        n = nodes[i]
+        pad = "    " * ind
+        if n["type"] == "leaf":
+            leaf(n["value"], pad)
+            return
+        fname = n["feature"]
+        if fname not in names:
+            # the interpreters give an unknown feature no probability
+            out.append(f"{pad}/* unknown feature {fname} */")
+            leaf(None, pad)
+            return
+        out.append(f"{pad}if (x[{names.index(fname)}] <= {c_float(n['threshold'])}) {{")
+        walk(n["left"], ind + 1)
+        out.append(f"{pad}}} else {{")
+        walk(n["right"], ind + 1)
+        out.append(f"{pad}}}")
+
+    walk(tree.get("root", 0), 1)
+
+
+def emit_forest(out, model):
+    trees = model["trees"]
+    out.append("const int compiled_have_forest = 1;")
+    out.append(f"const int compiled_forest_trees = {len(trees)};")
+    out.append("")
+
+    def leaf(value, pad):
+        for c in range(FOREST_CLASSES):
+            v = value[c] if value is not None and c < len(value) else 0.0
+            if v != 0.0:
+                out.append(f"{pad}p[{c}] += {c_double(v)};")
+
+    for t, tree in enumerate(trees):
+        out.append(f"static inline void forest_tree_{t}(const float *x, double *p)")
+        out.append("{")
+        emit_tree(out, tree, FOREST_FEATURES, leaf)
+        out.append("}")
+        out.append("")
+
+    out.append("void compiled_forest_predict(const float *x, double *probs)")
+    out.append("{")
+    out.append(f"    for (int c = 0; c < {FOREST_CLASSES}; c++) probs[c] = 0.0;")
+    for t in range(len(trees)):
+        out.append(f"    forest_tree_{t}(x, probs);")
+    out.append(f"    for (int c = 0; c < {FOREST_CLASSES}; c++) probs[c] /= {len(trees)};")
+    out.append("}")
+    out.append("")
+
+
+def emit_no_forest(out):
+    out.append("const int compiled_have_forest = 0;")
+    out.append("const int compiled_forest_trees = 0;")
+    out.append("")
+    out.append("void compiled_forest_predict(const float *x, double *probs)")
+    out.append("{")
+    out.append("    (void)x;")
+    out.append(f"    for (int c = 0; c < {FOREST_CLASSES}; c++) probs[c] = 1.0 / {FOREST_CLASSES};")
+    out.append("}")
+    out.append("")
+
+
+def argmax_vote(value):
+    # first class with the highest probability, class 0 if all are zero,
+    # as evaluate_tree() in libclassifier_2step.c did
+    best, cls = 0.0, 0
+    for i, v in enumerate(value or []):
+        if v > best:
+            best, cls = v, i
+    return cls
+
+
+def emit_two_step(out, step1, step2):
+    names = step1["feature_names"][: step1["n_features"]]
+    if len(names) > len(FOREST_FEATURES):
+        raise ValueError("two-step model has more features than the classifier provides")
+    for step, model in ((1, step1), (2, step2)):
+        if model["n_classes"] != 2:
+            raise ValueError(f"step {step} model is not a binary classifier")
+
+    out.append("const int compiled_have_two_step = 1;")
+    out.append("")
+
+    def leaf(value, pad):
+        out.append(f"{pad}return {argmax_vote(value)};")
+
+    for step, model in ((1, step1), (2, step2)):
+        for t, tree in enumerate(model["trees"]):
+            out.append(f"static inline int step{step}_tree_{t}(const float *x)")
+            out.append("{")
+            emit_tree(out, tree, names, leaf)
+            out.append("}")
+            out.append("")
+
+    out.append("int compiled_two_step_votes(int step, const float *x, float votes[2])")
+    out.append("{")
+    out.append("    votes[0] = votes[1] = 0.0f;")
+    for step, model in ((1, step1), (2, step2)):
+        out.append(f"    if (step == {step}) {{")
+        for t in range(len(model["trees"])):
+            out.append(f"        votes[step{step}_tree_{t}(x)]++;")
+        out.append("        return 0;")
+        out.append("    }")
+    out.append("    return -1;")
+    out.append("}")
+    out.append("")
+
+
+def emit_no_two_step(out):
+    out.append("const int compiled_have_two_step = 0;")
+    out.append("")
+    out.append("int compiled_two_step_votes(int step, const float *x, float votes[2])")
+    out.append("{")
+    out.append("    (void)step;")
+    out.append("    (void)x;")
+    out.append("    votes[0] = votes[1] = 0.0f;")
+    out.append("    return -1;")
+    out.append("}")
+    out.append("")
+
+
+def emit_linear(out, name, model):
+    if model is None:
+        out.append(f"const double compiled_linear_{name}[6] = {{0}};")
+        return
+    if model.get("features") != LINEAR_FEATURES:
+        raise ValueError(f"linear model {name}: 'features' does not match {LINEAR_FEATURES}")
+    w = model["weights"]
+    vals = [model["intercept"]] + [w[f] for f in LINEAR_FEATURES]
+    out.append(f"const double compiled_linear_{name}[6] = {{")
+    out.append("    " + ", ".join(c_double(v) for v in vals))
+    out.append("};")
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Compile exported models into C for the scheduler")
+    ap.add_argument("--forest", help="random forest JSON (workload_classifier.json)")
+    ap.add_argument("--two-step", help="two-step prefix; reads <prefix>_compute_step{1,2}.json")
+    ap.add_argument("--linear-p", help="linear P-core model (model_P.json)")
+    ap.add_argument("--linear-e", help="linear E-core model (model_E.json)")
+    ap.add_argument("-o", "--output", default="compiled_models.c")
+    args = ap.parse_args()
+
+    out = [
+        "// Generated by compile_models.py - do not edit.",
+        "#include \"compiled_models.h\"",
+        "",
+    ]
+
+    sources = []
+    if args.forest:
+        emit_forest(out, load(args.forest))
+        sources.append(args.forest)
+    else:
+        emit_no_forest(out)
+
+    step1 = step2 = None
+    if args.two_step:
+        p1 = f"{args.two_step}_compute_step1.json"
+        p2 = f"{args.two_step}_compute_step2.json"
+        if os.path.exists(p1) and os.path.exists(p2):
+            step1, step2 = load(p1), load(p2)
+            sources += [p1, p2]
+    if step1 is not None:
+        emit_two_step(out, step1, step2)
+    else:
+        emit_no_two_step(out)
+
+    lin_p = load(args.linear_p) if args.linear_p else None
+    lin_e = load(args.linear_e) if args.linear_e else None
+    out.append(f"const int compiled_have_linear = {1 if lin_p and lin_e else 0};")
+    emit_linear(out, "P", lin_p)
+    emit_linear(out, "E", lin_e)
+    sources += [p for p in (args.linear_p, args.linear_e) if p]
+
+    out.insert(1, "// Sources: " + " ".join(sources))
+    with open(args.output, "w") as f:
+        f.write("\n".join(out) + "\n")
+    print(f"Wrote {args.output} from {len(sources)} model file(s)")
+    return 0
+
+
+if __name__ == "__main__":
+    raise SystemExit(main())
@@ -0,0 +1,34 @@
+#ifndef COMPILED_MODELS_H
+#define COMPILED_MODELS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Models compiled into C by compile_models.py (make models). Linked in and
+// used instead of the JSON files when built with -DUSE_COMPILED_MODELS
+// (make COMPILED_MODELS=1). Each have flag is 0 when the generator was not
+// given that model; the matching functions are then stubs.
+
+// Random forest: x in libclassifier.c feature order (13 values), probs
+// receives the per-class average over all trees.
+extern const int compiled_have_forest;
+extern const int compiled_forest_trees;
+void compiled_forest_predict(const float *x, double *probs);
+
+// Two-step forests: per-tree hard votes of step 1 or 2 into votes[2].
+// x follows the step-1 feature_names order. Returns 0, or -1 if absent.
+extern const int compiled_have_two_step;
+int compiled_two_step_votes(int step, const float *x, float votes[2]);
+
+// Linear inst/ms models: intercept, then the weights of cycles_per_ms, IPC,
+// Cache_Miss_Ratio, MemStall_per_Mem and MemStall_per_Inst.
+extern const int compiled_have_linear;
+extern const double compiled_linear_P[6];
+extern const double compiled_linear_E[6];
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // COMPILED_MODELS_H
@@ -0,0 +1,151 @@
+#define _GNU_SOURCE
+// cpuload.c - per-CPU busy time and runqueue wait sampled from procfs
+#include "cpuload.h"
+#include "topology.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef struct {
+    unsigned long long busy;    // jiffies
+    unsigned long long total;   // jiffies
+    unsigned long long wait_ns; // schedstat run_delay
+    int seen;
+} cpu_counters_t;
+
+static char g_proc_root[256] = "/proc";
+static cpu_counters_t g_prev[TOPO_MAX_CPUS];
+static cpuload_cpu_t g_load[TOPO_MAX_CPUS];
+static unsigned long long g_prev_ns = 0;
+static int g_samples = 0;
+static int g_has_schedstat = 0;
+
+static unsigned long long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ull + (unsigned long long)ts.tv_nsec;
+}
+
+static int read_stat(cpu_counters_t *cur)
+{
+    char path[320];
+    snprintf(path, sizeof(path), "%s/stat", g_proc_root);
+    FILE *f = fopen(path, "r");
+    if (!f) return -1;
+
+    char line[512];
+    while (fgets(line, sizeof(line), f)) {
+        if (strncmp(line, "cpu", 3) != 0) break;       // cpu lines come first
+        if (line[3] < '0' || line[3] > '9') continue;  // aggregate "cpu " line
+
+        int cpu;
+        unsigned long long v[10] = {0};
+        int n = sscanf(line, "cpu%d %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu", &cpu,
+                       &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6], &v[7], &v[8], &v[9]);
+        if (n < 5 || cpu < 0 || cpu >= TOPO_MAX_CPUS) continue;
+
+        // guest time is already included in user/nice
+        unsigned long long idle = v[3] + v[4];
+        unsigned long long total = v[0] + v[1] + v[2] + v[3] + v[4] + v[5] + v[6] + v[7];
+        cur[cpu].busy = total - idle;
+        cur[cpu].total = total;
+        cur[cpu].seen = 1;
+    }
+    fclose(f);
+    return 0;
+}
+
+// cpuN yld_count 0 sched_count sched_goidle ttwu_count ttwu_local run_time run_delay pcount
+static int read_schedstat(cpu_counters_t *cur)
+{
+    char path[320];
+    snprintf(path, sizeof(path), "%s/schedstat", g_proc_root);
+    FILE *f = fopen(path, "r");
+    if (!f) return -1;
+
+    char line[512];
+    int found = 0;
+    while (fgets(line, sizeof(line), f)) {
+        int cpu;
+        unsigned long long v[8];
+        if (sscanf(line, "cpu%d %llu %llu %llu %llu %llu %llu %llu %llu", &cpu,
+                   &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6], &v[7]) != 9) continue;
+        if (cpu < 0 || cpu >= TOPO_MAX_CPUS) continue;
+        cur[cpu].wait_ns = v[7];
+        found = 1;
+    }
+    fclose(f);
+    return found ? 0 : -1;
+}
+
+int cpuload_init(const char *proc_root)
+{
+    if (!proc_root || !*proc_root) proc_root = getenv("CPULOAD_PROC_ROOT");
+    if (!proc_root || !*proc_root) proc_root = "/proc";
+    snprintf(g_proc_root, sizeof(g_proc_root), "%s", proc_root);
+
+    memset(g_prev, 0, sizeof(g_prev));
+    memset(g_load, 0, sizeof(g_load));
+    g_samples = 0;
+    return cpuload_sample();
+}
+
+int cpuload_sample(void)
+{
+    static cpu_counters_t cur[TOPO_MAX_CPUS];
+    memset(cur, 0, sizeof(cur));
+
+    unsigned long long ns = now_ns();
+    if (read_stat(cur) != 0) return -1;
+    g_has_schedstat = (read_schedstat(cur) == 0);
+
+    double dt_ns = (double)(ns - g_prev_ns);
+    for (int c = 0; c < TOPO_MAX_CPUS; c++) {
+        if (!cur[c].seen) {
+            // offline CPUs drop out of /proc/stat
+            g_load[c].busy = g_load[c].waiting = 0.0;
+            continue;
+        }
+        if (g_samples > 0 && g_prev[c].seen) {
+            unsigned long long dtotal = cur[c].total - g_prev[c].total;
+            unsigned long long dbusy = cur[c].busy - g_prev[c].busy;
+            g_load[c].busy = dtotal ? (double)dbusy / (double)dtotal : 0.0;
+            g_load[c].waiting = (g_has_schedstat && dt_ns > 0.0 && cur[c].wait_ns >= g_prev[c].wait_ns)
+                              ? (double)(cur[c].wait_ns - g_prev[c].wait_ns) / dt_ns : 0.0;
+        }
+        g_prev[c] = cur[c];
+    }
+    g_prev_ns = ns;
+    g_samples++;
+    return 0;
+}
+
+int cpuload_ready(void)
+{
+    return g_samples >= 2;
+}
+
+int cpuload_has_runqueue(void)
+{
+    return g_has_schedstat;
+}
+
+const cpuload_cpu_t *cpuload_cpu(int cpu)
+{
+    if (cpu < 0 || cpu >= TOPO_MAX_CPUS) return NULL;
+    return &g_load[cpu];
+}
+
+double cpuload_demand(int pcore)
+{
+    const topology_t *t = topology_get();
+    double demand = 0.0;
+    for (int c = 0; c < t->nr_cpus && c < TOPO_MAX_CPUS; c++) {
+        if (!t->cpu[c].present || !t->cpu[c].online) continue;
+        if (t->cpu[c].pcore != pcore) continue;
+        demand += g_load[c].busy + g_load[c].waiting;
+    }
+    return demand;
+}
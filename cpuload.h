@@ -0,0 +1,37 @@
+#ifndef CPULOAD_H
+#define CPULOAD_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Per-CPU load between two samples, from /proc/stat (busy time) and
+// /proc/schedstat (time tasks spent waiting on the runqueue).
+typedef struct {
+    double busy;        // fraction of the interval the CPU was not idle, 0..1
+    double waiting;     // average number of tasks waiting to run, 0 without schedstat
+} cpuload_cpu_t;
+
+// proc_root == NULL uses $CPULOAD_PROC_ROOT, else "/proc".
+// Returns 0, or -1 if /proc/stat cannot be read.
+int cpuload_init(const char *proc_root);
+
+// Take a sample; loads cover the time since the previous one.
+// Returns 0 on success, -1 if /proc/stat could not be read.
+int cpuload_sample(void);
+
+// 1 once two samples have been taken
+int cpuload_ready(void);
+int cpuload_has_runqueue(void);
+
+const cpuload_cpu_t *cpuload_cpu(int cpu);
+
+// Runnable demand on the online CPUs of one kind (pcore = 1 P, 0 E):
+// sum of busy + waiting, in CPUs. Compare with the number of such CPUs.
+double cpuload_demand(int pcore);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CPULOAD_H
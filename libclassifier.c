@@ -4,6 +4,11 @@
 #include <errno.h>
 #include "libclassifier.h"
 #include "cJSON.h"
+#include "rf_forest.h"
+#include "model_format.h"
+#ifdef USE_COMPILED_MODELS
+#include "compiled_models.h"
+#endif
 
 #ifndef QUIET_CLASSIFIER
 #define CLASSIFIER_PRINTF(fmt, ...) \
@@ -16,26 +21,9 @@
     fprintf(stderr, "\033[31m[CLASSIFIER ERROR]\033[0m: " fmt, ##__VA_ARGS__)
 #endif
 
-#define MAX_NODES 10000
-#define NUM_TREES 300
-
-typedef struct {
-    int is_leaf;
-    int feature_idx;
-    double threshold;
-    int left, right;
-    double class_probs[NUM_CLASSES];
-} TreeNode;
-
-typedef struct {
-    TreeNode nodes[MAX_NODES];
-    int node_count;
-    int root;
-} Tree;
-
-static Tree trees[NUM_TREES];
-static int tree_count = 0;
+static rf_forest_t *g_forest = NULL;
 static int model_loaded = 0;
+static int model_compiled = 0;    // forest linked in by compile_models.py
 static const char *feature_names[] = {
     "P-Threads", "P-Cores", "E-Cores", "IPC", "Cache_Miss_Ratio", "Uop_per_Cycle",
     "MemStallCycle_per_Mem_Inst", "MemStallCycle_per_Inst", "Fault_Rate_per_mem_instr",
@@ -43,7 +31,36 @@ static const char *feature_names[] = {
 };
 static const char *class_names[] = {"Compute", "I/O", "Memory"};
 
+// Batch buffers, grown to the largest batch seen and kept until cleanup
+static float *g_batch_x = NULL;
+static double *g_batch_probs = NULL;
+static int g_batch_cap = 0;
+
+// Map <model_path>.bin in place if it is there and current
+static int map_rf_model(const char *model_path) {
+    char bin[256], json[256];
+    snprintf(bin, sizeof(bin), "%s%s", model_path, MODEL_FILE_EXT);
+    snprintf(json, sizeof(json), "%s.json", model_path);
+    if (model_is_stale(bin, json)) {
+        CLASSIFIER_PRINTF("%s is older than %s, ignoring it\n", bin, json);
+        return -1;
+    }
+    g_forest = model_map_forest(bin, feature_names, NUM_FEATURES);
+    if (!g_forest) {
+        if (errno != ENOENT) {
+            CLASSIFIER_PERROR("Ignoring %s: %s\n", bin, strerror(errno));
+        }
+        return -1;
+    }
+    CLASSIFIER_PRINTF("Mapped %s: %d trees, %d nodes, %d leaves, %zu bytes\n", bin,
+                      g_forest->n_trees, g_forest->n_nodes, g_forest->n_leaves,
+                      rf_forest_bytes(g_forest));
+    return 0;
+}
+
 static void load_rf_model(const char *model_path) {
+    if (map_rf_model(model_path) == 0) return;
+
     char filename[256];
     snprintf(filename, sizeof(filename), "%s.json", model_path);
     CLASSIFIER_PRINTF("Loading CJSON model %s\n", filename);
@@ -79,76 +96,19 @@ static void load_rf_model(const char *model_path) {
         cJSON_Delete(json);
         return;
     }
-    tree_count = cJSON_GetArraySize(trees_json);
-    if (tree_count > NUM_TREES) {
-        tree_count = NUM_TREES;
-    }
-
-    for (int t = 0; t < tree_count; t++) {
-        cJSON *tree_json = cJSON_GetArrayItem(trees_json, t);
-        cJSON *nodes_json = cJSON_GetObjectItem(tree_json, "nodes");
-        if (!nodes_json) {
-            continue;
-        }
-        int node_count = cJSON_GetArraySize(nodes_json);
-        if (node_count > MAX_NODES) {
-            node_count = MAX_NODES;
-        }
-        trees[t].node_count = node_count;
-
-        for (int n = 0; n < node_count; n++) {
-            cJSON *node_json = cJSON_GetArrayItem(nodes_json, n);
-            cJSON *type_json = cJSON_GetObjectItem(node_json, "type");
-            TreeNode *node = &trees[t].nodes[n];
-            node->is_leaf = strcmp(cJSON_GetStringValue(type_json), "leaf") == 0;
-
-            if (node->is_leaf) {
-                cJSON *value_json = cJSON_GetObjectItem(node_json, "value");
-                for (int c = 0; c < NUM_CLASSES; c++) {
-                    node->class_probs[c] = cJSON_GetArrayItem(value_json, c)->valuedouble;
-                }
-            } else {
-                cJSON *feature_json = cJSON_GetObjectItem(node_json, "feature");
-                const char *feature = cJSON_GetStringValue(feature_json);
-                node->feature_idx = -1;
-                for (int f = 0; f < NUM_FEATURES; f++) {
-                    if (strcmp(feature, feature_names[f]) == 0) {
-                        node->feature_idx = f;
-                        break;
-                    }
-                }
-                node->threshold = cJSON_GetObjectItem(node_json, "threshold")->valuedouble;
-                node->left = cJSON_GetObjectItem(node_json, "left")->valueint;
-                node->right = cJSON_GetObjectItem(node_json, "right")->valueint;
-            }
-        }
-        cJSON *root_json = cJSON_GetObjectItem(tree_json, "root");
-        trees[t].root = root_json ? root_json->valueint : 0;
+    g_forest = rf_forest_from_json(trees_json, feature_names, NUM_FEATURES, NUM_CLASSES);
+    if (!g_forest) {
+        CLASSIFIER_PERROR("Malformed trees in %s\n", filename);
+    } else {
+        CLASSIFIER_PRINTF("Flattened %d trees: %d nodes, %d leaves, %zu bytes\n",
+                          g_forest->n_trees, g_forest->n_nodes, g_forest->n_leaves,
+                          rf_forest_bytes(g_forest));
     }
     cJSON_Delete(json);
-    model_loaded = 1;
 }
 
-static void predict_rf(double *features, double *probs, int *pred_class) {
-    CLASSIFIER_PRINTF("predict_rf\n");
-    for (int c = 0; c < NUM_CLASSES; c++) probs[c] = 0.0;
-    for (int t = 0; t < tree_count; t++) {
-        int node_idx = trees[t].root;
-        while (!trees[t].nodes[node_idx].is_leaf) {
-            TreeNode *node = &trees[t].nodes[node_idx];
-            if (node->feature_idx < 0 || node->feature_idx >= NUM_FEATURES) {
-                break;
-            }
-            double feature_value = features[node->feature_idx];
-            node_idx = feature_value <= node->threshold ? node->left : node->right;
-        }
-        for (int c = 0; c < NUM_CLASSES; c++) {
-            probs[c] += trees[t].nodes[node_idx].class_probs[c];
-        }
-    }
-    for (int c = 0; c < NUM_CLASSES; c++) {
-        probs[c] /= tree_count;
-    }
+// Fallback for an all-zero vote and argmax, shared by the single and batch paths
+static int finish_probs(double *probs) {
     // Normalize probs to sum = 1.0
     double prob_sum = 0.0;
     for (int c = 0; c < NUM_CLASSES; c++) {
@@ -163,24 +123,50 @@ static void predict_rf(double *features, double *probs, int *pred_class) {
             probs[c] = 1.0 / NUM_CLASSES;
         }
     }
-    *pred_class = 0;
+    int pred_class = 0;
     double max_prob = probs[0];
     for (int c = 1; c < NUM_CLASSES; c++) {
         if (probs[c] > max_prob) {
             max_prob = probs[c];
-            *pred_class = c;
+            pred_class = c;
         }
     }
+    return pred_class;
+}
+
+static void predict_rf(double *features, double *probs, int *pred_class) {
+    CLASSIFIER_PRINTF("predict_rf\n");
+    float x[NUM_FEATURES];
+    for (int i = 0; i < NUM_FEATURES; i++) x[i] = (float)features[i];
+#ifdef USE_COMPILED_MODELS
+    if (model_compiled) {
+        compiled_forest_predict(x, probs);
+    } else {
+        rf_forest_predict(g_forest, x, probs);
+    }
+#else
+    rf_forest_predict(g_forest, x, probs);
+#endif
+    *pred_class = finish_probs(probs);
 }
 
 int init_classifier_cjson(const char *model_path) {
     CLASSIFIER_PRINTF("Initializing CJSON classifier\n");
+#ifdef USE_COMPILED_MODELS
+    if (compiled_have_forest) {
+        model_loaded = model_compiled = 1;
+        CLASSIFIER_PRINTF("Using the compiled-in forest with %d trees, %s not loaded\n",
+                          compiled_forest_trees, model_path);
+        return 0;
+    }
+#endif
     load_rf_model(model_path);
-    if (tree_count == 0) {
+    if (!g_forest) {
         CLASSIFIER_PERROR("Failed to initialize CJSON classifier: no trees loaded\n");
         return -1;
     }
-    CLASSIFIER_PRINTF("CJSON classifier initialized successfully with %d trees\n", tree_count);
+    CLASSIFIER_PRINTF("CJSON classifier initialized successfully with %d trees\n", g_forest->n_trees);
+    model_loaded = 1;
     return 0;
 }
 
@@ -221,15 +207,92 @@ void classify_workload_cjson(MonitorData *data) {
     }
 }
 
+static int reserve_batch(int n) {
+    if (n <= g_batch_cap) return 0;
+    int cap = g_batch_cap ? g_batch_cap : 16;
+    while (cap < n) cap *= 2;
+    float *x = realloc(g_batch_x, (size_t)cap * NUM_FEATURES * sizeof(*x));
+    if (x) g_batch_x = x;
+    double *probs = realloc(g_batch_probs, (size_t)cap * NUM_CLASSES * sizeof(*probs));
+    if (probs) g_batch_probs = probs;
+    if (!x || !probs) return -1;
+    g_batch_cap = cap;
+    return 0;
+}
+
+void classify_workload_cjson_batch(MonitorData *data, int n) {
+    if (n <= 0) return;
+    if (!model_loaded || reserve_batch(n) != 0) {
+        if (model_loaded) {
+            CLASSIFIER_PERROR("Out of memory for a batch of %d\n", n);
+        } else {
+            CLASSIFIER_PERROR("CJSON classifier not initialized\n");
+        }
+        for (int i = 0; i < n; i++) {
+            data[i].compute_prob_cjson = 1.0 / NUM_CLASSES;
+            data[i].io_prob_cjson = 1.0 / NUM_CLASSES;
+            data[i].memory_prob_cjson = 1.0 / NUM_CLASSES;
+        }
+        return;
+    }
+
+    float *x = g_batch_x;
+    double *probs = g_batch_probs;
+    for (int i = 0; i < n; i++) {
+        const MonitorData *d = &data[i];
+        float *row = x + (size_t)i * NUM_FEATURES;
+        row[0] = (float)d->pthread_count;
+        row[1] = (float)d->pcore_count;
+        row[2] = (float)d->ecore_count;
+        row[3] = (float)d->ratios.IPC;
+        row[4] = (float)d->ratios.Cache_Miss_Ratio;
+        row[5] = (float)d->ratios.Uop_per_Cycle;
+        row[6] = (float)d->ratios.MemStallCycle_per_Mem_Inst;
+        row[7] = (float)d->ratios.MemStallCycle_per_Inst;
+        row[8] = (float)d->ratios.Fault_Rate_per_mem_instr;
+        row[9] = (float)d->ratios.RChar_per_Cycle;
+        row[10] = (float)d->ratios.WChar_per_Cycle;
+        row[11] = (float)d->ratios.RBytes_per_Cycle;
+        row[12] = (float)d->ratios.WBytes_per_Cycle;
+    }
+
+    const char *isa;
+#ifdef USE_COMPILED_MODELS
+    if (model_compiled) {
+        for (int i = 0; i < n; i++) {
+            compiled_forest_predict(x + (size_t)i * NUM_FEATURES, probs + (size_t)i * NUM_CLASSES);
+        }
+        isa = "compiled";
+    } else {
+        rf_forest_predict_batch(g_forest, x, n, probs);
+        isa = rf_forest_isa();
+    }
+#else
+    rf_forest_predict_batch(g_forest, x, n, probs);
+    isa = rf_forest_isa();
+#endif
+
+    for (int i = 0; i < n; i++) {
+        double *p = probs + (size_t)i * NUM_CLASSES;
+        finish_probs(p);
+        data[i].compute_prob_cjson = p[0];
+        data[i].io_prob_cjson = p[1];
+        data[i].memory_prob_cjson = p[2];
+    }
+    CLASSIFIER_PRINTF("Classified %d workloads in one batch (%s)\n", n, isa);
+}
+
 void cleanup_classifier_cjson(void) {
     CLASSIFIER_PRINTF("cleanup_classifier_cjson\n");
     if (model_loaded) {
-        for (int t = 0; t < tree_count; t++) {
-            trees[t].node_count = 0;
-            trees[t].root = 0;
-        }
-        tree_count = 0;
-        model_loaded = 0;
+        rf_forest_free(g_forest);
+        g_forest = NULL;
+        model_loaded = model_compiled = 0;
         CLASSIFIER_PRINTF("CJSON classifier resources cleaned up\n");
     }
+    free(g_batch_x);
+    free(g_batch_probs);
+    g_batch_x = NULL;
+    g_batch_probs = NULL;
+    g_batch_cap = 0;
 }
@@ -27,6 +27,8 @@
 // CJSON classifier functions
 int init_classifier_cjson(const char *model_path);
 void classify_workload_cjson(MonitorData *data);
+// Classify n records in one pass over the forest (SIMD where available)
+void classify_workload_cjson_batch(MonitorData *data, int n);
 void cleanup_classifier_cjson(void);
 
 // CJSON 2-step classifier functions
@@ -37,11 +39,15 @@ void cleanup_classifier_cjson_2step(void);
 // ONNX classifier functions
 int init_classifier_onnx(const char *model_path);
 void classify_workload_onnx(MonitorData *data);
+// Classify n records with one Run() over an [n, NUM_FEATURES] input
+void classify_workload_onnx_batch(MonitorData *data, int n);
 void cleanup_classifier_onnx(void);
 
 // ONNX 2-step classifier functions
 int init_classifier_onnx_2step(const char *model_path);
 void classify_workload_onnx_2step(MonitorData *data);
+// Step 1 over all n records in one Run(), then Step 2 over the non-Compute ones
+void classify_workload_onnx_2step_batch(MonitorData *data, int n);
 void cleanup_classifier_onnx_2step(void);
 
 #endif
\ No newline at end of file
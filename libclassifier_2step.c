@@ -4,9 +4,15 @@
 #include "cJSON.h"
 #include <errno.h>
 #include "libclassifier.h"
+#include "rf_forest.h"
+#include "model_format.h"
+#ifdef USE_COMPILED_MODELS
+#include "compiled_models.h"
+#endif
 
-static cJSON *g_model_step1 = NULL;
-static cJSON *g_model_step2 = NULL;
+static rf_forest_t *g_model_step1 = NULL;
+static rf_forest_t *g_model_step2 = NULL;
+static int g_compiled = 0;    // both steps linked in by compile_models.py
 static int g_n_classes_step1 = 0;
 static int g_n_classes_step2 = 0;
 static int g_n_features = 0;
@@ -15,115 +21,192 @@ static const char *class_names[] = {"Compute", "I/O", "Memory"};
 static const char *positive_class = "Compute";
 static const char *other_classes[] = {"I/O", "Memory"};
 
-static float evaluate_tree(cJSON *tree, float *features, int n_features) {
-    cJSON *nodes = cJSON_GetObjectItem(tree, "nodes");
-    int root = cJSON_GetObjectItem(tree, "root")->valueint;
-    int current = root;
-    
-    while (1) {
-        cJSON *node = cJSON_GetArrayItem(nodes, current);
-        if (strcmp(cJSON_GetObjectItem(node, "type")->valuestring, "leaf") == 0) {
-            cJSON *value = cJSON_GetObjectItem(node, "value");
-            float max_prob = 0.0;
-            int max_class = 0;
-            for (int i = 0; i < cJSON_GetArraySize(value); i++) {
-                float prob = (float)cJSON_GetArrayItem(value, i)->valuedouble;
-                if (prob > max_prob) {
-                    max_prob = prob;
-                    max_class = i;
-                }
-            }
-            return (float)max_class;
-        }
-        
-        cJSON *feature = cJSON_GetObjectItem(node, "feature");
-        float threshold = (float)cJSON_GetObjectItem(node, "threshold")->valuedouble;
-        int feature_idx = -1;
-        for (int i = 0; i < n_features; i++) {
-            if (strcmp(g_feature_names[i], feature->valuestring) == 0) {
-                feature_idx = i;
-                break;
+// Per-tree hard vote, as sklearn's predict does per estimator: each tree
+// votes for the first class with the highest leaf probability.
+static void vote_trees(const rf_forest_t *f, const float *features, float *votes) {
+    for (int c = 0; c < f->n_classes; c++) votes[c] = 0.0;
+    for (int t = 0; t < f->n_trees; t++) {
+        int32_t i = f->root[t];
+        uint16_t fid;
+        while ((fid = f->feature[i]) != RF_LEAF)
+            i = f->child[i] + !(features[fid] <= f->threshold[i]);
+
+        const float *value = f->leaf + (size_t)f->child[i] * f->n_classes;
+        float max_prob = 0.0;
+        int max_class = 0;
+        for (int c = 0; c < f->n_classes; c++) {
+            if (value[c] > max_prob) {
+                max_prob = value[c];
+                max_class = c;
             }
         }
-        
-        int next = features[feature_idx] <= threshold ? 
-                   cJSON_GetObjectItem(node, "left")->valueint :
-                   cJSON_GetObjectItem(node, "right")->valueint;
-        current = next;
+        votes[max_class]++;
     }
 }
 
-int init_classifier_cjson_2step(const char *model_path) {
-    printf("Initializing CJSON two-step classifier\n");
-    
-    // Construct paths for Step 1 and Step 2
-    char model_path_step1[256], model_path_step2[256];
-    snprintf(model_path_step1, sizeof(model_path_step1), "%s_compute_step1.json", model_path);
-    snprintf(model_path_step2, sizeof(model_path_step2), "%s_compute_step2.json", model_path);
-    
-    // Load Step 1 model
-    FILE *file = fopen(model_path_step1, "r");
+static void step_votes(int step, const float *features, float *votes) {
+#ifdef USE_COMPILED_MODELS
+    if (g_compiled) {
+        compiled_two_step_votes(step, features, votes);
+        return;
+    }
+#endif
+    vote_trees(step == 1 ? g_model_step1 : g_model_step2, features, votes);
+}
+
+// Flatten one step's trees; the cJSON document is not needed afterwards.
+static rf_forest_t *compile_step(cJSON *model, const char *path) {
+    cJSON *n_classes = cJSON_GetObjectItem(model, "n_classes");
+    if (!cJSON_IsNumber(n_classes) || n_classes->valueint != 2) {
+        fprintf(stderr, "Model %s is not a binary classifier\n", path);
+        return NULL;
+    }
+    rf_forest_t *f = rf_forest_from_json(cJSON_GetObjectItem(model, "trees"),
+                                         (const char *const *)g_feature_names, g_n_features,
+                                         n_classes->valueint);
+    if (!f) {
+        fprintf(stderr, "Malformed trees in %s\n", path);
+    }
+    return f;
+}
+
+static cJSON *parse_model_file(const char *path) {
+    FILE *file = fopen(path, "r");
     if (!file) {
-        fprintf(stderr, "Failed to open model file %s: %s\n", model_path_step1, strerror(errno));
-        return -1;
+        fprintf(stderr, "Failed to open model file %s: %s\n", path, strerror(errno));
+        return NULL;
     }
     fseek(file, 0, SEEK_END);
     long length = ftell(file);
     fseek(file, 0, SEEK_SET);
     char *data = malloc(length + 1);
+    if (!data) {
+        fclose(file);
+        return NULL;
+    }
     fread(data, 1, length, file);
     data[length] = '\0';
     fclose(file);
-    
-    g_model_step1 = cJSON_Parse(data);
+
+    cJSON *model = cJSON_Parse(data);
     free(data);
-    if (!g_model_step1) {
+    if (!model) {
         fprintf(stderr, "Failed to parse JSON: %s\n", cJSON_GetErrorPtr());
+    }
+    return model;
+}
+
+// Map both steps from <model_path>_compute_step{1,2}.bin if they are there
+// and current. Step 2 must list the same features as step 1.
+static int map_steps(const char *model_path) {
+    char bin1[256], bin2[256], json1[256], json2[256];
+    snprintf(bin1, sizeof(bin1), "%s_compute_step1%s", model_path, MODEL_FILE_EXT);
+    snprintf(bin2, sizeof(bin2), "%s_compute_step2%s", model_path, MODEL_FILE_EXT);
+    snprintf(json1, sizeof(json1), "%s_compute_step1.json", model_path);
+    snprintf(json2, sizeof(json2), "%s_compute_step2.json", model_path);
+    if (model_is_stale(bin1, json1) || model_is_stale(bin2, json2)) {
+        printf("Two-step %s files are older than the JSON exports, ignoring them\n", MODEL_FILE_EXT);
         return -1;
     }
-    
-    // Load Step 2 model
-    file = fopen(model_path_step2, "r");
-    if (!file) {
-        fprintf(stderr, "Failed to open model file %s: %s\n", model_path_step2, strerror(errno));
-        cJSON_Delete(g_model_step1);
-        g_model_step1 = NULL;
+
+    rf_forest_t *step1 = model_map_forest(bin1, NULL, 0);
+    if (!step1) {
+        if (errno != ENOENT) {
+            fprintf(stderr, "Ignoring %s: %s\n", bin1, strerror(errno));
+        }
         return -1;
     }
-    fseek(file, 0, SEEK_END);
-    length = ftell(file);
-    fseek(file, 0, SEEK_SET);
-    data = malloc(length + 1);
-    fread(data, 1, length, file);
-    data[length] = '\0';
-    fclose(file);
-    
-    g_model_step2 = cJSON_Parse(data);
-    free(data);
-    if (!g_model_step2) {
-        fprintf(stderr, "Failed to parse JSON: %s\n", cJSON_GetErrorPtr());
-        cJSON_Delete(g_model_step1);
-        g_model_step1 = NULL;
+    const char *names[NUM_FEATURES];
+    if (step1->n_classes != 2 || model_forest_feature_names(step1, names, NUM_FEATURES) != 0) {
+        fprintf(stderr, "Ignoring %s: not a binary classifier over at most %d features\n",
+                bin1, NUM_FEATURES);
+        rf_forest_free(step1);
         return -1;
     }
+    rf_forest_t *step2 = model_map_forest(bin2, names, step1->n_features);
+    if (!step2 || step2->n_classes != 2) {
+        fprintf(stderr, "Ignoring %s: %s\n", bin2,
+                step2 ? "not a binary classifier" : strerror(errno));
+        rf_forest_free(step2);
+        rf_forest_free(step1);
+        return -1;
+    }
+
+    g_model_step1 = step1;
+    g_model_step2 = step2;
+    g_n_features = step1->n_features;
+    g_n_classes_step1 = g_n_classes_step2 = 2;
+    printf("Mapped %s and %s\n", bin1, bin2);
+    return 0;
+}
+
+int init_classifier_cjson_2step(const char *model_path) {
+    printf("Initializing CJSON two-step classifier\n");
+#ifdef USE_COMPILED_MODELS
+    if (compiled_have_two_step) {
+        g_compiled = 1;
+        printf("Using the compiled-in two-step models, %s not loaded\n", model_path);
+        return 0;
+    }
+#endif
+    if (map_steps(model_path) == 0) {
+        printf("CJSON two-step classifier initialized successfully with %d trees\n",
+               g_model_step1->n_trees);
+        return 0;
+    }
     
-    g_n_classes_step1 = cJSON_GetObjectItem(g_model_step1, "n_classes")->valueint;
-    g_n_classes_step2 = cJSON_GetObjectItem(g_model_step2, "n_classes")->valueint;
-    g_n_features = cJSON_GetObjectItem(g_model_step1, "n_features")->valueint;
+    // Construct paths for Step 1 and Step 2
+    char model_path_step1[256], model_path_step2[256];
+    snprintf(model_path_step1, sizeof(model_path_step1), "%s_compute_step1.json", model_path);
+    snprintf(model_path_step2, sizeof(model_path_step2), "%s_compute_step2.json", model_path);
     
-    cJSON *feature_names = cJSON_GetObjectItem(g_model_step1, "feature_names");
+    // Load Step 1 model; its feature order applies to both steps
+    cJSON *model = parse_model_file(model_path_step1);
+    if (!model) {
+        return -1;
+    }
+    g_n_features = cJSON_GetObjectItem(model, "n_features")->valueint;
+    if (g_n_features <= 0 || g_n_features > NUM_FEATURES) {
+        fprintf(stderr, "Model %s has %d features, expected at most %d\n",
+                model_path_step1, g_n_features, NUM_FEATURES);
+        cJSON_Delete(model);
+        g_n_features = 0;
+        return -1;
+    }
+    cJSON *feature_names = cJSON_GetObjectItem(model, "feature_names");
     g_feature_names = malloc(g_n_features * sizeof(char *));
     for (int i = 0; i < g_n_features; i++) {
         g_feature_names[i] = strdup(cJSON_GetArrayItem(feature_names, i)->valuestring);
     }
+    g_n_classes_step1 = cJSON_GetObjectItem(model, "n_classes")->valueint;
+    g_model_step1 = compile_step(model, model_path_step1);
+    cJSON_Delete(model);
+    if (!g_model_step1) {
+        cleanup_classifier_cjson_2step();
+        return -1;
+    }
+    
+    // Load Step 2 model
+    model = parse_model_file(model_path_step2);
+    if (!model) {
+        cleanup_classifier_cjson_2step();
+        return -1;
+    }
+    g_n_classes_step2 = cJSON_GetObjectItem(model, "n_classes")->valueint;
+    g_model_step2 = compile_step(model, model_path_step2);
+    cJSON_Delete(model);
+    if (!g_model_step2) {
+        cleanup_classifier_cjson_2step();
+        return -1;
+    }
     
     printf("CJSON two-step classifier initialized successfully with %d trees\n", 
-           cJSON_GetObjectItem(g_model_step1, "n_estimators")->valueint);
+           g_model_step1->n_trees);
     return 0;
 }
 
 void classify_workload_cjson_2step(MonitorData *data) {
-    if (!g_model_step1 || !g_model_step2) {
+    if (!g_compiled && (!g_model_step1 || !g_model_step2)) {
         fprintf(stderr, "CJSON classifier not initialized\n");
         data->compute_prob_cjson_2step = 0.0;
         data->io_prob_cjson_2step = 0.0;
@@ -144,12 +227,8 @@ void classify_workload_cjson_2step(MonitorData *data) {
     };
     
     // Step 1: Predict positive class (Compute)
-    cJSON *trees = cJSON_GetObjectItem(g_model_step1, "trees");
-    float votes[2] = {0.0, 0.0};
-    for (int i = 0; i < cJSON_GetArraySize(trees); i++) {
-        float pred = evaluate_tree(cJSON_GetArrayItem(trees, i), features, g_n_features);
-        votes[(int)pred]++;
-    }
+    float votes[2];
+    step_votes(1, features, votes);
     float prob_positive = votes[1] / (votes[0] + votes[1]);
     
     float probs[3] = {0.0, 0.0, 0.0};
@@ -171,12 +250,7 @@ if (prob_positive > 0.5) {
     }
     
     // Step 2: Predict non-positive classes (I/O vs. Memory)
-    trees = cJSON_GetObjectItem(g_model_step2, "trees");
-    votes[0] = votes[1] = 0.0;
-    for (int i = 0; i < cJSON_GetArraySize(trees); i++) {
-        float pred = evaluate_tree(cJSON_GetArrayItem(trees, i), features, g_n_features);
-        votes[(int)pred]++;
-    }
+    step_votes(2, features, votes);
     probs[1] = votes[0] / (votes[0] + votes[1]); // I/O
     probs[2] = votes[1] / (votes[0] + votes[1]); // Memory
     
@@ -194,11 +268,11 @@ if (prob_positive > 0.5) {
 
 void cleanup_classifier_cjson_2step(void) {
     if (g_model_step1) {
-        cJSON_Delete(g_model_step1);
+        rf_forest_free(g_model_step1);
         g_model_step1 = NULL;
     }
     if (g_model_step2) {
-        cJSON_Delete(g_model_step2);
+        rf_forest_free(g_model_step2);
         g_model_step2 = NULL;
     }
     if (g_feature_names) {
@@ -208,6 +282,7 @@ void cleanup_classifier_cjson_2step(void) {
         free(g_feature_names);
         g_feature_names = NULL;
     }
+    g_compiled = 0;
     g_n_classes_step1 = 0;
     g_n_classes_step2 = 0;
     g_n_features = 0;
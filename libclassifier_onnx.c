@@ -3,7 +3,7 @@
 #include <string.h>
 #include <errno.h>
 #include "libclassifier.h"
-#include "libclassifier.h"
+#include "onnx_io.h"
 
 static const OrtApi *g_ort = NULL;
 static OrtEnv *g_env = NULL;
@@ -12,6 +12,8 @@ static OrtSessionOptions *g_session_options = NULL;
 static char *g_input_name = NULL;
 static char *g_prob_name = NULL;
 static OrtAllocator *g_allocator = NULL;
+static onnx_io_t g_io;          // one row, bound once at init
+static onnx_io_t g_io_batch;    // rebound only when the batch size changes
 
 static const char *class_names[] = {"Compute", "I/O", "Memory"};
 
@@ -24,6 +26,39 @@ static void check_ort_status(OrtStatus *status, const char *msg) {
     }
 }
 
+static void fill_features(const MonitorData *data, float *features) {
+    features[0] = (float)data->pthread_count;
+    features[1] = (float)data->pcore_count;
+    features[2] = (float)data->ecore_count;
+    features[3] = (float)data->ratios.IPC;
+    features[4] = (float)data->ratios.Cache_Miss_Ratio;
+    features[5] = (float)data->ratios.Uop_per_Cycle;
+    features[6] = (float)data->ratios.MemStallCycle_per_Mem_Inst;
+    features[7] = (float)data->ratios.MemStallCycle_per_Inst;
+    features[8] = (float)data->ratios.Fault_Rate_per_mem_instr;
+    features[9] = (float)data->ratios.RChar_per_Cycle;
+    features[10] = (float)data->ratios.WChar_per_Cycle;
+    features[11] = (float)data->ratios.RBytes_per_Cycle;
+    features[12] = (float)data->ratios.WBytes_per_Cycle;
+}
+
+// Store one row of class probabilities and return the predicted class
+static int store_probs(MonitorData *data, const float *output_probs) {
+    data->compute_prob_onnx = output_probs[0];
+    data->io_prob_onnx = output_probs[1];
+    data->memory_prob_onnx = output_probs[2];
+
+    int pred_class = 0;
+    float max_prob = output_probs[0];
+    for (int c = 1; c < NUM_CLASSES; c++) {
+        if (output_probs[c] > max_prob) {
+            max_prob = output_probs[c];
+            pred_class = c;
+        }
+    }
+    return pred_class;
+}
+
 int init_classifier_onnx(const char *model_path) {
     char filename[256];
     snprintf(filename, sizeof(filename), "%s.onnx", model_path);
@@ -40,6 +75,8 @@ int init_classifier_onnx(const char *model_path) {
 
     check_ort_status(g_ort->CreateSessionOptions(&g_session_options),
                      "Failed to create session options");
+    check_ort_status(onnx_io_session_options(g_ort, g_session_options),
+                     "Failed to set session options");
 
     check_ort_status(g_ort->CreateSession(g_env, filename, g_session_options, &g_session),
                      "Failed to create ONNX session");
@@ -56,6 +93,16 @@ int init_classifier_onnx(const char *model_path) {
     check_ort_status(g_ort->SessionGetOutputName(g_session, 1, g_allocator, &g_prob_name),
                      "Failed to get probability output name");
 
+    OrtStatus *status = NULL;
+    check_ort_status(onnx_io_init(&g_io, g_ort, g_session, g_input_name, g_prob_name,
+                                  NUM_FEATURES, NUM_CLASSES),
+                     "Failed to create IoBinding");
+    check_ort_status(onnx_io_init(&g_io_batch, g_ort, g_session, g_input_name, g_prob_name,
+                                  NUM_FEATURES, NUM_CLASSES),
+                     "Failed to create batch IoBinding");
+    onnx_io_rows(&g_io, 1, &status);
+    check_ort_status(status, "Failed to bind input and output tensors");
+
     printf("ONNX classifier initialized successfully\n");
     return 0;
 }
@@ -71,70 +118,56 @@ void classify_workload_onnx(MonitorData *data) {
 
     printf("onnx classify_workload_onnx\n");
 
-    float features[NUM_FEATURES] = {
-        (float)data->pthread_count, (float)data->pcore_count, (float)data->ecore_count,
-        (float)data->ratios.IPC, (float)data->ratios.Cache_Miss_Ratio, (float)data->ratios.Uop_per_Cycle,
-        (float)data->ratios.MemStallCycle_per_Mem_Inst, (float)data->ratios.MemStallCycle_per_Inst,
-        (float)data->ratios.Fault_Rate_per_mem_instr, (float)data->ratios.RChar_per_Cycle,
-        (float)data->ratios.WChar_per_Cycle, (float)data->ratios.RBytes_per_Cycle,
-        (float)data->ratios.WBytes_per_Cycle
-    };
-
+    float *features = g_io.x;
+    fill_features(data, features);
     for (int i = 0; i < NUM_FEATURES; i++) {
         printf("Feature %d: %.15f\n", i, features[i]);
     }
 
-    OrtMemoryInfo *memory_info;
-    check_ort_status(g_ort->CreateCpuMemoryInfo(OrtArenaAllocator, OrtMemTypeDefault, &memory_info),
-                     "Failed to create memory info");
-
-    int64_t input_dims[] = {1, NUM_FEATURES};
-    OrtValue *input_tensor;
-    check_ort_status(g_ort->CreateTensorWithDataAsOrtValue(memory_info, features, sizeof(features),
-                                                            input_dims, 2, ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT,
-                                                            &input_tensor),
-                     "Failed to create input tensor");
-
-    g_ort->ReleaseMemoryInfo(memory_info);
-
-    const char *input_names[] = {g_input_name};
-    const char *output_names[] = {g_prob_name};
-    OrtValue *output_tensor = NULL;
-    check_ort_status(g_ort->Run(g_session, NULL, input_names, (const OrtValue *const *)&input_tensor, 1,
-                                 output_names, 1, &output_tensor),
-                     "Failed to run inference");
-
-    float *output_probs;
-    check_ort_status(g_ort->GetTensorMutableData(output_tensor, (void **)&output_probs),
-                     "Failed to get output tensor data");
+    check_ort_status(onnx_io_run(&g_io), "Failed to run inference");
+    const float *output_probs = g_io.probs;
 
     float prob_sum = output_probs[0] + output_probs[1] + output_probs[2];
     printf("Probability sum: %.15f\n", prob_sum);
 
-    data->compute_prob_onnx = output_probs[0];
-    data->io_prob_onnx = output_probs[1];
-    data->memory_prob_onnx = output_probs[2];
-
-    int pred_class = 0;
-    float max_prob = output_probs[0];
-    for (int c = 1; c < NUM_CLASSES; c++) {
-        if (output_probs[c] > max_prob) {
-            max_prob = output_probs[c];
-            pred_class = c;
-        }
-    }
+    int pred_class = store_probs(data, output_probs);
 
     printf("\n--- Workload Classification (ONNX) ---\n");
     printf("  Predicted Class: %s\n", class_names[pred_class]);
     for (int c = 0; c < NUM_CLASSES; c++) {
         printf("  Prob_%s: %.15f\n", class_names[c], output_probs[c]);
     }
+}
+
+void classify_workload_onnx_batch(MonitorData *data, int n) {
+    if (n <= 0) return;
+    if (!g_session || !g_ort) {
+        fprintf(stderr, "ONNX classifier not initialized\n");
+        for (int i = 0; i < n; i++) {
+            data[i].compute_prob_onnx = 0.0;
+            data[i].io_prob_onnx = 0.0;
+            data[i].memory_prob_onnx = 0.0;
+        }
+        return;
+    }
 
-    g_ort->ReleaseValue(output_tensor);
-    g_ort->ReleaseValue(input_tensor);
+    OrtStatus *status = NULL;
+    float *x = onnx_io_rows(&g_io_batch, n, &status);
+    check_ort_status(status, "Failed to bind batch tensors");
+    for (int i = 0; i < n; i++) {
+        fill_features(&data[i], x + (size_t)i * NUM_FEATURES);
+    }
+
+    check_ort_status(onnx_io_run(&g_io_batch), "Failed to run batch inference");
+    for (int i = 0; i < n; i++) {
+        store_probs(&data[i], g_io_batch.probs + (size_t)i * NUM_CLASSES);
+    }
+    printf("ONNX classified %d workloads in one run\n", n);
 }
 
 void cleanup_classifier_onnx(void) {
+    onnx_io_free(&g_io);
+    onnx_io_free(&g_io_batch);
     if (g_ort) {
         if (g_input_name) g_ort->AllocatorFree(g_allocator, g_input_name);
         if (g_prob_name) g_ort->AllocatorFree(g_allocator, g_prob_name);
@@ -3,6 +3,7 @@
 #include <string.h>
 #include <errno.h>
 #include "libclassifier.h"
+#include "onnx_io.h"
 
 static const OrtApi *g_ort = NULL;
 static OrtEnv *g_env = NULL;
@@ -14,6 +15,10 @@ static char *g_prob_name_step1 = NULL;
 static char *g_input_name_step2 = NULL;
 static char *g_prob_name_step2 = NULL;
 static OrtAllocator *g_allocator = NULL;
+// One row per step, bound once at init, and the batch bindings, rebound
+// only when the number of rows changes
+static onnx_io_t g_io_step1, g_io_step2;
+static onnx_io_t g_io_batch_step1, g_io_batch_step2;
 static const char *class_names[] = {"Compute", "I/O", "Memory"};
 
 static void check_ort_status(OrtStatus *status, const char *msg) {
@@ -25,6 +30,65 @@ static void check_ort_status(OrtStatus *status, const char *msg) {
     }
 }
 
+static void fill_features(const MonitorData *data, float *features) {
+    features[0] = (float)data->pthread_count;
+    features[1] = (float)data->pcore_count;
+    features[2] = (float)data->ecore_count;
+    features[3] = (float)data->ratios.IPC;
+    features[4] = (float)data->ratios.Cache_Miss_Ratio;
+    features[5] = (float)data->ratios.Uop_per_Cycle;
+    features[6] = (float)data->ratios.MemStallCycle_per_Mem_Inst;
+    features[7] = (float)data->ratios.MemStallCycle_per_Inst;
+    features[8] = (float)data->ratios.Fault_Rate_per_mem_instr;
+    features[9] = (float)data->ratios.RChar_per_Cycle;
+    features[10] = (float)data->ratios.WChar_per_Cycle;
+    features[11] = (float)data->ratios.RBytes_per_Cycle;
+    features[12] = (float)data->ratios.WBytes_per_Cycle;
+}
+
+// Step 2 runs unless Step 1 gives Compute more than 50%
+static int needs_step2(float prob_compute) {
+    return !(prob_compute > 0.5);
+}
+
+// Merge Step 1's Compute probability with Step 2's I/O and Memory
+// probabilities (NULL when Step 1 said Compute) into probs[3], store them
+// and return the predicted class.
+static int combine_steps(MonitorData *data, float prob_compute, const float *probs_step2, float *probs) {
+    if (!probs_step2) {
+        // If Compute probability > 50%, assign remaining probability equally to I/O and Memory
+        probs[0] = prob_compute;
+        probs[1] = (1.0 - prob_compute) / 2.0;
+        probs[2] = (1.0 - prob_compute) / 2.0;
+    } else {
+        probs[0] = 0.0;  // Compute probability is 0
+        probs[1] = probs_step2[0];  // I/O probability
+        probs[2] = probs_step2[1];  // Memory probability
+    }
+
+    // Normalize probabilities to sum to 1
+    float prob_sum = probs[0] + probs[1] + probs[2];
+    if (prob_sum > 0) {
+        probs[0] /= prob_sum;
+        probs[1] /= prob_sum;
+        probs[2] /= prob_sum;
+    }
+
+    // Store results
+    data->compute_prob_onnx_2step = probs[0];
+    data->io_prob_onnx_2step = probs[1];
+    data->memory_prob_onnx_2step = probs[2];
+
+    // Determine predicted class
+    int pred_class = 0;
+    if (probs[1] > probs[0] && probs[1] > probs[2]) {
+        pred_class = 1;
+    } else if (probs[2] > probs[0] && probs[2] > probs[1]) {
+        pred_class = 2;
+    }
+    return pred_class;
+}
+
 int init_classifier_onnx_2step(const char *model_path) {
     char filename_step1[256];
     char filename_step2[256];
@@ -46,9 +110,12 @@ int init_classifier_onnx_2step(const char *model_path) {
 
     check_ort_status(g_ort->CreateSessionOptions(&g_session_options),
                      "Failed to create session options");
+    check_ort_status(onnx_io_session_options(g_ort, g_session_options),
+                     "Failed to set session options");
 
+    OrtStatus *status = NULL;
 #ifdef USE_OPENVINO
-    OrtStatus *status = g_ort->SessionOptionsAppendExecutionProvider_OpenVINO(g_session_options, NULL);
+    status = g_ort->SessionOptionsAppendExecutionProvider_OpenVINO(g_session_options, NULL);
     if (status) {
         fprintf(stderr, "Failed to enable OpenVINO: %s\n", g_ort->GetErrorMessage(status));
         g_ort->ReleaseStatus(status);
@@ -84,6 +151,23 @@ int init_classifier_onnx_2step(const char *model_path) {
     check_ort_status(g_ort->SessionGetOutputName(g_session_step2, 1, g_allocator, &g_prob_name_step2),
                      "Failed to get probability output name for Step 2");
 
+    check_ort_status(onnx_io_init(&g_io_step1, g_ort, g_session_step1, g_input_name_step1,
+                                  g_prob_name_step1, NUM_FEATURES, 2),
+                     "Failed to create IoBinding for Step 1");
+    check_ort_status(onnx_io_init(&g_io_step2, g_ort, g_session_step2, g_input_name_step2,
+                                  g_prob_name_step2, NUM_FEATURES, 2),
+                     "Failed to create IoBinding for Step 2");
+    check_ort_status(onnx_io_init(&g_io_batch_step1, g_ort, g_session_step1, g_input_name_step1,
+                                  g_prob_name_step1, NUM_FEATURES, 2),
+                     "Failed to create batch IoBinding for Step 1");
+    check_ort_status(onnx_io_init(&g_io_batch_step2, g_ort, g_session_step2, g_input_name_step2,
+                                  g_prob_name_step2, NUM_FEATURES, 2),
+                     "Failed to create batch IoBinding for Step 2");
+    onnx_io_rows(&g_io_step1, 1, &status);
+    check_ort_status(status, "Failed to bind tensors for Step 1");
+    onnx_io_rows(&g_io_step2, 1, &status);
+    check_ort_status(status, "Failed to bind tensors for Step 2");
+
     printf("ONNX two-step classifier initialized successfully\n");
     return 0;
 }
@@ -97,103 +181,86 @@ void classify_workload_onnx_2step(MonitorData *data) {
         return;
     }
 
-    float features[NUM_FEATURES] = {
-        (float)data->pthread_count, (float)data->pcore_count, (float)data->ecore_count,
-        (float)data->ratios.IPC, (float)data->ratios.Cache_Miss_Ratio, (float)data->ratios.Uop_per_Cycle,
-        (float)data->ratios.MemStallCycle_per_Mem_Inst, (float)data->ratios.MemStallCycle_per_Inst,
-        (float)data->ratios.Fault_Rate_per_mem_instr, (float)data->ratios.RChar_per_Cycle,
-        (float)data->ratios.WChar_per_Cycle, (float)data->ratios.RBytes_per_Cycle,
-        (float)data->ratios.WBytes_per_Cycle
-    };
-
-    OrtMemoryInfo *memory_info;
-    check_ort_status(g_ort->CreateCpuMemoryInfo(OrtArenaAllocator, OrtMemTypeDefault, &memory_info),
-                     "Failed to create memory info");
-
-    int64_t input_dims[] = {1, NUM_FEATURES};
-    OrtValue *input_tensor;
-    check_ort_status(g_ort->CreateTensorWithDataAsOrtValue(memory_info, features, sizeof(features),
-                                                          input_dims, 2, ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT,
-                                                          &input_tensor),
-                     "Failed to create input tensor");
-    g_ort->ReleaseMemoryInfo(memory_info);
+    float *features = g_io_step1.x;
+    fill_features(data, features);
 
     // Step 1: Compute vs Non-Compute classification
-    const char *input_names_step1[] = {g_input_name_step1};
-    const char *output_names_step1[] = {g_prob_name_step1};
-    OrtValue *output_tensor_step1 = NULL;
-    check_ort_status(g_ort->Run(g_session_step1, NULL, input_names_step1, 
-                               (const OrtValue *const *)&input_tensor, 1,
-                               output_names_step1, 1, &output_tensor_step1),
-                     "Failed to run inference for Step 1");
-
-    float *output_probs_step1;
-    check_ort_status(g_ort->GetTensorMutableData(output_tensor_step1, (void **)&output_probs_step1),
-                     "Failed to get output tensor data for Step 1");
-
-    float prob_compute = output_probs_step1[1];  // Probability of being Compute
-    float probs[3] = {0.0, 0.0, 0.0};
-
-    if (prob_compute > 0.5) {
-        // If Compute probability > 50%, assign remaining probability equally to I/O and Memory
-        probs[0] = prob_compute;
-        probs[1] = (1.0 - prob_compute) / 2.0;
-        probs[2] = (1.0 - prob_compute) / 2.0;
-    } else {
-        // Step 2: I/O vs Memory classification
-        const char *input_names_step2[] = {g_input_name_step2};
-        const char *output_names_step2[] = {g_prob_name_step2};
-        OrtValue *output_tensor_step2 = NULL;
-        
-        check_ort_status(g_ort->Run(g_session_step2, NULL, input_names_step2,
-                                   (const OrtValue *const *)&input_tensor, 1,
-                                   output_names_step2, 1, &output_tensor_step2),
-                         "Failed to run inference for Step 2");
-
-        float *output_probs_step2;
-        check_ort_status(g_ort->GetTensorMutableData(output_tensor_step2, (void **)&output_probs_step2),
-                         "Failed to get output tensor data for Step 2");
+    check_ort_status(onnx_io_run(&g_io_step1), "Failed to run inference for Step 1");
+    float prob_compute = g_io_step1.probs[1];  // Probability of being Compute
 
-        probs[0] = 0.0;  // Compute probability is 0
-        probs[1] = output_probs_step2[0];  // I/O probability
-        probs[2] = output_probs_step2[1];  // Memory probability
-
-        g_ort->ReleaseValue(output_tensor_step2);
-    }
-
-    // Normalize probabilities to sum to 1
-    float prob_sum = probs[0] + probs[1] + probs[2];
-    if (prob_sum > 0) {
-        probs[0] /= prob_sum;
-        probs[1] /= prob_sum;
-        probs[2] /= prob_sum;
+    const float *probs_step2 = NULL;
+    if (needs_step2(prob_compute)) {
+        // Step 2: I/O vs Memory classification
+        memcpy(g_io_step2.x, features, NUM_FEATURES * sizeof(*features));
+        check_ort_status(onnx_io_run(&g_io_step2), "Failed to run inference for Step 2");
+        probs_step2 = g_io_step2.probs;
     }
 
-    // Store results
-    data->compute_prob_onnx_2step = probs[0];
-    data->io_prob_onnx_2step = probs[1];
-    data->memory_prob_onnx_2step = probs[2];
-
-    // Determine predicted class
-    int pred_class = 0;
-    if (probs[1] > probs[0] && probs[1] > probs[2]) {
-        pred_class = 1;
-    } else if (probs[2] > probs[0] && probs[2] > probs[1]) {
-        pred_class = 2;
-    }
+    float probs[3];
+    int pred_class = combine_steps(data, prob_compute, probs_step2, probs);
 
     printf("\n--- Workload Classification (ONNX Two-Step) ---\n");
     printf("  Predicted Class: %s\n", class_names[pred_class]);
     printf("  Prob_Compute: %.4f\n", probs[0]);
     printf("  Prob_I/O: %.4f\n", probs[1]);
     printf("  Prob_Memory: %.4f\n", probs[2]);
+}
+
+void classify_workload_onnx_2step_batch(MonitorData *data, int n) {
+    if (n <= 0) return;
+    if (!g_session_step1 || !g_session_step2 || !g_ort) {
+        fprintf(stderr, "ONNX 2 step classifier not initialized\n");
+        for (int i = 0; i < n; i++) {
+            data[i].compute_prob_onnx_2step = 0.0;
+            data[i].io_prob_onnx_2step = 0.0;
+            data[i].memory_prob_onnx_2step = 0.0;
+        }
+        return;
+    }
+
+    // Step 1 over every row
+    OrtStatus *status = NULL;
+    float *x = onnx_io_rows(&g_io_batch_step1, n, &status);
+    check_ort_status(status, "Failed to bind batch tensors for Step 1");
+    for (int i = 0; i < n; i++) {
+        fill_features(&data[i], x + (size_t)i * NUM_FEATURES);
+    }
+    check_ort_status(onnx_io_run(&g_io_batch_step1), "Failed to run batch inference for Step 1");
+    const float *probs_step1 = g_io_batch_step1.probs;
 
-    // Clean up
-    g_ort->ReleaseValue(output_tensor_step1);
-    g_ort->ReleaseValue(input_tensor);
+    // Step 2 over the rows Step 1 did not call Compute, packed in order
+    int m = 0;
+    for (int i = 0; i < n; i++) {
+        m += needs_step2(probs_step1[2 * i + 1]);
+    }
+    const float *probs_step2 = NULL;
+    if (m > 0) {
+        float *x2 = onnx_io_rows(&g_io_batch_step2, m, &status);
+        check_ort_status(status, "Failed to bind batch tensors for Step 2");
+        for (int i = 0, k = 0; i < n; i++) {
+            if (needs_step2(probs_step1[2 * i + 1])) {
+                memcpy(x2 + (size_t)k++ * NUM_FEATURES, x + (size_t)i * NUM_FEATURES,
+                       NUM_FEATURES * sizeof(*x));
+            }
+        }
+        check_ort_status(onnx_io_run(&g_io_batch_step2), "Failed to run batch inference for Step 2");
+        probs_step2 = g_io_batch_step2.probs;
+    }
+
+    for (int i = 0, k = 0; i < n; i++) {
+        float prob_compute = probs_step1[2 * i + 1];
+        float probs[3];
+        combine_steps(&data[i], prob_compute,
+                      needs_step2(prob_compute) ? probs_step2 + 2 * k++ : NULL, probs);
+    }
+    printf("ONNX two-step classified %d workloads, %d through Step 2\n", n, m);
 }
 
 void cleanup_classifier_onnx_2step(void) {
+    onnx_io_free(&g_io_step1);
+    onnx_io_free(&g_io_step2);
+    onnx_io_free(&g_io_batch_step1);
+    onnx_io_free(&g_io_batch_step2);
     if (g_ort) {
         if (g_input_name_step1) g_ort->AllocatorFree(g_allocator, g_input_name_step1);
         if (g_prob_name_step1) g_ort->AllocatorFree(g_allocator, g_prob_name_step1);
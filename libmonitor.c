@@ -15,14 +15,34 @@
 #include <sys/syscall.h>
 #include <sys/socket.h>
 #include <sys/un.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
 #include <linux/sched.h>
 #include "perf_backend.h"
+#include "topology.h"
 #include "monitor.h"
+#include "telemetry_ring.h"
 
 /* --- Constants & Macros --- */
-#define CORESET "0-15"
+// Compile-time default CPU list (make CORESET=...). CORESET in the environment
+// overrides it; empty means every online CPU from the topology table.
+#ifndef CORESET
+#define CORESET ""
+#endif
 #define SOCKET_PATH "/tmp/scheduler_socket"
 #define MONITOR_RESAMPLE_INTERVAL_MILLISECONDS 100 
+#define MONITOR_SELF_SAMPLE_MILLISECONDS 5
+// MONITOR_RDPMC=1 delivers this signal to application threads from their
+// CPU-time timers. The handler is SA_RESTART, but calls the kernel never
+// restarts (sleep, nanosleep, epoll_wait, poll, select, sigtimedwait...)
+// return early with EINTR if the timer expires as the thread enters them.
+// That is rare, since the timer only advances while the thread runs, but
+// applications that do not retry on EINTR should not enable MONITOR_RDPMC.
+#define MONITOR_SELF_SAMPLE_SIGNAL (SIGRTMIN + 4)
+
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
 
 #define MONITOR_PRINTF(fmt, ...) \
     printf("\033[32m[MONITOR]\033[0m: " fmt, ##__VA_ARGS__);
@@ -55,19 +75,45 @@ enum {
 };
 
 /* --- Data Structures --- */
+
+// Written only by the owning thread (rdpmc), read by the monitor thread.
+// seq is odd while a write is in progress.
+typedef struct {
+    volatile unsigned seq;
+    uint64_t p[MEV_NUM_EVENTS];
+    uint64_t e[MEV_NUM_EVENTS];
+    uint64_t run_p;
+    uint64_t run_e;
+    uint64_t pf;                // page faults, read() by the owner
+    int cpu;                    // sched_getcpu() at the time of the sample
+} SelfSampleSlot;
+
 typedef struct {
     pid_t tid;
-    int active;
+    int state;                  // SLOT_*, see the thread registry below
+    uint32_t slot;              // index in the registry
+    uint32_t next_free;         // free-list link (slot + 1, 0 = end)
 
     int last_cpu;               // last observed CPU
     int last_pcore;             // last observed core type (1=P, 0=E)
-    uint32_t cpu_bitmask;
 
-    perf_monitor_t mon;
+    perf_dual_monitor_t mon;    // P and E event sets, both open for the thread's lifetime
     int mon_initialized;
 
-    uint64_t prev[MEV_NUM_EVENTS];
-    uint64_t curr[MEV_NUM_EVENTS];
+    uint64_t prev_p[MEV_NUM_EVENTS];
+    uint64_t prev_e[MEV_NUM_EVENTS];
+    uint64_t prev_pf;
+    uint64_t prev_run_p;        // time_running of the P set (ns)
+    uint64_t prev_run_e;        // time_running of the E set (ns)
+    double last_p_ms;           // residency on P-cores in the last window
+    double last_e_ms;           // residency on E-cores in the last window
+
+    // rdpmc self-sampling (MONITOR_RDPMC=1): the thread publishes its own counts
+    volatile int self_sampling;
+    volatile int self_busy;     // owner is inside self_sample_publish()
+    timer_t self_timer;
+    SelfSampleSlot self_slot;
+    unsigned self_seq_seen;     // slot seq the monitor last consumed
 
     // for actual storage IO
     int io_initialized;
@@ -80,23 +126,70 @@ static TelemetryMode g_mode = TELEMETRY_PROCESS;
 static pid_t g_main_tid = 0;
 
 static __thread int tl_disable_wrap = 0;
-static ThreadData thread_data[MAX_THREADS];
-static int thread_count = 0;
 static pid_t target_pid = 0;
-static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Shared-memory transport (MONITOR_TRANSPORT=socket disables it). The
+// socket stays in use until the scheduler has attached to the ring.
+static TelemetryRing *g_ring = NULL;
+static int g_ring_fd = -1;
+static int g_ring_efd = -1;
+// Serialises the monitor walk with finish_monitor(); application threads never take it
+static pthread_mutex_t g_walk_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* --- Thread registry ---
+ * Slots live in fixed-size segments that are allocated on demand and never
+ * freed, so a ThreadData pointer stays valid for the life of the process.
+ * Application threads claim and retire their own slot with atomics only.
+ * The monitor thread is the single reclaimer: it closes the fds of retired
+ * slots and pushes them on the free list, so a slot is never reused while
+ * the monitor is reading it.
+ */
+#define REGISTRY_SEGMENT_SHIFT 6
+#define REGISTRY_SEGMENT_SLOTS (1u << REGISTRY_SEGMENT_SHIFT)
+#define REGISTRY_MAX_SEGMENTS  1024
+#define REGISTRY_MAX_SLOTS     (REGISTRY_MAX_SEGMENTS * REGISTRY_SEGMENT_SLOTS)
+
+enum {
+    SLOT_FREE = 0,      // unused or on the free list
+    SLOT_INIT,          // claimed, owner is still setting it up
+    SLOT_LIVE,          // visible to the monitor
+    SLOT_EXITING        // owner is gone, monitor reclaims it
+};
+
+static ThreadData *g_segments[REGISTRY_MAX_SEGMENTS];
+static unsigned g_slot_hwm = 0;         // slots handed out so far
+static uint64_t g_free_head = 0;        // (ABA tag << 32) | (slot + 1), 0 = empty
+static __thread ThreadData *tl_slot = NULL;
 static int results_output = 0;
 
 static ProcessIOStats initial_io, final_io;
+// IO over the last resample interval (process, P-side, E-side) and its length
+static ProcessIOStats g_io_interval, g_io_p_interval, g_io_e_interval;
+static double g_io_interval_ms = 0.0;
+static double g_prev_full_ms = -1.0;
 static struct timespec start_time;
-static cpu_set_t global_cpuset;
+
+// All cpu sets are CPU_ALLOC'd for g_nr_cpus CPUs, so hosts beyond
+// CPU_SETSIZE work; use the *_S macros with g_cpuset_size on them.
+static const char *g_coreset = NULL;
+static int g_nr_cpus = 0;
+static size_t g_cpuset_size = 0;
+static cpu_set_t *global_cpuset = NULL;
+static cpu_set_t *g_seen_cpus = NULL;   // CPUs seen in the current window
 
 static double g_prev_exec_time_ms = -1.0;
 static int g_training_mode = 0;
 static ForceMode g_force_mode = FORCE_NONE;
+static int g_perf_grouped = 1;     // MONITOR_PERF_GROUP=0 -> one fd per event
+static int g_rdpmc_mode = 0;       // MONITOR_RDPMC=1 -> threads sample themselves
+static int g_self_sample_ms = MONITOR_SELF_SAMPLE_MILLISECONDS;
+static int g_interval_ms = MONITOR_RESAMPLE_INTERVAL_MILLISECONDS;
 
-static cpu_set_t g_pset;
-static cpu_set_t g_eset;
-static cpu_set_t g_forced_set;
+static __thread volatile int tl_in_publish = 0;
+
+static cpu_set_t *g_pset = NULL;
+static cpu_set_t *g_eset = NULL;
+static cpu_set_t *g_forced_set = NULL;
 static int g_forced_set_ready = 0;
 
 static unsigned long g_window_idx = 0;
@@ -114,10 +207,25 @@ static void (*real_pthread_exit)(void *) = NULL;
 static int (*real_pthread_join)(pthread_t, void **) = NULL;
 
 /* --- Forward Declarations --- */
-static int find_thread_index(pid_t tid);
-static int alloc_thread_slot(pid_t tid);
+static ThreadData *registry_claim(pid_t tid);
+static void registry_publish(ThreadData *td);
+static void registry_exit_self(void);
+static void registry_reclaim(ThreadData *td);
+static unsigned registry_nslots(void);
+static ThreadData *registry_slot(unsigned idx);
+static int thread_alive(pid_t tid);
 static int open_or_reopen_thread_perf(ThreadData *td, int cpu_now, int pcore_now);
-static void output_results(void);
+static void accumulate_window(long long *dst, const uint64_t *delta, int pcore);
+static unsigned int thread_sample_count(uint64_t events);
+static void add_thread_sample(ThreadSample *samples, int *n, const ThreadSample *ts);
+static void self_sample_publish(void);
+static void self_sample_start(ThreadData *td);
+static void self_sample_stop(ThreadData *td);
+static int read_self_slot(ThreadData *td, uint64_t *p, uint64_t *e, uint64_t *pf,
+                          uint64_t *run_p, uint64_t *run_e, int *cpu);
+static int read_thread_counts(ThreadData *td, uint64_t *p, uint64_t *e, uint64_t *pf,
+                              uint64_t *run_p, uint64_t *run_e);
+static void output_results(int full);
 static void *thread_wrapper(void *arg);
 static ForceMode parse_force_mode(const char *s);
 static void build_p_e_sets_from_global_cpuset(void);
@@ -126,119 +234,76 @@ static void training_apply_affinity(pid_t tid, const cpu_set_t *set, const char
 
 
 
-// detect if a CPU is P-core or E-core via sysfs
-static int detect_pcore_sysfs(int cpu) {
-    char path[128];
-    snprintf(path, sizeof(path),
-             "/sys/devices/system/cpu/cpu%d/topology/core_type", cpu);
-
-    FILE *fp = fopen(path, "r");
-    if (!fp) {
-        // if sysfs not available
-        return (cpu < 8) ? 1 : 0;
-    }
-
-    int core_type = 0;
-    if (fscanf(fp, "%d", &core_type) != 1) {
-        fclose(fp);
-        return (cpu < 8) ? 1 : 0;
+static cpu_set_t *alloc_cpuset(void) {
+    cpu_set_t *set = CPU_ALLOC(g_nr_cpus);
+    if (!set) {
+        MONITOR_PERROR("CPU_ALLOC(%d) failed\n", g_nr_cpus);
+        exit(1);
     }
-    fclose(fp);
-
-    // Common convention: performance=0, efficiency=1
-    if (core_type == 1) return 1;
-    if (core_type == 2) return 0;
+    CPU_ZERO_S(g_cpuset_size, set);
+    return set;
+}
 
-    // Unknown type -> fallback
-    return (cpu < 8) ? 1 : 0;
+static int cpu_in_set(int cpu, const cpu_set_t *set) {
+    return cpu >= 0 && cpu < g_nr_cpus && CPU_ISSET_S(cpu, g_cpuset_size, set);
 }
 
-// Initialize global_cpuset from CORESET
+// Size the cpu sets from the host and fill global_cpuset from CORESET
 static void init_global_cpuset() {
-    CPU_ZERO(&global_cpuset);
-    if (!CORESET || strlen(CORESET) == 0) {
+    const char *env = getenv("CORESET");
+    if (env && *env)      g_coreset = env;
+    else if (CORESET[0])  g_coreset = CORESET;
+    else                  g_coreset = topology_all_coreset();
+
+    g_nr_cpus = topology_nr_cpus();
+    long conf = sysconf(_SC_NPROCESSORS_CONF);
+    if (conf > g_nr_cpus) g_nr_cpus = (int)conf;
+    g_cpuset_size = CPU_ALLOC_SIZE(g_nr_cpus);
+
+    global_cpuset = alloc_cpuset();
+    g_seen_cpus = alloc_cpuset();
+    g_pset = alloc_cpuset();
+    g_eset = alloc_cpuset();
+    g_forced_set = alloc_cpuset();
+
+    if (!g_coreset[0]) {
         MONITOR_PERROR("CORESET is not defined or empty\n");
         exit(1);
     }
-    char *copy = strdup(CORESET);
-    char *token = strtok(copy, ",");
-    int core_count = 0;
-    while (token) {
-        if (strchr(token, '-')) {
-            int start, end;
-            if (sscanf(token, "%d-%d", &start, &end) == 2) {
-                if (start < 0 || end >= 16 || start > end) { // Limit to 16 CPUs
-                    MONITOR_PERROR("Invalid CORESET range: %s\n", token);
-                    free(copy);
-                    exit(1);
-                }
-                for (int i = start; i <= end; i++) {
-                    CPU_SET(i, &global_cpuset);
-                    core_count++;
-                }
-            }
-        } else {
-            int cpu = atoi(token);
-            if (cpu < 0 || cpu >= 16) { // Limit to 16 CPUs
-                MONITOR_PERROR("Invalid CORESET CPU: %s\n", token);
-                free(copy);
-                exit(1);
-            }
-            CPU_SET(cpu, &global_cpuset);
-            core_count++;
-        }
-        token = strtok(NULL, ",");
+    int core_count = topology_parse_cpulist(g_coreset, global_cpuset, g_cpuset_size);
+    if (core_count < 0) {
+        MONITOR_PERROR("Invalid CORESET %s (host has %d CPUs)\n", g_coreset, g_nr_cpus);
+        exit(1);
     }
-    free(copy);
     if (core_count == 0) {
-        MONITOR_PERROR("No valid cores in CORESET %s\n", CORESET);
+        MONITOR_PERROR("No valid cores in CORESET %s\n", g_coreset);
         exit(1);
     }
     #ifndef QUIET_MONITOR
-    MONITOR_PRINTF("Initialized global_cpuset for CORESET=%s, core_count=%d\n", CORESET, core_count);
+    MONITOR_PRINTF("Initialized global_cpuset for CORESET=%s, core_count=%d, nr_cpus=%d\n",
+                   g_coreset, core_count, g_nr_cpus);
     #endif
 }
 
 // Set affinity for a PID or TID
 static void set_affinity(pid_t pid, const char *coreset) {
-    cpu_set_t cpuset;
-    CPU_ZERO(&cpuset);
     if (!coreset || strlen(coreset) == 0) {
         MONITOR_PERROR("CORESET is not defined or empty\n");
         exit(1);
     }
-    char *copy = strdup(coreset);
-    char *token = strtok(copy, ",");
-    while (token) {
-        if (strchr(token, '-')) {
-            int start, end;
-            if (sscanf(token, "%d-%d", &start, &end) == 2) {
-                if (start < 0 || end >= 16 || start > end) { // Limit to 32 CPUs
-                    MONITOR_PERROR("Invalid CORESET range: %s\n", token);
-                    free(copy);
-                    exit(1);
-                }
-                for (int i = start; i <= end; i++) {
-                    CPU_SET(i, &cpuset);
-                }
-            }
-        } else {
-            int cpu = atoi(token);
-            if (cpu < 0 || cpu >= 16) { // Limit to 32 CPUs
-                MONITOR_PERROR("Invalid CORESET CPU: %s\n", token);
-                free(copy);
-                exit(1);
-            }
-            CPU_SET(cpu, &cpuset);
-        }
-        token = strtok(NULL, ",");
+    cpu_set_t *cpuset = alloc_cpuset();
+    if (topology_parse_cpulist(coreset, cpuset, g_cpuset_size) <= 0) {
+        MONITOR_PERROR("Invalid CORESET: %s\n", coreset);
+        CPU_FREE(cpuset);
+        exit(1);
     }
-    free(copy);
 
-    if (sched_setaffinity(pid, sizeof(cpu_set_t), &cpuset) == -1) {
+    if (sched_setaffinity(pid, g_cpuset_size, cpuset) == -1) {
         MONITOR_PERROR("Failed to set affinity for PID/TID %d: %s\n", pid, strerror(errno));
+        CPU_FREE(cpuset);
         return;
     }
+    CPU_FREE(cpuset);
     #ifndef QUIET_MONITOR
     MONITOR_PRINTF("Pinned PID/TID %d to coreset %s\n", pid, coreset);
     #endif
@@ -297,7 +362,7 @@ static int get_thread_cpu(pid_t tid) {
         MONITOR_PERROR("Failed to open %s: %s\n", path, strerror(errno));
         return -1;
     }
-    char line[256];
+    char line[1024];
     if (!fgets(line, sizeof(line), fp)) {
         MONITOR_PERROR("Failed to read %s: %s\n", path, strerror(errno));
         fclose(fp);
@@ -316,7 +381,7 @@ static int get_thread_cpu(pid_t tid) {
         MONITOR_PERROR("Failed to parse CPU from %s\n", path);
         return -1;
     }
-    if (cpu < 0 || cpu >= 16 || !CPU_ISSET(cpu, &global_cpuset)) {
+    if (!cpu_in_set(cpu, global_cpuset)) {
         MONITOR_PERROR("Thread %d: Invalid CPU %d\n", tid, cpu);
         return -1;
     }
@@ -352,7 +417,82 @@ static void calculate_ratios(long long *total_values, ProcessIOStats *io_delta,
 }
 
 // Send data to scheduler
+// Create the memfd ring and its doorbell; they are handed over with the
+// startup notification
+static void telemetry_ring_setup(void) {
+    const char *t = getenv("MONITOR_TRANSPORT");
+    if (t && strcmp(t, "socket") == 0) return;
+
+    int fd = memfd_create(TELEMETRY_RING_MEMFD_NAME, MFD_CLOEXEC);
+    if (fd < 0) {
+        MONITOR_PERROR("memfd_create: %s, using socket transport\n", strerror(errno));
+        return;
+    }
+    if (ftruncate(fd, sizeof(TelemetryRing)) != 0) {
+        MONITOR_PERROR("ftruncate ring: %s, using socket transport\n", strerror(errno));
+        close(fd);
+        return;
+    }
+    void *p = mmap(NULL, sizeof(TelemetryRing), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+        MONITOR_PERROR("mmap ring: %s, using socket transport\n", strerror(errno));
+        close(fd);
+        return;
+    }
+    int efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (efd < 0) {
+        MONITOR_PERROR("eventfd: %s, using socket transport\n", strerror(errno));
+        munmap(p, sizeof(TelemetryRing));
+        close(fd);
+        return;
+    }
+
+    g_ring = (TelemetryRing *)p;
+    telemetry_ring_init(g_ring, getpid());
+    g_ring_fd = fd;
+    g_ring_efd = efd;
+}
+
+// Write the pid, attaching the ring fds to it on the startup notification
+static int send_pid_with_ring(int sock, pid_t pid, int startup_flag) {
+    if (!startup_flag || !g_ring) {
+        return write(sock, &pid, sizeof(pid)) == sizeof(pid) ? 0 : -1;
+    }
+
+    int fds[2] = { g_ring_fd, g_ring_efd };
+    char cbuf[CMSG_SPACE(sizeof(fds))];
+    memset(cbuf, 0, sizeof(cbuf));
+
+    struct iovec iov = { .iov_base = &pid, .iov_len = sizeof(pid) };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cbuf;
+    msg.msg_controllen = sizeof(cbuf);
+
+    struct cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+    cm->cmsg_level = SOL_SOCKET;
+    cm->cmsg_type = SCM_RIGHTS;
+    cm->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cm), fds, sizeof(fds));
+
+    return sendmsg(sock, &msg, 0) == sizeof(pid) ? 0 : -1;
+}
+
 static void send_to_scheduler(const MonitorData *data, int startup_flag) {
+    // fast path: publish into the shared ring once the scheduler has attached
+    if (!startup_flag && g_ring && __atomic_load_n(&g_ring->consumer_attached, __ATOMIC_ACQUIRE)) {
+        if (telemetry_ring_push(g_ring, data) == 0) {
+            telemetry_ring_doorbell(g_ring, g_ring_efd);
+            return;
+        }
+        // the scheduler stopped draining (gone or stuck), use the socket from now on
+        MONITOR_PERROR("Telemetry ring full (%llu dropped), falling back to socket\n",
+                       (unsigned long long)g_ring->dropped);
+        __atomic_store_n(&g_ring->consumer_attached, 0, __ATOMIC_RELEASE);
+    }
+
     #ifndef QUIET_MONITOR
     MONITOR_PRINTF("Sending %s to scheduler\n", startup_flag ? "startup notification" : "data");
     #endif
@@ -378,8 +518,7 @@ static void send_to_scheduler(const MonitorData *data, int startup_flag) {
 
     pid_t pid = getpid();
     ssize_t bytes_written;
-    bytes_written = write(sock, &pid, sizeof(pid));
-    if (bytes_written != sizeof(pid)) {
+    if (send_pid_with_ring(sock, pid, startup_flag) != 0) {
         MONITOR_PERROR("Failed to write PID: %s\n", strerror(errno));
         close(sock);
         return;
@@ -411,19 +550,34 @@ static void send_to_scheduler(const MonitorData *data, int startup_flag) {
     }
 }
 
-static void output_results(void) {
+// Scale an IO delta to a window of another length
+static void scale_io(ProcessIOStats *io, double f) {
+    io->rchar       = (unsigned long long)(io->rchar * f);
+    io->wchar       = (unsigned long long)(io->wchar * f);
+    io->syscr       = (unsigned long long)(io->syscr * f);
+    io->syscw       = (unsigned long long)(io->syscw * f);
+    io->read_bytes  = (unsigned long long)(io->read_bytes * f);
+    io->write_bytes = (unsigned long long)(io->write_bytes * f);
+}
+
+// full = 1: resample interval, thread CPUs and IO come from /proc.
+// full = 0: self-sample window, built from the threads' slots only; threads
+// on the read() path and the IO counters are picked up by the next full window.
+static void output_results(int full) {
 #ifndef QUIET_MONITOR
     MONITOR_PRINTF("Outputting results\n");
 #endif
-    pthread_mutex_lock(&mutex);
+    pthread_mutex_lock(&g_walk_lock);
 
     g_window_idx++;
-
-    if (g_training_mode && g_forced_set_ready) {
-        // re pin every active thread each window.
-        for (int i = 0; i < thread_count; i++) {
-            if (!thread_data[i].active) continue;
-            training_apply_affinity(thread_data[i].tid, &g_forced_set, "repin/window");
+    unsigned nslots = registry_nslots();
+
+    if (full && g_training_mode && g_forced_set_ready) {
+        // re pin every live thread each window.
+        for (unsigned s = 0; s < nslots; s++) {
+            ThreadData *td = registry_slot(s);
+            if (!td || __atomic_load_n(&td->state, __ATOMIC_ACQUIRE) != SLOT_LIVE) continue;
+            training_apply_affinity(td->tid, g_forced_set, "repin/window");
         }
     }
 
@@ -436,64 +590,84 @@ static void output_results(void) {
     ProcessIOStats io_p_delta = {0};
     ProcessIOStats io_e_delta = {0};
 
+    int live_threads = 0;
     int hw_thread_count = 0;
     int pthread_count_local = 0;   // threads currently on P-cores
     int pcore_count = 0;
     int ecore_count = 0;
     int total_cores = 0;
 
-    uint32_t seen_pcore_mask = 0;
-    uint32_t seen_ecore_mask = 0;
+    CPU_ZERO_S(g_cpuset_size, g_seen_cpus);
 
-    for (int i = 0; i < thread_count; i++) {
-        if (!thread_data[i].active) continue;
+    double p_time_ms = 0.0;        // summed thread residency on P-cores
+    double e_time_ms = 0.0;        // summed thread residency on E-cores
 
-        pid_t tid = thread_data[i].tid;
+    ThreadSample samples[MAX_THREAD_SAMPLES];
+    int nsamples = 0;
 
-        int cpu = get_thread_cpu(tid);
+    for (unsigned s = 0; s < nslots; s++) {
+        ThreadData *td = registry_slot(s);
+        if (!td) continue;
+        int state = __atomic_load_n(&td->state, __ATOMIC_ACQUIRE);
+        if (state == SLOT_EXITING) {
+            registry_reclaim(td);
+            continue;
+        }
+        if (state != SLOT_LIVE) continue;
+        live_threads++;
+
+        pid_t tid = td->tid;
+
+        uint64_t curr_p[MEV_NUM_EVENTS], curr_e[MEV_NUM_EVENTS], curr_pf;
+        uint64_t run_p_now, run_e_now;
+        int cpu = -1;
+        int have_counts = 0;
+        if (!full) {
+            if (!td->self_sampling ||
+                read_self_slot(td, curr_p, curr_e, &curr_pf, &run_p_now, &run_e_now, &cpu) != 0 ||
+                cpu < 0) {
+                continue;
+            }
+            have_counts = 1;
+        } else {
+            cpu = get_thread_cpu(tid);
+        }
         if (cpu < 0) {
-            // close perf fds if open and mark inactive
-            if (thread_data[i].mon_initialized) {
-                perf_monitor_close(&thread_data[i].mon);
-                thread_data[i].mon_initialized = 0;
+            // gone without passing through our wrappers (raw clone, cancellation);
+            // a live thread outside CORESET is only skipped for this window
+            if (!thread_alive(tid)) {
+                registry_reclaim(td);
+                live_threads--;
             }
-            thread_data[i].active = 0;
-            thread_data[i].io_initialized = 0;
             continue;
         }
 
         hw_thread_count++;
-        int pcore_now = detect_pcore_sysfs(cpu);
+        int pcore_now = topology_is_pcore(cpu);
         // track unique cores used this window
-        if (pcore_now) {
-            pthread_count_local++;
-            if (!(seen_pcore_mask & (1U << cpu))) {
-                seen_pcore_mask |= (1U << cpu);
-                pcore_count++;
-            }
-        } else {
-            if (!(seen_ecore_mask & (1U << cpu))) {
-                seen_ecore_mask |= (1U << cpu);
-                ecore_count++;
-            }
+        if (pcore_now) pthread_count_local++;
+        if (!CPU_ISSET_S(cpu, g_cpuset_size, g_seen_cpus)) {
+            CPU_SET_S(cpu, g_cpuset_size, g_seen_cpus);
+            if (pcore_now) pcore_count++;
+            else           ecore_count++;
         }
         
-        // get io for storage 
+        // get io for storage (full windows only)
         ProcessIOStats tio;
-        if (get_thread_io_stats(target_pid, tid, &tio) == 0) {
-            if (!thread_data[i].io_initialized) {
-                thread_data[i].prev_io = tio;
-                thread_data[i].io_initialized = 1;
+        if (full && get_thread_io_stats(target_pid, tid, &tio) == 0) {
+            if (!td->io_initialized) {
+                td->prev_io = tio;
+                td->io_initialized = 1;
             } else {
                 ProcessIOStats d = {
-                    .rchar       = tio.rchar       - thread_data[i].prev_io.rchar,
-                    .wchar       = tio.wchar       - thread_data[i].prev_io.wchar,
-                    .syscr       = tio.syscr       - thread_data[i].prev_io.syscr,
-                    .syscw       = tio.syscw       - thread_data[i].prev_io.syscw,
-                    .read_bytes  = tio.read_bytes  - thread_data[i].prev_io.read_bytes,
-                    .write_bytes = tio.write_bytes - thread_data[i].prev_io.write_bytes
+                    .rchar       = tio.rchar       - td->prev_io.rchar,
+                    .wchar       = tio.wchar       - td->prev_io.wchar,
+                    .syscr       = tio.syscr       - td->prev_io.syscr,
+                    .syscw       = tio.syscw       - td->prev_io.syscw,
+                    .read_bytes  = tio.read_bytes  - td->prev_io.read_bytes,
+                    .write_bytes = tio.write_bytes - td->prev_io.write_bytes
                 };
-                thread_data[i].prev_io = tio;
+                td->prev_io = tio;
 
                 ProcessIOStats *dstio = pcore_now ? &io_p_delta : &io_e_delta;
                 dstio->rchar       += d.rchar;
@@ -503,89 +677,95 @@ static void output_results(void) {
                 dstio->read_bytes  += d.read_bytes;
                 dstio->write_bytes += d.write_bytes;
             }
-        } else {
+        } else if (full) {
              //skip if per thread io failed
-            thread_data[i].io_initialized = 0;
+            td->io_initialized = 0;
         }
        
 #ifdef MONITOR_SPLIT_DEBUG
         MONITOR_PRINTF("[Placement] tid=%d cpu=%d class=%s\n",
                        (int)tid, cpu, pcore_now ? "P" : "E");
 #endif
-        // reopen if not initialized or core type changed
-        if (!thread_data[i].mon_initialized || thread_data[i].last_pcore != pcore_now) {
-            open_or_reopen_thread_perf(&thread_data[i], cpu, pcore_now);
-            // skip this window after reopen to avoid weird deltas
+        // both PMU sets stay open across migrations; the first sighting only sets a baseline
+        if (!td->mon_initialized) {
+            open_or_reopen_thread_perf(td, cpu, pcore_now);
             continue;
         }
+        td->last_cpu = cpu;
+        td->last_pcore = pcore_now;
 
-        if (perf_monitor_read(&thread_data[i].mon, thread_data[i].curr) != 0) {
+        if (!have_counts && read_thread_counts(td, curr_p, curr_e, &curr_pf,
+                                               &run_p_now, &run_e_now) != 0) {
             continue;
         }
 
-        uint64_t delta[MEV_NUM_EVENTS];
+        uint64_t delta_p[MEV_NUM_EVENTS], delta_e[MEV_NUM_EVENTS];
         for (int e = 0; e < MEV_NUM_EVENTS; e++) {
-            delta[e] = thread_data[i].curr[e] - thread_data[i].prev[e];
+            delta_p[e] = curr_p[e] - td->prev_p[e];
+            delta_e[e] = curr_e[e] - td->prev_e[e];
         }
-        memcpy(thread_data[i].prev, thread_data[i].curr, sizeof(thread_data[i].prev));
-
-        uint64_t inst_retired     = delta[MEV_INST_RETIRED];
-        uint64_t core_cycles      = delta[MEV_CORE_CYCLES];
-        uint64_t mem_retired      = delta[MEV_MEM_LOADS] + delta[MEV_MEM_STORES];
-        uint64_t mem_stall_cycles = delta[MEV_MEM_STALL_CYCLES];
-        uint64_t page_faults      = delta[MEV_PAGE_FAULTS];
-        uint64_t uops_retired     = delta[MEV_UOPS_RETIRED];
-
-        // your requirement:
-        uint64_t cache_misses = pcore_now ? delta[MEV_L3_LOAD_MISS] : delta[MEV_CACHE_LOAD_MISS];
-
-        total_values[MON_INST_RETIRED]     += (long long)inst_retired;
-        total_values[MON_CACHE_MISSES]     += (long long)cache_misses;
-        total_values[MON_CORE_CYCLES]      += (long long)core_cycles;
-        total_values[MON_MEM_RETIRED]      += (long long)mem_retired;
-        total_values[MON_PAGE_FAULTS]      += (long long)page_faults;
-        total_values[MON_MEM_STALL_CYCLES] += (long long)mem_stall_cycles;
-        total_values[MON_UOPS_RETIRED]     += (long long)uops_retired;
-        
-        // second mode 
-        long long *dst = pcore_now ? total_values_p : total_values_e;
+        uint64_t d_pf  = curr_pf - td->prev_pf;
+        uint64_t run_p = run_p_now - td->prev_run_p;
+        uint64_t run_e = run_e_now - td->prev_run_e;
+
+        memcpy(td->prev_p, curr_p, sizeof(curr_p));
+        memcpy(td->prev_e, curr_e, sizeof(curr_e));
+        td->prev_pf    = curr_pf;
+        td->prev_run_p = run_p_now;
+        td->prev_run_e = run_e_now;
+        td->last_p_ms  = run_p / 1e6;
+        td->last_e_ms  = run_e / 1e6;
+
+        // page faults are counted thread-wide, split them by residency
+        uint64_t run_total = run_p + run_e;
+        delta_p[MEV_PAGE_FAULTS] = run_total ? (uint64_t)((double)d_pf * run_p / run_total)
+                                             : (pcore_now ? d_pf : 0);
+        delta_e[MEV_PAGE_FAULTS] = d_pf - delta_p[MEV_PAGE_FAULTS];
+
+        p_time_ms += td->last_p_ms;
+        e_time_ms += td->last_e_ms;
 
-        dst[MON_INST_RETIRED]     += (long long)inst_retired;
-        dst[MON_CACHE_MISSES]     += (long long)cache_misses;
-        dst[MON_CORE_CYCLES]      += (long long)core_cycles;
-        dst[MON_MEM_RETIRED]      += (long long)mem_retired;
-        dst[MON_PAGE_FAULTS]      += (long long)page_faults;
-        dst[MON_MEM_STALL_CYCLES] += (long long)mem_stall_cycles;
-        dst[MON_UOPS_RETIRED]     += (long long)uops_retired;
+#ifdef MONITOR_SPLIT_DEBUG
+        MONITOR_PRINTF("[Residency] tid=%d P=%.3fms E=%.3fms\n",
+                       (int)tid, td->last_p_ms, td->last_e_ms);
+#endif
+
+        ThreadSample ts = {
+            .tid              = (int)tid,
+            .cpu              = (unsigned short)cpu,
+            .pcore            = (unsigned char)pcore_now,
+            .inst_retired     = thread_sample_count(delta_p[MEV_INST_RETIRED] + delta_e[MEV_INST_RETIRED]),
+            .core_cycles      = thread_sample_count(delta_p[MEV_CORE_CYCLES] + delta_e[MEV_CORE_CYCLES]),
+            .cache_misses     = thread_sample_count(delta_p[MEV_L3_LOAD_MISS] + delta_e[MEV_CACHE_LOAD_MISS]),
+            .mem_stall_cycles = thread_sample_count(delta_p[MEV_MEM_STALL_CYCLES] + delta_e[MEV_MEM_STALL_CYCLES]),
+        };
+        add_thread_sample(samples, &nsamples, &ts);
+
+        accumulate_window(total_values, delta_p, 1);
+        accumulate_window(total_values, delta_e, 0);
+
+        // second mode: split by the PMU that actually counted
+        accumulate_window(total_values_p, delta_p, 1);
+        accumulate_window(total_values_e, delta_e, 0);
     }
 
     total_cores = pcore_count + ecore_count;
 
     // Fill MonitorData and send
     MonitorData data = (MonitorData){0};
-    data.thread_count    = thread_count;
+    data.thread_count    = live_threads;
     data.hw_thread_count = hw_thread_count;
     data.pthread_count   = pthread_count_local;
     data.pcore_count     = pcore_count;
     data.ecore_count     = ecore_count;
     data.total_cores     = total_cores;
+    data.p_time_ms       = p_time_ms;
+    data.e_time_ms       = e_time_ms;
+    data.thread_sample_count = nsamples;
+    memcpy(data.threads, samples, nsamples * sizeof(ThreadSample));
 
     memcpy(data.total_values, total_values, sizeof(total_values));
 
-    data.io_delta = (ProcessIOStats){
-        final_io.rchar       - initial_io.rchar,
-        final_io.wchar       - initial_io.wchar,
-        final_io.syscr       - initial_io.syscr,
-        final_io.syscw       - initial_io.syscw,
-        final_io.read_bytes  - initial_io.read_bytes,
-        final_io.write_bytes - initial_io.write_bytes
-    };
-    memcpy(&initial_io, &final_io, sizeof(ProcessIOStats));
-
-    calculate_ratios(total_values, &data.io_delta, &data.ratios);
-    calculate_ratios(total_values_p, &io_p_delta, &ratios_p);
-    calculate_ratios(total_values_e, &io_e_delta, &ratios_e);
-
     struct timespec end_time;
     clock_gettime(CLOCK_MONOTONIC, &end_time);
     data.exec_time_ms = (end_time.tv_sec - start_time.tv_sec) * 1000.0 +
@@ -595,8 +775,40 @@ static void output_results(void) {
     if (g_prev_exec_time_ms < 0.0) dt_ms = 0.0;   // first window
     else dt_ms = data.exec_time_ms - g_prev_exec_time_ms;
     g_prev_exec_time_ms = data.exec_time_ms;
+    data.dt_ms = dt_ms;
+
+    // IO is measured over the resample interval; every window reports it at
+    // the rate of the last full interval so the per-cycle features stay smooth
+    if (full) {
+        g_io_interval = (ProcessIOStats){
+            final_io.rchar       - initial_io.rchar,
+            final_io.wchar       - initial_io.wchar,
+            final_io.syscr       - initial_io.syscr,
+            final_io.syscw       - initial_io.syscw,
+            final_io.read_bytes  - initial_io.read_bytes,
+            final_io.write_bytes - initial_io.write_bytes
+        };
+        memcpy(&initial_io, &final_io, sizeof(ProcessIOStats));
+        g_io_p_interval = io_p_delta;
+        g_io_e_interval = io_e_delta;
+        g_io_interval_ms = g_prev_full_ms < 0.0 ? 0.0 : data.exec_time_ms - g_prev_full_ms;
+        g_prev_full_ms = data.exec_time_ms;
+    }
+    data.io_delta = g_io_interval;
+    io_p_delta = g_io_p_interval;
+    io_e_delta = g_io_e_interval;
+    if (g_io_interval_ms > 0.0 && dt_ms != g_io_interval_ms) {
+        double f = dt_ms / g_io_interval_ms;
+        scale_io(&data.io_delta, f);
+        scale_io(&io_p_delta, f);
+        scale_io(&io_e_delta, f);
+    }
+
+    calculate_ratios(total_values, &data.io_delta, &data.ratios);
+    calculate_ratios(total_values_p, &io_p_delta, &ratios_p);
+    calculate_ratios(total_values_e, &io_e_delta, &ratios_e);
     
-    pthread_mutex_unlock(&mutex);
+    pthread_mutex_unlock(&g_walk_lock);
     double d_inst   = (double)total_values[MON_INST_RETIRED];
     double d_cycles = (double)total_values[MON_CORE_CYCLES];
     double CPI = d_inst > 0.0 ? (d_cycles / d_inst) : 0.0;
@@ -729,6 +941,180 @@ static void output_results(void) {
     send_to_scheduler(&data, 0);
 }
 
+// Scale one thread's event delta into a ThreadSample count
+static unsigned int thread_sample_count(uint64_t events) {
+    events >>= THREAD_SAMPLE_SHIFT;
+    return events > UINT32_MAX ? UINT32_MAX : (unsigned int)events;
+}
+
+// Keep the MAX_THREAD_SAMPLES busiest threads of the window (by core cycles)
+static void add_thread_sample(ThreadSample *samples, int *n, const ThreadSample *ts) {
+    if (*n < MAX_THREAD_SAMPLES) {
+        samples[(*n)++] = *ts;
+        return;
+    }
+    int min = 0;
+    for (int i = 1; i < *n; i++) {
+        if (samples[i].core_cycles < samples[min].core_cycles) min = i;
+    }
+    if (ts->core_cycles > samples[min].core_cycles) samples[min] = *ts;
+}
+
+// Add one PMU side's deltas into a MON_* totals array
+static void accumulate_window(long long *dst, const uint64_t *delta, int pcore) {
+    uint64_t inst_retired     = delta[MEV_INST_RETIRED];
+    uint64_t core_cycles      = delta[MEV_CORE_CYCLES];
+    uint64_t mem_retired      = delta[MEV_MEM_LOADS] + delta[MEV_MEM_STORES];
+    uint64_t mem_stall_cycles = delta[MEV_MEM_STALL_CYCLES];
+    uint64_t page_faults      = delta[MEV_PAGE_FAULTS];
+    uint64_t uops_retired     = delta[MEV_UOPS_RETIRED];
+
+    // your requirement:
+    uint64_t cache_misses = pcore ? delta[MEV_L3_LOAD_MISS] : delta[MEV_CACHE_LOAD_MISS];
+
+    dst[MON_INST_RETIRED]     += (long long)inst_retired;
+    dst[MON_CACHE_MISSES]     += (long long)cache_misses;
+    dst[MON_CORE_CYCLES]      += (long long)core_cycles;
+    dst[MON_MEM_RETIRED]      += (long long)mem_retired;
+    dst[MON_PAGE_FAULTS]      += (long long)page_faults;
+    dst[MON_MEM_STALL_CYCLES] += (long long)mem_stall_cycles;
+    dst[MON_UOPS_RETIRED]     += (long long)uops_retired;
+}
+
+// Publish the calling thread's counters to its slot. Runs on the owning
+// thread only: from the self-sample timer signal or an intercepted call.
+static void self_sample_publish(void) {
+    ThreadData *td = tl_slot;
+    if (!td || !td->self_sampling || tl_in_publish) return;
+    tl_in_publish = 1;
+
+    // self_sample_stop() clears self_sampling and then waits for self_busy,
+    // so the perf pages stay mapped until we are done with them
+    __atomic_store_n(&td->self_busy, 1, __ATOMIC_SEQ_CST);
+    uint64_t p[MEV_NUM_EVENTS], e[MEV_NUM_EVENTS], pf;
+    if (__atomic_load_n(&td->self_sampling, __ATOMIC_SEQ_CST) &&
+        perf_dual_monitor_read_self(&td->mon, p, e) == 0 &&
+        perf_dual_monitor_read_pf(&td->mon, &pf) == 0) {
+        SelfSampleSlot *slot = &td->self_slot;
+        unsigned seq = slot->seq;
+        __atomic_store_n(&slot->seq, seq + 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        memcpy(slot->p, p, sizeof(p));
+        memcpy(slot->e, e, sizeof(e));
+        slot->run_p = td->mon.p.time_running;
+        slot->run_e = td->mon.e.time_running;
+        slot->pf = pf;
+        slot->cpu = sched_getcpu();
+        __atomic_store_n(&slot->seq, seq + 2, __ATOMIC_RELEASE);
+    }
+    __atomic_store_n(&td->self_busy, 0, __ATOMIC_RELEASE);
+
+    tl_in_publish = 0;
+}
+
+static void self_sample_handler(int sig) {
+    (void)sig;
+    int saved_errno = errno;
+    self_sample_publish();
+    errno = saved_errno;
+}
+
+// Runs on the thread itself (tl_slot == td), after its perf sets are open. The timer counts
+// the thread's own CPU time, so idle threads are never interrupted.
+static void self_sample_start(ThreadData *td) {
+    if (!g_rdpmc_mode || !td->mon_initialized) return;
+
+    if (perf_dual_monitor_mmap(&td->mon) != 0) {
+        MONITOR_PERROR("rdpmc not usable for tid=%d, monitor thread will read()\n", td->tid);
+        return;
+    }
+
+    memset(&td->self_slot, 0, sizeof(td->self_slot));
+    td->self_sampling = 1;
+    self_sample_publish();
+
+    struct sigevent sev;
+    memset(&sev, 0, sizeof(sev));
+    sev.sigev_notify = SIGEV_THREAD_ID;
+    sev.sigev_signo = MONITOR_SELF_SAMPLE_SIGNAL;
+    sev.sigev_notify_thread_id = td->tid;
+    if (timer_create(CLOCK_THREAD_CPUTIME_ID, &sev, &td->self_timer) != 0) {
+        MONITOR_PERROR("timer_create failed for tid=%d: %s\n", td->tid, strerror(errno));
+        td->self_sampling = 0;
+        return;
+    }
+
+    struct itimerspec its;
+    its.it_value.tv_sec = g_self_sample_ms / 1000;
+    its.it_value.tv_nsec = (long)(g_self_sample_ms % 1000) * 1000000L;
+    its.it_interval = its.it_value;
+    if (timer_settime(td->self_timer, 0, &its, NULL) != 0) {
+        MONITOR_PERROR("timer_settime failed for tid=%d: %s\n", td->tid, strerror(errno));
+        timer_delete(td->self_timer);
+        td->self_sampling = 0;
+    }
+}
+
+// Must run before the perf pages are unmapped. A signal already on its way
+// finds self_sampling clear; one already inside the handler is waited for.
+static void self_sample_stop(ThreadData *td) {
+    if (!td->self_sampling) return;
+    __atomic_store_n(&td->self_sampling, 0, __ATOMIC_SEQ_CST);
+    timer_delete(td->self_timer);
+    while (__atomic_load_n(&td->self_busy, __ATOMIC_SEQ_CST) && thread_alive(td->tid))
+        sched_yield();
+}
+
+// Latest snapshot the thread published for itself, no syscalls
+static int read_self_slot(ThreadData *td, uint64_t *p, uint64_t *e, uint64_t *pf,
+                          uint64_t *run_p, uint64_t *run_e, int *cpu) {
+    SelfSampleSlot *slot = &td->self_slot;
+    for (int tries = 0; tries < 16; tries++) {
+        unsigned seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1) continue;
+        memcpy(p, slot->p, sizeof(slot->p));
+        memcpy(e, slot->e, sizeof(slot->e));
+        *run_p = slot->run_p;
+        *run_e = slot->run_e;
+        *pf = slot->pf;
+        *cpu = slot->cpu;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) == seq) {
+            td->self_seq_seen = seq;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// Cumulative counts and residency of one thread. With self-sampling
+// everything comes from the slot.
+static int read_thread_counts(ThreadData *td, uint64_t *p, uint64_t *e, uint64_t *pf,
+                              uint64_t *run_p, uint64_t *run_e) {
+    int cpu;
+    if (td->self_sampling && read_self_slot(td, p, e, pf, run_p, run_e, &cpu) == 0) return 0;
+    // the owner kept the slot busy, take the kernel path this window
+
+    if (perf_dual_monitor_read(&td->mon, p, e, pf) != 0) return -1;
+    *run_p = td->mon.p.time_running;
+    *run_e = td->mon.e.time_running;
+    return 0;
+}
+
+// 1 if some self-sampling thread published since the last window
+static int self_samples_fresh(void) {
+    int fresh = 0;
+    pthread_mutex_lock(&g_walk_lock);
+    unsigned nslots = registry_nslots();
+    for (unsigned s = 0; s < nslots && !fresh; s++) {
+        ThreadData *td = registry_slot(s);
+        if (!td || __atomic_load_n(&td->state, __ATOMIC_ACQUIRE) != SLOT_LIVE || !td->self_sampling) continue;
+        fresh = __atomic_load_n(&td->self_slot.seq, __ATOMIC_ACQUIRE) != td->self_seq_seen;
+    }
+    pthread_mutex_unlock(&g_walk_lock);
+    return fresh;
+}
+
 static ForceMode parse_force_mode(const char *s) {
     if (!s || !*s) return FORCE_NONE;
     if (!strcmp(s, "P") || !strcmp(s, "p")) return FORCE_P;
@@ -738,26 +1124,23 @@ static ForceMode parse_force_mode(const char *s) {
 }
 
 static void build_p_e_sets_from_global_cpuset(void) {
-    CPU_ZERO(&g_pset);
-    CPU_ZERO(&g_eset);
-
-    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
-        if (!CPU_ISSET(cpu, &global_cpuset)) continue;
-        int is_p = detect_pcore_sysfs(cpu);
-        if (is_p) CPU_SET(cpu, &g_pset);
-        else      CPU_SET(cpu, &g_eset);
+    CPU_ZERO_S(g_cpuset_size, g_pset);
+    CPU_ZERO_S(g_cpuset_size, g_eset);
+
+    for (int cpu = 0; cpu < g_nr_cpus; cpu++) {
+        if (!CPU_ISSET_S(cpu, g_cpuset_size, global_cpuset)) continue;
+        int is_p = topology_is_pcore(cpu);
+        if (is_p) CPU_SET_S(cpu, g_cpuset_size, g_pset);
+        else      CPU_SET_S(cpu, g_cpuset_size, g_eset);
     }
 }
 
 static int is_cpuset_empty(const cpu_set_t *set) {
-    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
-        if (CPU_ISSET(cpu, set)) return 0;
-    }
-    return 1;
+    return CPU_COUNT_S(g_cpuset_size, set) == 0;
 }
 
 static void training_apply_affinity(pid_t tid, const cpu_set_t *set, const char *tag) {
-    if (sched_setaffinity(tid, sizeof(cpu_set_t), set) != 0) {
+    if (sched_setaffinity(tid, g_cpuset_size, set) != 0) {
         MONITOR_PERROR("[TRAINING] sched_setaffinity(%s) failed tid=%d: %s\n",
                        tag, (int)tid, strerror(errno));
         exit(1);
@@ -772,39 +1155,28 @@ static void *thread_wrapper(void *arg) {
     pid_t tid = syscall(SYS_gettid);
 
     if (g_training_mode && g_forced_set_ready) {
-        training_apply_affinity(0 /* self */, &g_forced_set, "thread_wrapper/self");
+        training_apply_affinity(0 /* self */, g_forced_set, "thread_wrapper/self");
     }
 
-    pthread_mutex_lock(&mutex);
-    int idx = alloc_thread_slot(tid);
-    pthread_mutex_unlock(&mutex);
-
-    if (idx >= 0) {
+    // the slot stays private (SLOT_INIT) until perf is open, so no locking
+    ThreadData *td = registry_claim(tid);
+    if (td) {
+        tl_slot = td;
         int cpu = sched_getcpu();
         if (cpu >= 0) {
-            int pcore_now = detect_pcore_sysfs(cpu);
-            pthread_mutex_lock(&mutex);
-            thread_data[idx].cpu_bitmask = (cpu < 32) ? (1U << cpu) : 0;
-            open_or_reopen_thread_perf(&thread_data[idx], cpu, pcore_now);
-            pthread_mutex_unlock(&mutex);
+            int pcore_now = topology_is_pcore(cpu);
+            open_or_reopen_thread_perf(td, cpu, pcore_now);
+            self_sample_start(td);
         }
+        registry_publish(td);
     } else {
-        MONITOR_PERROR("Thread limit reached (%d)\n", MAX_THREADS);
+        MONITOR_PERROR("Thread registry full (%u slots)\n", REGISTRY_MAX_SLOTS);
     }
 
     void *ret = start_routine(start_arg);
 
-    // cleanup on thread exit
-    pthread_mutex_lock(&mutex);
-    int idx2 = find_thread_index(tid);
-    if (idx2 >= 0) {
-        if (thread_data[idx2].mon_initialized) {
-            perf_monitor_close(&thread_data[idx2].mon);
-            thread_data[idx2].mon_initialized = 0;
-        }
-        thread_data[idx2].active = 0;
-    }
-    pthread_mutex_unlock(&mutex);
+    // cleanup on thread exit, the monitor closes the fds
+    registry_exit_self();
 
     return ret;
 }
@@ -827,6 +1199,9 @@ int pthread_create(pthread_t *thread, const pthread_attr_t *attr,
         return real_pthread_create(thread, attr, start_routine, arg);
     }
 
+    // phase boundary: cheap point to refresh the caller's counters
+    self_sample_publish();
+
 #ifndef QUIET_MONITOR
     MONITOR_PRINTF("pthread_create called (wrapping)\n");
 #endif
@@ -900,11 +1275,9 @@ int clone(int (*fn)(void *), void *child_stack, int flags, void *arg, ...) {
     if (ret > 0 && (flags & CLONE_THREAD)) {
         pid_t child_tid = (pid_t)ret;
 
-        pthread_mutex_lock(&mutex);
-        int idx = alloc_thread_slot(child_tid);
-        pthread_mutex_unlock(&mutex);
-
-        (void)idx;
+        // the monitor opens perf for it on the next window
+        ThreadData *td = registry_claim(child_tid);
+        if (td) registry_publish(td);
     }
 
     return ret;
@@ -918,35 +1291,116 @@ int pthread_join(pthread_t thread, void **retval) {
             exit(1);
         }
     }
-    return real_pthread_join(thread, retval);
+    self_sample_publish();
+    int ret = real_pthread_join(thread, retval);
+    self_sample_publish();
+    return ret;
+}
+
+static int thread_alive(pid_t tid) {
+    if (syscall(SYS_tgkill, target_pid, tid, 0) == 0) return 1;
+    return errno != ESRCH;
 }
 
-static int find_thread_index(pid_t tid) {
-    for (int i = 0; i < thread_count; i++) {
-        if (thread_data[i].active && thread_data[i].tid == tid) return i;
+static ThreadData *registry_slot(unsigned idx) {
+    ThreadData *seg = __atomic_load_n(&g_segments[idx >> REGISTRY_SEGMENT_SHIFT], __ATOMIC_ACQUIRE);
+    return seg ? &seg[idx & (REGISTRY_SEGMENT_SLOTS - 1)] : NULL;
+}
+
+// Number of slots the monitor has to walk
+static unsigned registry_nslots(void) {
+    unsigned n = __atomic_load_n(&g_slot_hwm, __ATOMIC_ACQUIRE);
+    return n < REGISTRY_MAX_SLOTS ? n : REGISTRY_MAX_SLOTS;
+}
+
+static ThreadData *registry_pop_free(void) {
+    uint64_t head = __atomic_load_n(&g_free_head, __ATOMIC_ACQUIRE);
+    while ((uint32_t)head != 0) {
+        // slots are never freed, so reading a stale link is harmless; the tag
+        // makes the CAS fail if the head was popped and pushed meanwhile
+        ThreadData *td = registry_slot((uint32_t)head - 1);
+        uint64_t next = (((head >> 32) + 1) << 32) |
+                        __atomic_load_n(&td->next_free, __ATOMIC_RELAXED);
+        if (__atomic_compare_exchange_n(&g_free_head, &head, next, 1,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            return td;
+        }
     }
-    return -1;
+    return NULL;
+}
+
+static void registry_push_free(ThreadData *td) {
+    uint64_t head = __atomic_load_n(&g_free_head, __ATOMIC_RELAXED);
+    uint64_t next;
+    do {
+        __atomic_store_n(&td->next_free, (uint32_t)head, __ATOMIC_RELAXED);
+        next = (((head >> 32) + 1) << 32) | (uint64_t)(td->slot + 1);
+    } while (!__atomic_compare_exchange_n(&g_free_head, &head, next, 1,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
 }
 
-// Reuse inactive slots if possible else append.
-static int alloc_thread_slot(pid_t tid) {
-    for (int i = 0; i < thread_count; i++) {
-        if (!thread_data[i].active) {
-            memset(&thread_data[i], 0, sizeof(ThreadData));
-            thread_data[i].tid = tid;
-            thread_data[i].active = 1;
-            thread_data[i].last_cpu = -1;
-            return i;
+// Claim a slot for tid, reusing a retired one if possible. The slot is in
+// SLOT_INIT and invisible to the monitor until registry_publish().
+static ThreadData *registry_claim(pid_t tid) {
+    ThreadData *td = registry_pop_free();
+    uint32_t idx;
+
+    if (td) {
+        idx = td->slot;
+    } else {
+        idx = __atomic_fetch_add(&g_slot_hwm, 1, __ATOMIC_ACQ_REL);
+        if (idx >= REGISTRY_MAX_SLOTS) return NULL;
+
+        unsigned seg = idx >> REGISTRY_SEGMENT_SHIFT;
+        if (!__atomic_load_n(&g_segments[seg], __ATOMIC_ACQUIRE)) {
+            ThreadData *fresh = calloc(REGISTRY_SEGMENT_SLOTS, sizeof(ThreadData));
+            if (!fresh) return NULL;
+            ThreadData *expected = NULL;
+            if (!__atomic_compare_exchange_n(&g_segments[seg], &expected, fresh, 0,
+                                             __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                free(fresh);    // another thread installed it first
+            }
         }
+        td = registry_slot(idx);
     }
-    if (thread_count >= MAX_THREADS) return -1;
 
-    int idx = thread_count++;
-    memset(&thread_data[idx], 0, sizeof(ThreadData));
-    thread_data[idx].tid = tid;
-    thread_data[idx].active = 1;
-    thread_data[idx].last_cpu = -1;
-    return idx;
+    memset(td, 0, sizeof(ThreadData));
+    td->slot = idx;
+    td->tid = tid;
+    td->last_cpu = -1;
+    __atomic_store_n(&td->state, SLOT_INIT, __ATOMIC_RELAXED);
+    return td;
+}
+
+static void registry_publish(ThreadData *td) {
+    __atomic_store_n(&td->state, SLOT_LIVE, __ATOMIC_RELEASE);
+}
+
+// Called by a thread on its way out; the monitor reclaims the slot
+static void registry_exit_self(void) {
+    ThreadData *td = tl_slot;
+    if (!td) return;
+    tl_slot = NULL;
+
+    self_sample_stop(td);
+    int expected = SLOT_LIVE;
+    __atomic_compare_exchange_n(&td->state, &expected, SLOT_EXITING, 0,
+                                __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+}
+
+// Monitor thread only: release the slot's resources and make it reusable
+static void registry_reclaim(ThreadData *td) {
+    if (td->self_sampling) {
+        // the owner died without passing through registry_exit_self()
+        td->self_sampling = 0;
+        timer_delete(td->self_timer);
+    }
+    if (td->mon_initialized) {
+        perf_dual_monitor_close(&td->mon);
+        td->mon_initialized = 0;
+    }
+    __atomic_store_n(&td->state, SLOT_FREE, __ATOMIC_RELEASE);
+    registry_push_free(td);
 }
 
 __attribute__((noreturn)) void pthread_exit(void *retval) {
@@ -960,16 +1414,7 @@ __attribute__((noreturn)) void pthread_exit(void *retval) {
             exit(1);
         }
     }
-    pid_t tid = syscall(SYS_gettid);
-    pthread_mutex_lock(&mutex);
-    for (int i = 0; i < thread_count; i++) {
-        if (thread_data[i].tid == tid && thread_data[i].active) {
-            thread_data[i].active = 0;
-            thread_data[i].io_initialized = 0; // for storage io
-            break;
-        }
-    }
-    pthread_mutex_unlock(&mutex);
+    registry_exit_self();
     real_pthread_exit(retval);
     __builtin_unreachable();
 }
@@ -981,17 +1426,28 @@ static void *start_monitor_loop(void *unused) {
     MONITOR_PRINTF("Starting monitor loop\n");
     #endif
     if (g_training_mode && g_forced_set_ready) {
-        training_apply_affinity(0 /* self */, &g_forced_set, "monitor_thread/self");
+        training_apply_affinity(0 /* self */, g_forced_set, "monitor_thread/self");
     }
     // This function is used to send data to the scheduler periodically - 100ms
     // using a separate thread. It is also used to calculate delta values
     // for the initial and final I/O stats as well as the performance ratios.
     // The loop runs until the process is terminated or the monitor is finalized.
+    // With self-sampling the loop wakes every self-sample period and sends a
+    // window built from the threads' slots as soon as they have published
+    // fresh counts; /proc and the IO counters are still read once per
+    // resample interval, on the full window.
+    int tick_ms = g_rdpmc_mode && g_self_sample_ms < g_interval_ms ? g_self_sample_ms : g_interval_ms;
+    int waited_ms = 0;
     while (1) {
-        // Sleep for the resample interval
-        usleep(MONITOR_RESAMPLE_INTERVAL_MILLISECONDS * 1000);
+        usleep(tick_ms * 1000);
+        waited_ms += tick_ms;
+        if (waited_ms < g_interval_ms) {
+            if (self_samples_fresh()) output_results(0);
+            continue;
+        }
+        waited_ms = 0;
         get_process_io_stats(target_pid, &final_io);
-        output_results();
+        output_results(1);
         // Check if the process is still running
         if (kill(target_pid, 0) == -1 && errno == ESRCH) {
             #ifndef QUIET_MONITOR
@@ -1020,6 +1476,12 @@ void init_monitor(void) {
     if (initialized) return;
     initialized = 1;
 
+    // Load the CPU table once (TOPOLOGY_SYSFS_ROOT overrides /sys)
+    topology_init(NULL);
+#ifndef QUIET_MONITOR
+    topology_print();
+#endif
+
     // Initialize global_cpuset from CORESET
     init_global_cpuset();
     // Training config
@@ -1032,6 +1494,31 @@ void init_monitor(void) {
 
     g_force_mode = parse_force_mode(getenv("MONITOR_FORCE"));
 
+    const char *pg = getenv("MONITOR_PERF_GROUP");
+    if (pg && atoi(pg) == 0) g_perf_grouped = 0;
+
+    const char *iv = getenv("MONITOR_RESAMPLE_INTERVAL_MILLISECONDS");
+    if (iv && atoi(iv) > 0) g_interval_ms = atoi(iv);
+
+    // Opt-in: the sampling signal can cut blocking calls short with EINTR
+    // (see MONITOR_SELF_SAMPLE_SIGNAL)
+    const char *rp = getenv("MONITOR_RDPMC");
+    if (rp && atoi(rp) == 1) {
+        g_rdpmc_mode = 1;
+        const char *ss = getenv("MONITOR_SELF_SAMPLE_MILLISECONDS");
+        if (ss && atoi(ss) > 0) g_self_sample_ms = atoi(ss);
+
+        struct sigaction sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = self_sample_handler;
+        sa.sa_flags = SA_RESTART;
+        sigemptyset(&sa.sa_mask);
+        if (sigaction(MONITOR_SELF_SAMPLE_SIGNAL, &sa, NULL) != 0) {
+            MONITOR_PERROR("sigaction for self-sampling failed: %s\n", strerror(errno));
+            g_rdpmc_mode = 0;
+        }
+    }
+
     const char *ww = getenv("WARMUP_WINDOWS");
     g_warmup_windows = ww ? atoi(ww) : 0;
 
@@ -1050,11 +1537,9 @@ void init_monitor(void) {
     build_p_e_sets_from_global_cpuset();
 
     if (g_training_mode && g_force_mode != FORCE_NONE) {
-        CPU_ZERO(&g_forced_set);
-        if (g_force_mode == FORCE_P) g_forced_set = g_pset;
-        else                         g_forced_set = g_eset;
+        memcpy(g_forced_set, g_force_mode == FORCE_P ? g_pset : g_eset, g_cpuset_size);
 
-        if (is_cpuset_empty(&g_forced_set)) {
+        if (is_cpuset_empty(g_forced_set)) {
             MONITOR_PERROR("[TRAINING] Forced set is empty. Check CORESET + core_type sysfs.\n");
             exit(1);
         }
@@ -1067,7 +1552,7 @@ void init_monitor(void) {
 #endif
 
         // Strong: pin the main thread immediately (so everything starts on the right class)
-        training_apply_affinity(0 /* self */, &g_forced_set, "main/self");
+        training_apply_affinity(0 /* self */, g_forced_set, "main/self");
     } else {
         g_forced_set_ready = 0;
 #ifndef QUIET_MONITOR
@@ -1124,46 +1609,32 @@ void init_monitor(void) {
 #ifndef QUIET_MONITOR
     MONITOR_PRINTF("Main process pinned/observed on CPU %d\n", cpu);
 #endif
-    if (cpu < 0 || cpu >= 32 || !CPU_ISSET(cpu, &global_cpuset)) {
+    if (!cpu_in_set(cpu, global_cpuset)) {
         MONITOR_PERROR("Main process initial CPU %d invalid or not in CORESET %s\n",
-                       cpu, CORESET);
+                       cpu, g_coreset);
         // you can choose to exit(1) or just continue with a default cpu=0
         cpu = 0;
     }
 
-    // Register main thread slot
-    pthread_mutex_lock(&mutex);
-    if (thread_count < MAX_THREADS) {
-        thread_data[thread_count].tid = syscall(SYS_gettid);
-        thread_data[thread_count].active = 1;
-        thread_data[thread_count].cpu_bitmask = 0;
-        int t_cpu = sched_getcpu();
-        if (t_cpu >= 0 && t_cpu < 32 && CPU_ISSET(t_cpu, &global_cpuset)) {
-            thread_data[thread_count].cpu_bitmask = (1U << t_cpu);
-        } else {
+    // Register main thread slot and open perf for it
+    ThreadData *main_td = registry_claim(syscall(SYS_gettid));
+    if (main_td) {
+        tl_slot = main_td;
+        int cpu0 = sched_getcpu();
+        if (!cpu_in_set(cpu0, global_cpuset)) {
             MONITOR_PERROR("Main thread %d: Invalid CPU %d (not in CORESET %s)\n",
-                           thread_data[thread_count].tid, t_cpu, CORESET);
+                           main_td->tid, cpu0, g_coreset);
         }
-        thread_count++;
-    }
-    pthread_mutex_unlock(&mutex);
-
-    // After registering main thread slot open perf for it
-    pthread_mutex_lock(&mutex);
-    int main_idx = find_thread_index(syscall(SYS_gettid));
-    pthread_mutex_unlock(&mutex);
-
-    if (main_idx >= 0) {
-        int cpu0 = sched_getcpu();
         if (cpu0 >= 0) {
-            int pcore0 = detect_pcore_sysfs(cpu0);
-            pthread_mutex_lock(&mutex);
-            open_or_reopen_thread_perf(&thread_data[main_idx], cpu0, pcore0);
-            pthread_mutex_unlock(&mutex);
+            int pcore0 = topology_is_pcore(cpu0);
+            open_or_reopen_thread_perf(main_td, cpu0, pcore0);
+            self_sample_start(main_td);
         }
+        registry_publish(main_td);
     }
 
-    // Notify scheduler of startup
+    // Notify scheduler of startup (hands over the telemetry ring)
+    telemetry_ring_setup();
     MonitorData initial_data = {0};
     send_to_scheduler(&initial_data, 1);
 
@@ -1184,18 +1655,18 @@ void init_monitor(void) {
 static int open_or_reopen_thread_perf(ThreadData *td, int cpu_now, int pcore_now) {
     // Close old fds if open
     if (td->mon_initialized) {
-        perf_monitor_close(&td->mon);
+        perf_dual_monitor_close(&td->mon);
         td->mon_initialized = 0;
     }
 
-    // Open with correct encodings for the *current* core type
-    if (perf_monitor_open_thread(td->tid, cpu_now, &td->mon) != 0) {
-        MONITOR_PERROR("perf_monitor_open_thread failed for tid=%d cpu=%d\n", td->tid, cpu_now);
+    // Open the P and E sets together, the thread can migrate freely afterwards
+    if (perf_dual_monitor_open_thread(td->tid, g_perf_grouped, &td->mon) != 0) {
+        MONITOR_PERROR("perf_dual_monitor_open_thread failed for tid=%d cpu=%d\n", td->tid, cpu_now);
         return -1;
     }
-    if (perf_monitor_start(&td->mon) != 0) {
-        MONITOR_PERROR("perf_monitor_start failed for tid=%d cpu=%d\n", td->tid, cpu_now);
-        perf_monitor_close(&td->mon);
+    if (perf_dual_monitor_start(&td->mon) != 0) {
+        MONITOR_PERROR("perf_dual_monitor_start failed for tid=%d cpu=%d\n", td->tid, cpu_now);
+        perf_dual_monitor_close(&td->mon);
         return -1;
     }
 
@@ -1204,25 +1675,38 @@ static int open_or_reopen_thread_perf(ThreadData *td, int cpu_now, int pcore_now
     td->last_pcore = pcore_now;
 
     // Establish baseline
-    if (perf_monitor_read(&td->mon, td->curr) == 0) {
-        memcpy(td->prev, td->curr, sizeof(td->prev));
+    if (perf_dual_monitor_read(&td->mon, td->prev_p, td->prev_e, &td->prev_pf) == 0) {
+        td->prev_run_p = td->mon.p.time_running;
+        td->prev_run_e = td->mon.e.time_running;
     } else {
-        memset(td->prev, 0, sizeof(td->prev));
+        memset(td->prev_p, 0, sizeof(td->prev_p));
+        memset(td->prev_e, 0, sizeof(td->prev_e));
+        td->prev_pf = 0;
+        td->prev_run_p = 0;
+        td->prev_run_e = 0;
     }
     return 0;
 }
 
 __attribute__((destructor))
 void finish_monitor(void) {
-    pthread_mutex_lock(&mutex);
-    for (int i = 0; i < thread_count; i++) {
-        if (thread_data[i].mon_initialized) {
-            perf_monitor_close(&thread_data[i].mon);
-            thread_data[i].mon_initialized = 0;
+    pthread_mutex_lock(&g_walk_lock);
+    unsigned nslots = registry_nslots();
+    for (unsigned s = 0; s < nslots; s++) {
+        ThreadData *td = registry_slot(s);
+        if (td) self_sample_stop(td);
+    }
+    for (unsigned s = 0; s < nslots; s++) {
+        ThreadData *td = registry_slot(s);
+        if (!td) continue;
+        if (td->mon_initialized) {
+            perf_dual_monitor_close(&td->mon);
+            td->mon_initialized = 0;
         }
-        thread_data[i].active = 0;
+        // leave the slot off the free list so the monitor ignores it from now on
+        __atomic_store_n(&td->state, SLOT_FREE, __ATOMIC_RELEASE);
     }
-    pthread_mutex_unlock(&mutex);
+    pthread_mutex_unlock(&g_walk_lock);
     if (g_dataset_fp) {
         fclose(g_dataset_fp);
         g_dataset_fp = NULL;
@@ -0,0 +1,153 @@
+// model_convert - turn an exported JSON model into a binary model file
+//
+//   model_convert <model.json> [model.bin]
+//
+// Forests ("trees") and linear models ("weights") are recognised by their
+// keys; the output defaults to the input name with .json replaced by .bin.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "cJSON.h"
+#include "rf_forest.h"
+#include "model_format.h"
+
+static cJSON *parse_file(const char *path) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        fprintf(stderr, "Failed to open %s: %s\n", path, strerror(errno));
+        return NULL;
+    }
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    char *data = malloc(size + 1);
+    if (!data) {
+        fclose(fp);
+        return NULL;
+    }
+    size_t got = fread(data, 1, size, fp);
+    data[got] = '\0';
+    fclose(fp);
+
+    cJSON *json = cJSON_Parse(data);
+    free(data);
+    if (!json) {
+        fprintf(stderr, "Failed to parse JSON in %s: %s\n", path, cJSON_GetErrorPtr());
+    }
+    return json;
+}
+
+// Strings of a JSON array; NULL if any item is not a string
+static const char **string_array(const cJSON *arr, int n) {
+    if (!cJSON_IsArray(arr) || cJSON_GetArraySize(arr) < n || n <= 0) return NULL;
+    const char **names = malloc(n * sizeof(*names));
+    if (!names) return NULL;
+    for (int i = 0; i < n; i++) {
+        const cJSON *it = cJSON_GetArrayItem(arr, i);
+        if (!cJSON_IsString(it)) {
+            free(names);
+            return NULL;
+        }
+        names[i] = it->valuestring;
+    }
+    return names;
+}
+
+static int convert_forest(const cJSON *json, const char *in, const char *out) {
+    const cJSON *n_features = cJSON_GetObjectItem(json, "n_features");
+    const cJSON *n_classes = cJSON_GetObjectItem(json, "n_classes");
+    if (!cJSON_IsNumber(n_features) || !cJSON_IsNumber(n_classes)) {
+        fprintf(stderr, "%s: missing n_features/n_classes\n", in);
+        return -1;
+    }
+    const char **names = string_array(cJSON_GetObjectItem(json, "feature_names"), n_features->valueint);
+    if (!names) {
+        fprintf(stderr, "%s: feature_names does not list %d features\n", in, n_features->valueint);
+        return -1;
+    }
+    rf_forest_t *f = rf_forest_from_json(cJSON_GetObjectItem(json, "trees"), names,
+                                         n_features->valueint, n_classes->valueint);
+    if (!f) {
+        fprintf(stderr, "%s: malformed trees\n", in);
+        free(names);
+        return -1;
+    }
+    int rc = model_write_forest(out, f, names);
+    if (rc != 0) {
+        fprintf(stderr, "Failed to write %s: %s\n", out, strerror(errno));
+    } else {
+        printf("%s: %d trees, %d nodes, %d leaves (%d as bitvectors) -> %s\n", in, f->n_trees,
+               f->n_nodes, f->n_leaves, f->n_bv_leaves, out);
+    }
+    rf_forest_free(f);
+    free(names);
+    return rc;
+}
+
+static int convert_linear(const cJSON *json, const char *in, const char *out) {
+    const cJSON *features = cJSON_GetObjectItem(json, "features");
+    const cJSON *weights = cJSON_GetObjectItem(json, "weights");
+    const cJSON *intercept = cJSON_GetObjectItem(json, "intercept");
+    int n = cJSON_GetArraySize(features);
+    const char **names = string_array(features, n);
+    if (!names || !cJSON_IsObject(weights) || !cJSON_IsNumber(intercept)) {
+        fprintf(stderr, "%s: missing features/weights/intercept\n", in);
+        free(names);
+        return -1;
+    }
+    double *coef = malloc((n + 1) * sizeof(*coef));
+    if (!coef) {
+        free(names);
+        return -1;
+    }
+    coef[0] = intercept->valuedouble;
+    int rc = 0;
+    for (int i = 0; i < n; i++) {
+        const cJSON *w = cJSON_GetObjectItemCaseSensitive(weights, names[i]);
+        if (!cJSON_IsNumber(w)) {
+            fprintf(stderr, "%s: no weight for %s\n", in, names[i]);
+            rc = -1;
+            break;
+        }
+        coef[i + 1] = w->valuedouble;
+    }
+    if (rc == 0 && (rc = model_write_linear(out, coef, names, n)) != 0) {
+        fprintf(stderr, "Failed to write %s: %s\n", out, strerror(errno));
+    } else if (rc == 0) {
+        printf("%s: linear model over %d features -> %s\n", in, n, out);
+    }
+    free(coef);
+    free(names);
+    return rc;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2 || argc > 3) {
+        fprintf(stderr, "Usage: %s <model.json> [model%s]\n", argv[0], MODEL_FILE_EXT);
+        return 1;
+    }
+    const char *in = argv[1];
+    char out[4096];
+    if (argc == 3) {
+        snprintf(out, sizeof(out), "%s", argv[2]);
+    } else {
+        size_t len = strlen(in);
+        if (len > 5 && strcmp(in + len - 5, ".json") == 0) len -= 5;
+        snprintf(out, sizeof(out), "%.*s%s", (int)len, in, MODEL_FILE_EXT);
+    }
+
+    cJSON *json = parse_file(in);
+    if (!json) return 1;
+    int rc;
+    if (cJSON_GetObjectItem(json, "trees")) {
+        rc = convert_forest(json, in, out);
+    } else if (cJSON_GetObjectItem(json, "weights")) {
+        rc = convert_linear(json, in, out);
+    } else {
+        fprintf(stderr, "%s: neither a forest (\"trees\") nor a linear model (\"weights\")\n", in);
+        rc = -1;
+    }
+    cJSON_Delete(json);
+    return rc == 0 ? 0 : 1;
+}
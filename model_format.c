@@ -0,0 +1,391 @@
+// model_format.c - binary model container: writer, and read-only mmap loader
+#include "model_format.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "model files are little-endian and used in place"
+#endif
+
+// Section ids. Feature names are NUL-terminated strings back to back.
+enum {
+    SEC_FEATURE_NAMES = 1,
+    SEC_ROOT,
+    SEC_FEATURE,
+    SEC_THRESHOLD,
+    SEC_CHILD,
+    SEC_LEAF,
+    SEC_BV_FIRST,
+    SEC_BV_COUNT,
+    SEC_BV_LEAF_FIRST,
+    SEC_BV_FEATURE,
+    SEC_BV_THRESHOLD,
+    SEC_BV_MASK,
+    SEC_BV_VALUE,
+    SEC_COEF,                           // linear: intercept, then one weight per feature
+};
+
+// header params of MODEL_KIND_FOREST
+enum {
+    P_TREES, P_NODES, P_LEAVES, P_CLASSES, P_FEATURES, P_BV_SPLITS, P_BV_LEAVES,
+};
+// header params of MODEL_KIND_LINEAR
+enum {
+    P_LINEAR_FEATURES,
+};
+
+#define MAX_SECTIONS 16
+
+typedef struct {
+    uint32_t id;
+    uint32_t elem_size;
+    const void *data;
+    uint64_t count;
+} section_src_t;
+
+static uint64_t fnv1a64(const unsigned char *p, size_t n)
+{
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < n; i++) {
+        h ^= p[i];
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+// Feature names as one NUL-separated block; returns its length or 0
+static size_t names_block(const char *const *names, int n, char **out)
+{
+    size_t len = 0;
+    for (int i = 0; i < n; i++) len += strlen(names[i]) + 1;
+    *out = malloc(len ? len : 1);
+    if (!*out) return 0;
+    char *p = *out;
+    for (int i = 0; i < n; i++) {
+        size_t l = strlen(names[i]) + 1;
+        memcpy(p, names[i], l);
+        p += l;
+    }
+    return len;
+}
+
+static int names_count(const char *block, size_t len)
+{
+    int n = 0;
+    for (size_t i = 0; i < len; i++) n += block[i] == '\0';
+    return n;
+}
+
+static int names_match(const char *block, size_t len, const char *const *names, int n)
+{
+    const char *p = block, *end = block + len;
+    for (int i = 0; i < n; i++) {
+        size_t l = strlen(names[i]) + 1;
+        if ((size_t)(end - p) < l || memcmp(p, names[i], l) != 0) return 0;
+        p += l;
+    }
+    return p == end;
+}
+
+static uint64_t align_up(uint64_t v)
+{
+    return (v + MODEL_SECTION_ALIGN - 1) & ~(uint64_t)(MODEL_SECTION_ALIGN - 1);
+}
+
+// Lay the sections out, checksum, and replace path atomically: schedulers
+// that have the old file mapped keep their pages.
+static int write_file(const char *path, uint32_t kind, const int32_t *params, int n_params,
+                      const section_src_t *src, int n_src)
+{
+    uint64_t off = align_up(sizeof(model_header_t) + (size_t)n_src * sizeof(model_section_t));
+    model_section_t sec[MAX_SECTIONS];
+    for (int i = 0; i < n_src; i++) {
+        sec[i].id = src[i].id;
+        sec[i].elem_size = src[i].elem_size;
+        sec[i].offset = off;
+        sec[i].count = src[i].count;
+        off = align_up(off + src[i].count * src[i].elem_size);
+    }
+
+    unsigned char *buf = calloc(1, off);
+    if (!buf) return -1;
+    model_header_t *h = (model_header_t *)buf;
+    memcpy(h->magic, MODEL_MAGIC, sizeof(h->magic));
+    h->version = MODEL_FORMAT_VERSION;
+    h->kind = kind;
+    h->file_size = off;
+    h->n_sections = (uint32_t)n_src;
+    memcpy(h->params, params, (size_t)n_params * sizeof(*params));
+    memcpy(buf + sizeof(*h), sec, (size_t)n_src * sizeof(*sec));
+    for (int i = 0; i < n_src; i++)
+        if (src[i].count) memcpy(buf + sec[i].offset, src[i].data, src[i].count * src[i].elem_size);
+    h->checksum = fnv1a64(buf + sizeof(*h), off - sizeof(*h));
+
+    char tmp[4096];
+    snprintf(tmp, sizeof(tmp), "%s.tmp.%d", path, (int)getpid());
+    FILE *fp = fopen(tmp, "wb");
+    int ok = fp && fwrite(buf, 1, off, fp) == off;
+    if (fp && fclose(fp) != 0) ok = 0;
+    free(buf);
+    if (!ok || rename(tmp, path) != 0) {
+        int err = errno;
+        unlink(tmp);
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+int model_write_forest(const char *path, const rf_forest_t *f, const char *const *feature_names)
+{
+    char *names;
+    size_t names_len = names_block(feature_names, f->n_features, &names);
+    if (!names_len) return -1;
+
+    int32_t params[] = {
+        [P_TREES] = f->n_trees, [P_NODES] = f->n_nodes, [P_LEAVES] = f->n_leaves,
+        [P_CLASSES] = f->n_classes, [P_FEATURES] = f->n_features,
+        [P_BV_SPLITS] = f->n_bv_splits, [P_BV_LEAVES] = f->n_bv_leaves,
+    };
+    size_t nc = (size_t)f->n_classes;
+    section_src_t src[] = {
+        { SEC_FEATURE_NAMES, 1, names, names_len },
+        { SEC_ROOT, sizeof(*f->root), f->root, (uint64_t)f->n_trees },
+        { SEC_FEATURE, sizeof(*f->feature), f->feature, (uint64_t)f->n_nodes },
+        { SEC_THRESHOLD, sizeof(*f->threshold), f->threshold, (uint64_t)f->n_nodes },
+        { SEC_CHILD, sizeof(*f->child), f->child, (uint64_t)f->n_nodes },
+        { SEC_LEAF, sizeof(*f->leaf), f->leaf, (uint64_t)f->n_leaves * nc },
+        { SEC_BV_FIRST, sizeof(*f->bv_first), f->bv_first, (uint64_t)f->n_trees },
+        { SEC_BV_COUNT, sizeof(*f->bv_count), f->bv_count, (uint64_t)f->n_trees },
+        { SEC_BV_LEAF_FIRST, sizeof(*f->bv_leaf_first), f->bv_leaf_first, (uint64_t)f->n_trees },
+        { SEC_BV_FEATURE, sizeof(*f->bv_feature), f->bv_feature, (uint64_t)f->n_bv_splits },
+        { SEC_BV_THRESHOLD, sizeof(*f->bv_threshold), f->bv_threshold, (uint64_t)f->n_bv_splits },
+        { SEC_BV_MASK, sizeof(*f->bv_mask), f->bv_mask, (uint64_t)f->n_bv_splits },
+        { SEC_BV_VALUE, sizeof(*f->bv_value), f->bv_value, (uint64_t)f->n_bv_leaves * nc },
+    };
+    int rc = write_file(path, MODEL_KIND_FOREST, params, sizeof(params) / sizeof(*params),
+                        src, sizeof(src) / sizeof(*src));
+    free(names);
+    return rc;
+}
+
+int model_write_linear(const char *path, const double *coef, const char *const *names, int n)
+{
+    char *block;
+    size_t block_len = names_block(names, n, &block);
+    if (!block_len) return -1;
+
+    int32_t params[] = { [P_LINEAR_FEATURES] = n };
+    section_src_t src[] = {
+        { SEC_FEATURE_NAMES, 1, block, block_len },
+        { SEC_COEF, sizeof(*coef), coef, (uint64_t)n + 1 },
+    };
+    int rc = write_file(path, MODEL_KIND_LINEAR, params, 1, src, 2);
+    free(block);
+    return rc;
+}
+
+// A verified read-only mapping of one model file
+typedef struct {
+    unsigned char *base;
+    size_t len;
+    const model_header_t *h;
+} mapped_t;
+
+static int map_file(const char *path, uint32_t kind, mapped_t *m)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(model_header_t)) {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+    m->len = (size_t)st.st_size;
+    m->base = mmap(NULL, m->len, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (m->base == MAP_FAILED) return -1;
+
+    m->h = (const model_header_t *)m->base;
+    const model_header_t *h = m->h;
+    if (memcmp(h->magic, MODEL_MAGIC, sizeof(h->magic)) != 0 || h->version != MODEL_FORMAT_VERSION ||
+        h->kind != kind || h->file_size != m->len || h->n_sections > MAX_SECTIONS ||
+        sizeof(*h) + (size_t)h->n_sections * sizeof(model_section_t) > m->len ||
+        h->checksum != fnv1a64(m->base + sizeof(*h), m->len - sizeof(*h))) {
+        munmap(m->base, m->len);
+        errno = EINVAL;
+        return -1;
+    }
+    return 0;
+}
+
+// Section id with exactly count elements of elem_size, in bounds and aligned
+static const void *section(const mapped_t *m, uint32_t id, uint32_t elem_size, uint64_t count)
+{
+    const model_section_t *sec = (const model_section_t *)(m->base + sizeof(*m->h));
+    for (uint32_t i = 0; i < m->h->n_sections; i++) {
+        if (sec[i].id != id) continue;
+        if (sec[i].elem_size != elem_size || sec[i].count != count ||
+            sec[i].offset % MODEL_SECTION_ALIGN != 0 || sec[i].offset > m->len ||
+            count > (m->len - sec[i].offset) / elem_size) return NULL;
+        return m->base + sec[i].offset;
+    }
+    return NULL;
+}
+
+static const char *names_section(const mapped_t *m, size_t *len)
+{
+    const model_section_t *sec = (const model_section_t *)(m->base + sizeof(*m->h));
+    for (uint32_t i = 0; i < m->h->n_sections; i++) {
+        if (sec[i].id != SEC_FEATURE_NAMES) continue;
+        *len = sec[i].count;
+        const char *p = section(m, SEC_FEATURE_NAMES, 1, sec[i].count);
+        return p && *len && p[*len - 1] == '\0' ? p : NULL;
+    }
+    return NULL;
+}
+
+// Every index the predictors follow stays inside the arrays, and every
+// walk terminates (a split's children come after it, as add_tree lays
+// them out), so a mapped forest is safe to evaluate.
+static int forest_ok(const rf_forest_t *f)
+{
+    if (f->n_trees <= 0 || f->n_nodes <= 0 || f->n_leaves <= 0 || f->n_classes <= 0 ||
+        f->n_features <= 0 || f->n_features >= RF_LEAF ||
+        f->n_bv_splits < 0 || f->n_bv_leaves < 0 || f->n_bv_leaves > f->n_leaves) return 0;
+
+    for (int t = 0; t < f->n_trees; t++)
+        if (f->root[t] < 0 || f->root[t] >= f->n_nodes) return 0;
+    for (int32_t i = 0; i < f->n_nodes; i++) {
+        if (f->feature[i] == RF_LEAF) {
+            if (f->child[i] < 0 || f->child[i] >= f->n_leaves) return 0;
+        } else if (f->feature[i] >= f->n_features || f->child[i] <= i || f->child[i] >= f->n_nodes - 1) {
+            return 0;
+        }
+    }
+
+    for (int t = 0; t < f->n_trees; t++) {
+        int32_t leaf_end = t + 1 < f->n_trees ? f->bv_leaf_first[t + 1] : f->n_bv_leaves;
+        int32_t leaves = leaf_end - f->bv_leaf_first[t];
+        if (f->bv_leaf_first[t] < 0 || leaves < 0 || leaf_end > f->n_bv_leaves) return 0;
+        if (f->bv_first[t] < 0) {
+            if (leaves != 0) return 0;
+            continue;
+        }
+        if (leaves < 1 || leaves > 64 || f->bv_count[t] < 0 ||
+            f->bv_first[t] > f->n_bv_splits - f->bv_count[t]) return 0;
+        // the rightmost leaf is never cleared, so the exit leaf is in range
+        uint64_t last = 1ull << (leaves - 1);
+        for (int32_t j = f->bv_first[t]; j < f->bv_first[t] + f->bv_count[t]; j++)
+            if (f->bv_feature[j] >= f->n_features || !(f->bv_mask[j] & last)) return 0;
+    }
+    return 1;
+}
+
+rf_forest_t *model_map_forest(const char *path, const char *const *feature_names, int n_features)
+{
+    mapped_t m;
+    if (map_file(path, MODEL_KIND_FOREST, &m) != 0) return NULL;
+
+    rf_forest_t *f = calloc(1, sizeof(*f));
+    if (!f) {
+        munmap(m.base, m.len);
+        return NULL;
+    }
+    const int32_t *p = m.h->params;
+    f->n_trees = p[P_TREES];
+    f->n_nodes = p[P_NODES];
+    f->n_leaves = p[P_LEAVES];
+    f->n_classes = p[P_CLASSES];
+    f->n_features = p[P_FEATURES];
+    f->n_bv_splits = p[P_BV_SPLITS];
+    f->n_bv_leaves = p[P_BV_LEAVES];
+    f->map = m.base;
+    f->map_len = m.len;
+
+    size_t names_len;
+    const char *names = names_section(&m, &names_len);
+    if (!names || names_count(names, names_len) != f->n_features ||
+        (feature_names && (f->n_features != n_features ||
+                           !names_match(names, names_len, feature_names, n_features))))
+        goto bad;
+    if (f->n_trees <= 0 || f->n_nodes <= 0 || f->n_leaves <= 0 || f->n_classes <= 0 ||
+        f->n_bv_splits < 0 || f->n_bv_leaves < 0)
+        goto bad;
+
+    // The engine never writes these; the casts only drop const
+    uint64_t nc = (uint64_t)f->n_classes;
+    f->root = (int32_t *)section(&m, SEC_ROOT, sizeof(*f->root), (uint64_t)f->n_trees);
+    f->feature = (uint16_t *)section(&m, SEC_FEATURE, sizeof(*f->feature), (uint64_t)f->n_nodes);
+    f->threshold = (float *)section(&m, SEC_THRESHOLD, sizeof(*f->threshold), (uint64_t)f->n_nodes);
+    f->child = (int32_t *)section(&m, SEC_CHILD, sizeof(*f->child), (uint64_t)f->n_nodes);
+    f->leaf = (float *)section(&m, SEC_LEAF, sizeof(*f->leaf), (uint64_t)f->n_leaves * nc);
+    f->bv_first = (int32_t *)section(&m, SEC_BV_FIRST, sizeof(*f->bv_first), (uint64_t)f->n_trees);
+    f->bv_count = (int32_t *)section(&m, SEC_BV_COUNT, sizeof(*f->bv_count), (uint64_t)f->n_trees);
+    f->bv_leaf_first = (int32_t *)section(&m, SEC_BV_LEAF_FIRST, sizeof(*f->bv_leaf_first),
+                                          (uint64_t)f->n_trees);
+    f->bv_feature = (uint16_t *)section(&m, SEC_BV_FEATURE, sizeof(*f->bv_feature),
+                                        (uint64_t)f->n_bv_splits);
+    f->bv_threshold = (float *)section(&m, SEC_BV_THRESHOLD, sizeof(*f->bv_threshold),
+                                       (uint64_t)f->n_bv_splits);
+    f->bv_mask = (uint64_t *)section(&m, SEC_BV_MASK, sizeof(*f->bv_mask), (uint64_t)f->n_bv_splits);
+    f->bv_value = (float *)section(&m, SEC_BV_VALUE, sizeof(*f->bv_value), (uint64_t)f->n_bv_leaves * nc);
+    if (!f->root || !f->feature || !f->threshold || !f->child || !f->leaf || !f->bv_first ||
+        !f->bv_count || !f->bv_leaf_first || (f->n_bv_splits && (!f->bv_feature || !f->bv_threshold ||
+        !f->bv_mask)) || (f->n_bv_leaves && !f->bv_value) || !forest_ok(f))
+        goto bad;
+    return f;
+
+bad:
+    rf_forest_free(f);
+    errno = EINVAL;
+    return NULL;
+}
+
+int model_forest_feature_names(const rf_forest_t *f, const char **names, int n)
+{
+    if (!f->map || n < f->n_features) return -1;
+    mapped_t m = { f->map, f->map_len, f->map };
+    size_t len;
+    const char *p = names_section(&m, &len);
+    if (!p) return -1;
+    for (int i = 0; i < f->n_features; i++) {
+        names[i] = p;
+        p += strlen(p) + 1;
+    }
+    return 0;
+}
+
+int model_read_linear(const char *path, const char *const *names, int n, double *coef)
+{
+    mapped_t m;
+    if (map_file(path, MODEL_KIND_LINEAR, &m) != 0) return -1;
+
+    size_t names_len;
+    const char *block = names_section(&m, &names_len);
+    const double *c = section(&m, SEC_COEF, sizeof(*coef), (uint64_t)n + 1);
+    int ok = m.h->params[P_LINEAR_FEATURES] == n && block && c &&
+             names_match(block, names_len, names, n);
+    if (ok) memcpy(coef, c, ((size_t)n + 1) * sizeof(*coef));
+    munmap(m.base, m.len);
+    if (!ok) {
+        errno = EINVAL;
+        return -1;
+    }
+    return 0;
+}
+
+int model_is_stale(const char *bin_path, const char *json_path)
+{
+    struct stat b, j;
+    if (stat(json_path, &j) != 0 || stat(bin_path, &b) != 0) return 0;
+    return j.st_mtim.tv_sec > b.st_mtim.tv_sec ||
+           (j.st_mtim.tv_sec == b.st_mtim.tv_sec && j.st_mtim.tv_nsec > b.st_mtim.tv_nsec);
+}
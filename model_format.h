@@ -0,0 +1,78 @@
+#ifndef MODEL_FORMAT_H
+#define MODEL_FORMAT_H
+
+#include <stdint.h>
+#include "rf_forest.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Binary model container, mapped read-only and used in place.
+//
+//   header | section table | sections
+//
+// All integers and floats are little-endian. Every section starts on a
+// 64-byte boundary, so arrays in a mapping are aligned for SIMD loads.
+// The checksum covers everything after the header. One file holds one
+// model; write with model_convert, or the model_write_* calls below.
+
+#define MODEL_MAGIC "HSMODEL"           // 8 bytes with the NUL
+#define MODEL_FORMAT_VERSION 1
+#define MODEL_SECTION_ALIGN 64
+#define MODEL_FILE_EXT ".bin"           // next to the .json export it came from
+
+enum {
+    MODEL_KIND_FOREST = 1,
+    MODEL_KIND_LINEAR = 2,
+};
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t kind;
+    uint64_t file_size;
+    uint64_t checksum;                  // FNV-1a 64 of bytes [sizeof(header), file_size)
+    uint32_t n_sections;
+    uint32_t reserved;
+    int32_t params[16];                 // kind-specific counts, see model_format.c
+} model_header_t;
+
+typedef struct {
+    uint32_t id;
+    uint32_t elem_size;
+    uint64_t offset;                    // from the start of the file
+    uint64_t count;                     // elements
+} model_section_t;
+
+// Write f with its bitvector tables and feature names. Returns 0 or -1.
+int model_write_forest(const char *path, const rf_forest_t *f, const char *const *feature_names);
+
+// Map a forest file. With feature_names, the file must list exactly those
+// n_features names in that order; with NULL any feature list is accepted.
+// Returns a forest whose arrays point into the read-only mapping (freed by
+// rf_forest_free), or NULL with errno set: ENOENT if the file is missing,
+// EINVAL if it is not a valid forest.
+rf_forest_t *model_map_forest(const char *path, const char *const *feature_names, int n_features);
+
+// Feature names of a mapped forest, pointing into its mapping: fills
+// names[0..f->n_features). Returns 0, or -1 if f is not mapped or n is
+// smaller than f->n_features.
+int model_forest_feature_names(const rf_forest_t *f, const char **names, int n);
+
+// Linear model: coef[0] is the intercept, coef[1..n] the weights of names.
+int model_write_linear(const char *path, const double *coef, const char *const *names, int n);
+
+// Read a linear model whose features are exactly names[0..n); fills
+// coef[0..n]. Returns 0, or -1 with errno as for model_map_forest().
+int model_read_linear(const char *path, const char *const *names, int n, double *coef);
+
+// 1 if json_path exists and was modified after bin_path, i.e. the binary
+// was not regenerated since the last export
+int model_is_stale(const char *bin_path, const char *json_path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MODEL_FORMAT_H
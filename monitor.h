@@ -4,6 +4,8 @@
 #define NUM_EVENTS 7
 #define MAX_THREADS 64
 #define MAX_CPUS 256
+#define MAX_THREAD_SAMPLES 8    // busiest threads reported per window
+#define THREAD_SAMPLE_SHIFT 6   // per-thread counts are stored >> 6, saturating
 
 typedef struct {
     unsigned long long rchar;
@@ -27,6 +29,20 @@ typedef struct {
     double WBytes_per_Cycle;
 } PerformanceRatios;
 
+// One thread's counter deltas over the window, both PMUs summed, in units
+// of 1 << THREAD_SAMPLE_SHIFT events: 32 bits cover ~55 s of cycles at
+// 5 GHz, and only ratios between threads are used
+typedef struct {
+    int tid;
+    unsigned short cpu;                 // CPU it was seen on at the end of the window
+    unsigned char pcore;                // 1 = that CPU is a P-core
+    unsigned char reserved;
+    unsigned int inst_retired;
+    unsigned int core_cycles;
+    unsigned int cache_misses;
+    unsigned int mem_stall_cycles;
+} ThreadSample;
+
 typedef struct {
     int thread_count;
     int hw_thread_count;
@@ -39,6 +55,8 @@ typedef struct {
     PerformanceRatios ratios;
     double exec_time_ms;
     double dt_ms;
+    double p_time_ms;     // thread time on P-cores this window (summed over threads)
+    double e_time_ms;     // thread time on E-cores this window (summed over threads)
     double compute_prob_cjson;
     double io_prob_cjson;
     double memory_prob_cjson;
@@ -52,6 +70,8 @@ typedef struct {
     double io_prob_onnx_2step;
     double memory_prob_onnx_2step;
 
+    int thread_sample_count;            // valid entries in threads[]
+    ThreadSample threads[MAX_THREAD_SAMPLES];
 } MonitorData;
 
 #endif
\ No newline at end of file
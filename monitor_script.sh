@@ -11,6 +11,7 @@ set -euo pipefail
 ROOT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
 SO_PATH="$ROOT_DIR/libmonitor.so"
 PB_OBJ="$ROOT_DIR/perf_backend.o"
+TOPO_OBJ="$ROOT_DIR/topology.o"
 
 CORESET_DEFAULT="0-15"
 INTERVAL_MS_DEFAULT="100"
@@ -33,9 +34,10 @@ build() {
 
   echo "[build] compiling perf_backend.c -> perf_backend.o"
   gcc -O2 -c -fPIC "$ROOT_DIR/perf_backend.c" -o "$PB_OBJ"
+  gcc -O2 -c -fPIC "$ROOT_DIR/topology.c" -o "$TOPO_OBJ"
 
   echo "[build] compiling libmonitor.c -> libmonitor.so"
-  gcc $cflags -shared -o "$SO_PATH" "$ROOT_DIR/libmonitor.c" "$PB_OBJ" -ldl -lpthread
+  gcc $cflags -shared -o "$SO_PATH" "$ROOT_DIR/libmonitor.c" "$PB_OBJ" "$TOPO_OBJ" -ldl -lpthread
 
   echo "[build] done: $SO_PATH"
   echo "[build] strings check:"
@@ -68,15 +70,12 @@ run() {
   [[ -n "$workload" ]] || die "--workload required"
   [[ -x "$ROOT_DIR/$workload" ]] || die "workload not found/executable: $ROOT_DIR/$workload"
 
-  # Export coreset via compile-time define in your code currently.
-  # If later you switch to getenv("CORESET"), we can export it here.
   export MONITOR_RESAMPLE_INTERVAL_MILLISECONDS="$interval_ms" 2>/dev/null || true
 
   # Base env
   export LD_PRELOAD="$SO_PATH"
 
-  # Your code currently has "#define CORESET "0-15"" hardcoded.
-  # So this env var won't affect anything unless you change the code.
+  # libmonitor reads the CPU list at startup (default: every online CPU)
   export CORESET="$coreset"
 
   case "$mode" in
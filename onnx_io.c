@@ -0,0 +1,104 @@
+// onnx_io.c - preallocated, IoBinding-based ONNX Runtime inputs and outputs
+#include "onnx_io.h"
+#include <stdlib.h>
+#include <string.h>
+
+OrtStatus *onnx_io_session_options(const OrtApi *ort, OrtSessionOptions *options)
+{
+    int threads = 1;
+    const char *env = getenv("ONNX_INTRA_OP_THREADS");
+    if (env && atoi(env) > 1) threads = atoi(env);
+
+    OrtStatus *status;
+    // The pool threads take the scheduler's affinity when ORT creates them,
+    // main() binds the whole process before any session exists
+    if ((status = ort->SetIntraOpNumThreads(options, threads))) return status;
+    if ((status = ort->SetInterOpNumThreads(options, 1))) return status;
+    if ((status = ort->SetSessionExecutionMode(options, ORT_SEQUENTIAL))) return status;
+    if ((status = ort->SetSessionGraphOptimizationLevel(options, ORT_ENABLE_ALL))) return status;
+    return ort->AddSessionConfigEntry(options, "session.intra_op.allow_spinning", "0");
+}
+
+OrtStatus *onnx_io_init(onnx_io_t *io, const OrtApi *ort, OrtSession *session, const char *input_name,
+                        const char *output_name, int n_features, int n_outputs)
+{
+    memset(io, 0, sizeof(*io));
+    io->ort = ort;
+    io->session = session;
+    io->input_name = input_name;
+    io->output_name = output_name;
+    io->n_features = n_features;
+    io->n_outputs = n_outputs;
+
+    OrtStatus *status = ort->CreateCpuMemoryInfo(OrtArenaAllocator, OrtMemTypeDefault, &io->memory_info);
+    if (status) return status;
+    return ort->CreateIoBinding(session, &io->binding);
+}
+
+static void release_tensors(onnx_io_t *io)
+{
+    if (io->binding) {
+        io->ort->ClearBoundInputs(io->binding);
+        io->ort->ClearBoundOutputs(io->binding);
+    }
+    if (io->in) io->ort->ReleaseValue(io->in);
+    if (io->out) io->ort->ReleaseValue(io->out);
+    io->in = io->out = NULL;
+    io->rows = 0;
+}
+
+float *onnx_io_rows(onnx_io_t *io, int n, OrtStatus **status)
+{
+    *status = NULL;
+    if (n == io->rows) return io->x;
+    release_tensors(io);
+
+    if (n > io->cap) {
+        int cap = io->cap ? io->cap : 16;
+        while (cap < n) cap *= 2;
+        float *x = realloc(io->x, (size_t)cap * io->n_features * sizeof(*x));
+        if (x) io->x = x;
+        float *p = realloc(io->probs, (size_t)cap * io->n_outputs * sizeof(*p));
+        if (p) io->probs = p;
+        if (!x || !p) {
+            *status = io->ort->CreateStatus(ORT_FAIL, "out of memory for the ONNX batch");
+            return NULL;
+        }
+        io->cap = cap;
+    }
+
+    int64_t in_dims[] = {n, io->n_features};
+    int64_t out_dims[] = {n, io->n_outputs};
+    const OrtApi *ort = io->ort;
+    if ((*status = ort->CreateTensorWithDataAsOrtValue(io->memory_info, io->x,
+                                                       (size_t)n * io->n_features * sizeof(*io->x),
+                                                       in_dims, 2, ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT,
+                                                       &io->in)) ||
+        (*status = ort->CreateTensorWithDataAsOrtValue(io->memory_info, io->probs,
+                                                       (size_t)n * io->n_outputs * sizeof(*io->probs),
+                                                       out_dims, 2, ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT,
+                                                       &io->out)) ||
+        (*status = ort->BindInput(io->binding, io->input_name, io->in)) ||
+        (*status = ort->BindOutput(io->binding, io->output_name, io->out))) {
+        release_tensors(io);
+        return NULL;
+    }
+    io->rows = n;
+    return io->x;
+}
+
+OrtStatus *onnx_io_run(onnx_io_t *io)
+{
+    return io->ort->RunWithBinding(io->session, NULL, io->binding);
+}
+
+void onnx_io_free(onnx_io_t *io)
+{
+    if (!io->ort) return;
+    release_tensors(io);
+    if (io->binding) io->ort->ReleaseIoBinding(io->binding);
+    if (io->memory_info) io->ort->ReleaseMemoryInfo(io->memory_info);
+    free(io->x);
+    free(io->probs);
+    memset(io, 0, sizeof(*io));
+}
@@ -0,0 +1,54 @@
+#ifndef ONNX_IO_H
+#define ONNX_IO_H
+
+#include <onnxruntime_c_api.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// One session's input and probability output bound through an OrtIoBinding
+// to buffers that live as long as the session. A call only writes features
+// into x and runs; the tensors are rebuilt only when the row count changes,
+// and the buffers only grow.
+typedef struct {
+    const OrtApi *ort;
+    OrtSession *session;            // not owned
+    const char *input_name;         // not owned
+    const char *output_name;        // not owned
+    int n_features;
+    int n_outputs;                  // probability columns
+    OrtMemoryInfo *memory_info;
+    OrtIoBinding *binding;
+    OrtValue *in;
+    OrtValue *out;
+    float *x;                       // rows * n_features
+    float *probs;                   // rows * n_outputs, valid after onnx_io_run()
+    int rows;                       // rows of the bound tensors
+    int cap;                        // rows the buffers hold
+} onnx_io_t;
+
+// Options for the scheduler's sessions: one intra-op and one inter-op
+// thread, so inference runs on the calling thread and stays on the
+// scheduler's own cores, sequential execution, and no spin-waiting.
+// $ONNX_INTRA_OP_THREADS > 1 adds pool threads, which inherit the
+// scheduler's affinity instead of the default spread over every core.
+OrtStatus *onnx_io_session_options(const OrtApi *ort, OrtSessionOptions *options);
+
+OrtStatus *onnx_io_init(onnx_io_t *io, const OrtApi *ort, OrtSession *session, const char *input_name,
+                        const char *output_name, int n_features, int n_outputs);
+
+// Bind tensors of n rows and return the input buffer to fill, or NULL with
+// *status set
+float *onnx_io_rows(onnx_io_t *io, int n, OrtStatus **status);
+
+// Run the session on the bound rows; io->probs holds the result
+OrtStatus *onnx_io_run(onnx_io_t *io);
+
+void onnx_io_free(onnx_io_t *io);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ONNX_IO_H
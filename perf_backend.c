@@ -1,5 +1,6 @@
 #define _GNU_SOURCE
 #include "perf_backend.h"
+#include "topology.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -9,6 +10,7 @@
 #include <sys/syscall.h>
 #include <linux/perf_event.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 
 static const char *event_names[MEV_NUM_EVENTS] = {
     "INST_RETIRED.ANY",
@@ -34,54 +36,32 @@ static long perf_event_open_sys(struct perf_event_attr *hw_event,
     return syscall(__NR_perf_event_open, hw_event, pid, cpu, group_fd, flags);
 }
 
-// Classify CPU as P-core or E-core
- static int is_pcore(int cpu) {
-     char path[256];
-     snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/core_cpus_list", cpu);
-     FILE *f = fopen(path, "r");
-     if (!f) return 1;
-     char buf[256];
-     if (!fgets(buf, sizeof(buf), f)) { fclose(f); return 1; }
-     fclose(f);
-     int first = atoi(buf);
-     return (first < 8);  
- } 
-// static int is_pcore(int cpu) {
-//     char path[256];
-//     snprintf(path, sizeof(path),
-//              "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list", cpu);
-
-//     FILE *f = fopen(path, "r");
-//     if (!f) return 1; // default to P if uncertain 
-
-//     char buf[256];
-//     if (!fgets(buf, sizeof(buf), f)) {
-//         fclose(f);
-//         return 1;
-//     }
-//     fclose(f);
-
-    
-//     return strchr(buf, ',') != NULL;
-// }
-
-
-// cpu_core for P-cores, cpu_atom for E-cores
-static int get_pmu_type(int pcore) {
-    const char *pmu_name = pcore ? "cpu_core" : "cpu_atom";
-    char path[256];
-    snprintf(path, sizeof(path), "/sys/devices/%s/type", pmu_name);
-    FILE *f = fopen(path, "r");
-    if (!f) {
-        return pcore ? 4 : 10; 
+static void reset_monitor_state(perf_monitor_t *mon)
+{
+    for (int i = 0; i < MEV_NUM_EVENTS; i++) {
+        mon->fds[i] = -1;
+        mon->group_ev[i] = -1;
     }
-    int type;
-    if (fscanf(f, "%d", &type) != 1) {
-        fclose(f);
-        return pcore ? 4 : 10;
+    mon->grouped = 0;
+    mon->leader_fd = -1;
+    mon->group_nr = 0;
+    mon->time_enabled = 0;
+    mon->time_running = 0;
+    for (int i = 0; i < MEV_NUM_EVENTS; i++)
+        mon->mmap_pages[i] = NULL;
+    mon->mmapped = 0;
+}
+
+static void unmap_monitor_pages(perf_monitor_t *mon)
+{
+    long page = sysconf(_SC_PAGESIZE);
+    for (int i = 0; i < MEV_NUM_EVENTS; i++) {
+        if (mon->mmap_pages[i]) {
+            munmap(mon->mmap_pages[i], (size_t)page);
+            mon->mmap_pages[i] = NULL;
+        }
     }
-    fclose(f);
-    return type;
+    mon->mmapped = 0;
 }
 
 // Setup perf_event_attr for each logical event
@@ -214,6 +194,34 @@ static void setup_event_attr(int pcore, int pmu_type,
     }
 }
 
+// Single read() of the whole group: { nr, time_enabled, time_running, value[nr] }.
+// The counters keep running, and all values come from the same instant.
+static int read_group(perf_monitor_t *mon, uint64_t values[MEV_NUM_EVENTS])
+{
+    struct {
+        uint64_t nr;
+        uint64_t time_enabled;
+        uint64_t time_running;
+        uint64_t value[MEV_NUM_EVENTS];
+    } data;
+
+    ssize_t n = read(mon->leader_fd, &data, sizeof(data));
+    if (n < (ssize_t)(3 * sizeof(uint64_t))) {
+        return -1;
+    }
+    if (data.nr > (uint64_t)mon->group_nr) {
+        data.nr = (uint64_t)mon->group_nr;
+    }
+
+    for (uint64_t k = 0; k < data.nr; k++) {
+        int ev = mon->group_ev[k];
+        if (ev >= 0) values[ev] = data.value[k];
+    }
+    mon->time_enabled = data.time_enabled;
+    mon->time_running = data.time_running;
+    return 0;
+}
+
 // ========== API IMPLEMENTATION ==========
 
 int perf_monitor_open(int cpu, perf_monitor_t *mon)
@@ -221,11 +229,9 @@ int perf_monitor_open(int cpu, perf_monitor_t *mon)
     if (!mon) return -1;
     pid_t pid = getpid();
     mon->cpu = cpu;
-    mon->pcore = is_pcore(cpu);
-    mon->pmu_type = get_pmu_type(mon->pcore);
-
-    for (int i = 0; i < MEV_NUM_EVENTS; i++)
-        mon->fds[i] = -1;
+    mon->pcore = topology_is_pcore(cpu);
+    mon->pmu_type = topology_pmu_type_for(mon->pcore);
+    reset_monitor_state(mon);
 
     // IMPORTATN : Uncomment this only if you are debugging , this pinnes monitoring to only one thread 
     // - when the thread changes from the scheduler then this will not work 
@@ -265,6 +271,14 @@ int perf_monitor_open(int cpu, perf_monitor_t *mon)
 int perf_monitor_start(perf_monitor_t *mon)
 {
     if (!mon) return -1;
+    if (mon->grouped) {
+        // one ioctl each reaches every member of the group
+        if (ioctl(mon->leader_fd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP) < 0)
+            return -1;
+        if (ioctl(mon->leader_fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP) < 0)
+            return -1;
+        return 0;
+    }
     for (int i = 0; i < MEV_NUM_EVENTS; i++) {
         if (mon->fds[i] >= 0) {
             if (ioctl(mon->fds[i], PERF_EVENT_IOC_RESET, 0) < 0)
@@ -284,6 +298,11 @@ int perf_monitor_stop_and_read(perf_monitor_t *mon, uint64_t values[MEV_NUM_EVEN
         values[i] = 0;
     }
 
+    if (mon->grouped) {
+        ioctl(mon->leader_fd, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+        return read_group(mon, values);
+    }
+
     for (int i = 0; i < MEV_NUM_EVENTS; i++) {
         if (mon->fds[i] >= 0) {
             ioctl(mon->fds[i], PERF_EVENT_IOC_DISABLE, 0);
@@ -307,32 +326,31 @@ int perf_monitor_stop_and_read(perf_monitor_t *mon, uint64_t values[MEV_NUM_EVEN
 void perf_monitor_close(perf_monitor_t *mon)
 {
     if (!mon) return;
+    unmap_monitor_pages(mon);
+    // siblings first, the leader goes last
     for (int i = 0; i < MEV_NUM_EVENTS; i++) {
-        if (mon->fds[i] >= 0) {
+        if (mon->fds[i] >= 0 && mon->fds[i] != mon->leader_fd) {
             close(mon->fds[i]);
-            mon->fds[i] = -1;
         }
+        mon->fds[i] = -1;
+    }
+    if (mon->leader_fd >= 0) {
+        close(mon->leader_fd);
     }
+    mon->leader_fd = -1;
+    mon->grouped = 0;
+    mon->group_nr = 0;
 }
-// used for dynamic intercept
-// Update fixed cpu migration issue
-int perf_monitor_open_thread(pid_t tid, int cpu_hint, perf_monitor_t *mon)
+// Open one event per fd for tid on the PMU already chosen in mon->pcore/pmu_type.
+// Events whose bit is set in skip_mask are left closed.
+static int open_thread_events(pid_t tid, unsigned skip_mask, perf_monitor_t *mon)
 {
-    if (!mon) return -1;
-
-    mon->cpu = cpu_hint;
-    mon->pcore = is_pcore(cpu_hint);
-    mon->pmu_type = get_pmu_type(mon->pcore);
-
-    for (int i = 0; i < MEV_NUM_EVENTS; i++)
-        mon->fds[i] = -1;
-
     struct perf_event_attr attr;
 
     for (int i = 0; i < MEV_NUM_EVENTS; i++) {
         setup_event_attr(mon->pcore, mon->pmu_type, (perf_event_id_t)i, &attr);
 
-        if (attr.type == 0) {
+        if (attr.type == 0 || (skip_mask & (1u << i))) {
             // Unsupported on this core type
             mon->fds[i] = -1;
             continue;
@@ -345,7 +363,7 @@ int perf_monitor_open_thread(pid_t tid, int cpu_hint, perf_monitor_t *mon)
         if (fd < 0) {
             fprintf(stderr,
                 "perf_monitor_open_thread: failed to open %s for tid %d (cpu_hint=%d, %s): %s\n",
-                event_names[i], tid, cpu_hint, mon->pcore ? "P-core" : "E-core", strerror(errno));
+                event_names[i], tid, mon->cpu, mon->pcore ? "P-core" : "E-core", strerror(errno));
             mon->fds[i] = -1;
         } else {
             mon->fds[i] = fd;
@@ -355,6 +373,189 @@ int perf_monitor_open_thread(pid_t tid, int cpu_hint, perf_monitor_t *mon)
     return 0;
 }
 
+// Grouped variant of open_thread_events(): the first event opened becomes the
+// leader and every other event is attached to it.
+static int open_thread_group_events(pid_t tid, unsigned skip_mask, perf_monitor_t *mon)
+{
+    struct perf_event_attr attr;
+
+    for (int i = 0; i < MEV_NUM_EVENTS; i++) {
+        setup_event_attr(mon->pcore, mon->pmu_type, (perf_event_id_t)i, &attr);
+
+        if (attr.type == 0 || (skip_mask & (1u << i))) {
+            // Unsupported on this core type
+            continue;
+        }
+
+        attr.read_format = PERF_FORMAT_GROUP |
+                           PERF_FORMAT_TOTAL_TIME_ENABLED |
+                           PERF_FORMAT_TOTAL_TIME_RUNNING;
+        // only the leader starts disabled, siblings follow it
+        attr.disabled = (mon->leader_fd < 0) ? 1 : 0;
+
+        int fd = perf_event_open_sys(&attr, tid, -1, mon->leader_fd, 0);
+        if (fd < 0) {
+            if (mon->leader_fd < 0) {
+                fprintf(stderr,
+                    "perf_monitor_open_thread_group: leader %s for tid %d failed (%s), using ungrouped fds\n",
+                    event_names[i], tid, strerror(errno));
+                return open_thread_events(tid, skip_mask, mon);
+            }
+            fprintf(stderr,
+                "perf_monitor_open_thread_group: failed to add %s for tid %d (cpu_hint=%d, %s): %s\n",
+                event_names[i], tid, mon->cpu, mon->pcore ? "P-core" : "E-core", strerror(errno));
+            continue;
+        }
+
+        if (mon->leader_fd < 0) {
+            mon->leader_fd = fd;
+        }
+        mon->fds[i] = fd;
+        mon->group_ev[mon->group_nr++] = i;
+    }
+
+    mon->grouped = (mon->leader_fd >= 0);
+    return 0;
+}
+
+// used for dynamic intercept
+// Update fixed cpu migration issue
+int perf_monitor_open_thread(pid_t tid, int cpu_hint, perf_monitor_t *mon)
+{
+    if (!mon) return -1;
+
+    mon->cpu = cpu_hint;
+    mon->pcore = topology_is_pcore(cpu_hint);
+    mon->pmu_type = topology_pmu_type_for(mon->pcore);
+    reset_monitor_state(mon);
+
+    return open_thread_events(tid, 0, mon);
+}
+
+// Same events as perf_monitor_open_thread(), but INST_RETIRED is opened as the
+// group leader and every other event is attached to it, so one read() returns
+// all counters. Falls back to the ungrouped path if the leader cannot be opened.
+int perf_monitor_open_thread_group(pid_t tid, int cpu_hint, perf_monitor_t *mon)
+{
+    if (!mon) return -1;
+
+    mon->cpu = cpu_hint;
+    mon->pcore = topology_is_pcore(cpu_hint);
+    mon->pmu_type = topology_pmu_type_for(mon->pcore);
+    reset_monitor_state(mon);
+
+    return open_thread_group_events(tid, 0, mon);
+}
+
+// ========== DUAL PMU (hybrid) ==========
+
+static int open_dual_side(pid_t tid, int pcore, int grouped, perf_monitor_t *mon)
+{
+    // page faults are a software event and would be counted by both sides,
+    // the dual monitor keeps a single thread-wide fd for them instead
+    const unsigned skip = 1u << MEV_PAGE_FAULTS;
+
+    mon->cpu = -1;
+    mon->pcore = pcore;
+    mon->pmu_type = topology_pmu_type_for(pcore);
+    reset_monitor_state(mon);
+
+    return grouped ? open_thread_group_events(tid, skip, mon)
+                   : open_thread_events(tid, skip, mon);
+}
+
+// Open the P-core (cpu_core) and E-core (cpu_atom) event sets for tid at the
+// same time. Each set only counts while the thread runs on its core type, so
+// migrations need no reopen and time_running of each set is the residency.
+int perf_dual_monitor_open_thread(pid_t tid, int grouped, perf_dual_monitor_t *mon)
+{
+    if (!mon) return -1;
+
+    mon->hybrid = topology_is_hybrid();
+    mon->pf_fd = -1;
+    reset_monitor_state(&mon->e);
+
+    open_dual_side(tid, 1, grouped, &mon->p);
+    if (mon->hybrid) {
+        open_dual_side(tid, 0, grouped, &mon->e);
+    }
+
+    struct perf_event_attr attr;
+    setup_event_attr(1, 0, MEV_PAGE_FAULTS, &attr);
+    int fd = perf_event_open_sys(&attr, tid, -1, -1, 0);
+    if (fd < 0) {
+        fprintf(stderr,
+            "perf_dual_monitor_open_thread: failed to open %s for tid %d: %s\n",
+            event_names[MEV_PAGE_FAULTS], tid, strerror(errno));
+    }
+    mon->pf_fd = fd;
+
+    return 0;
+}
+
+int perf_dual_monitor_start(perf_dual_monitor_t *mon)
+{
+    if (!mon) return -1;
+    if (perf_monitor_start(&mon->p) != 0) return -1;
+    if (mon->hybrid && perf_monitor_start(&mon->e) != 0) return -1;
+    if (mon->pf_fd >= 0) {
+        if (ioctl(mon->pf_fd, PERF_EVENT_IOC_RESET, 0) < 0) return -1;
+        if (ioctl(mon->pf_fd, PERF_EVENT_IOC_ENABLE, 0) < 0) return -1;
+    }
+    return 0;
+}
+
+// Cumulative values for each side; the thread-wide page fault count is
+// returned separately in *page_faults. Residency is in p.time_running and
+// e.time_running after the call.
+int perf_dual_monitor_read(perf_dual_monitor_t *mon,
+                           uint64_t values_p[MEV_NUM_EVENTS],
+                           uint64_t values_e[MEV_NUM_EVENTS],
+                           uint64_t *page_faults)
+{
+    if (!mon || !values_p || !values_e || !page_faults) return -1;
+
+    if (perf_monitor_read(&mon->p, values_p) != 0) return -1;
+    if (mon->hybrid) {
+        if (perf_monitor_read(&mon->e, values_e) != 0) return -1;
+    } else {
+        memset(values_e, 0, sizeof(uint64_t) * MEV_NUM_EVENTS);
+        mon->e.time_enabled = 0;
+        mon->e.time_running = 0;
+    }
+
+    return perf_dual_monitor_read_pf(mon, page_faults);
+}
+
+int perf_dual_monitor_read_pf(perf_dual_monitor_t *mon, uint64_t *page_faults)
+{
+    if (!mon || !page_faults) return -1;
+
+    *page_faults = 0;
+    if (mon->pf_fd >= 0) {
+        struct {
+            uint64_t value;
+            uint64_t time_enabled;
+            uint64_t time_running;
+        } data;
+        if (read(mon->pf_fd, &data, sizeof(data)) == sizeof(data)) {
+            *page_faults = data.value;
+        }
+    }
+    return 0;
+}
+
+void perf_dual_monitor_close(perf_dual_monitor_t *mon)
+{
+    if (!mon) return;
+    perf_monitor_close(&mon->p);
+    perf_monitor_close(&mon->e);
+    if (mon->pf_fd >= 0) {
+        close(mon->pf_fd);
+        mon->pf_fd = -1;
+    }
+}
+
 /// edw gia na kanei periodiko sampling sta 30ms 
 int perf_monitor_read(perf_monitor_t *mon, uint64_t values[MEV_NUM_EVENTS])
 {
@@ -364,6 +565,10 @@ int perf_monitor_read(perf_monitor_t *mon, uint64_t values[MEV_NUM_EVENTS])
         values[i] = 0;
     }
 
+    if (mon->grouped) {
+        return read_group(mon, values);
+    }
+
     for (int i = 0; i < MEV_NUM_EVENTS; i++) {
         if (mon->fds[i] >= 0) {
             // Disable and get a snapshot
@@ -380,6 +585,10 @@ int perf_monitor_read(perf_monitor_t *mon, uint64_t values[MEV_NUM_EVENTS])
             ssize_t n = read(mon->fds[i], &data, sizeof(data));
             if (n == sizeof(data)) {
                 values[i] = data.value;
+                if (i == MEV_INST_RETIRED) {
+                    mon->time_enabled = data.time_enabled;
+                    mon->time_running = data.time_running;
+                }
             }
 
             // Start counting again 
@@ -390,4 +599,148 @@ int perf_monitor_read(perf_monitor_t *mon, uint64_t values[MEV_NUM_EVENTS])
     }
 
     return 0;
-}
\ No newline at end of file
+}
+
+// ========== RDPMC SELF-MONITORING ==========
+
+#if defined(__x86_64__) || defined(__i386__)
+static inline uint64_t rdpmc_raw(uint32_t counter)
+{
+    uint32_t lo, hi;
+    __asm__ volatile("rdpmc" : "=a"(lo), "=d"(hi) : "c"(counter));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static inline uint64_t rdtsc_raw(void)
+{
+    uint32_t lo, hi;
+    __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+// Seqlock read of one event's mmap page (see perf_event_open(2)). When the
+// event is not scheduled (index == 0, e.g. the E set while on a P-core) the
+// count is just the kernel-maintained offset.
+static void read_mmap_event(const volatile struct perf_event_mmap_page *pc,
+                            uint64_t *value, uint64_t *running)
+{
+    uint32_t seq;
+    uint64_t count, run;
+
+    do {
+        seq = pc->lock;
+        __asm__ volatile("" ::: "memory");
+
+        uint32_t idx = pc->index;
+        count = pc->offset;
+        run = pc->time_running;
+
+        if (pc->cap_user_rdpmc && idx) {
+            uint16_t width = pc->pmc_width;
+            int64_t pmc = (int64_t)rdpmc_raw(idx - 1);
+            pmc <<= 64 - width;
+            pmc >>= 64 - width;
+            count += pmc;
+
+            if (pc->cap_user_time) {
+                uint16_t shift = pc->time_shift;
+                uint32_t mult = pc->time_mult;
+                uint64_t cyc = rdtsc_raw();
+                uint64_t quot = cyc >> shift;
+                uint64_t rem = cyc & (((uint64_t)1 << shift) - 1);
+                run += pc->time_offset + quot * mult + ((rem * mult) >> shift);
+            }
+        }
+
+        __asm__ volatile("" ::: "memory");
+    } while (pc->lock != seq);
+
+    *value = count;
+    if (running) *running = run;
+}
+#endif
+
+int perf_monitor_mmap(perf_monitor_t *mon)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    if (!mon) return -1;
+    if (mon->mmapped) return 0;
+
+    long page = sysconf(_SC_PAGESIZE);
+    for (int i = 0; i < MEV_NUM_EVENTS; i++) {
+        // page faults are a software event, rdpmc cannot read them
+        if (mon->fds[i] < 0 || i == MEV_PAGE_FAULTS) continue;
+
+        void *p = mmap(NULL, (size_t)page, PROT_READ, MAP_SHARED, mon->fds[i], 0);
+        if (p == MAP_FAILED) {
+            fprintf(stderr, "perf_monitor_mmap: mmap %s failed: %s\n",
+                    event_names[i], strerror(errno));
+            unmap_monitor_pages(mon);
+            return -1;
+        }
+        mon->mmap_pages[i] = p;
+
+        const volatile struct perf_event_mmap_page *pc = p;
+        if (!pc->cap_user_rdpmc) {
+            // /sys/bus/event_source/devices/cpu*/rdpmc disables user reads
+            unmap_monitor_pages(mon);
+            return -1;
+        }
+    }
+    mon->mmapped = 1;
+    return 0;
+#else
+    (void)mon;
+    return -1;
+#endif
+}
+
+int perf_monitor_read_self(perf_monitor_t *mon, uint64_t values[MEV_NUM_EVENTS])
+{
+#if defined(__x86_64__) || defined(__i386__)
+    if (!mon || !values || !mon->mmapped) return -1;
+
+    int time_ev = mon->grouped ? mon->group_ev[0] : MEV_INST_RETIRED;
+    for (int i = 0; i < MEV_NUM_EVENTS; i++) {
+        values[i] = 0;
+        if (!mon->mmap_pages[i]) continue;
+
+        uint64_t running;
+        read_mmap_event(mon->mmap_pages[i], &values[i], &running);
+        if (i == time_ev) mon->time_running = running;
+    }
+    return 0;
+#else
+    (void)mon; (void)values;
+    return -1;
+#endif
+}
+
+int perf_dual_monitor_mmap(perf_dual_monitor_t *mon)
+{
+    if (!mon) return -1;
+    if (perf_monitor_mmap(&mon->p) != 0) return -1;
+    if (mon->hybrid && perf_monitor_mmap(&mon->e) != 0) {
+        unmap_monitor_pages(&mon->p);
+        return -1;
+    }
+    return 0;
+}
+
+// Counterpart of perf_dual_monitor_read() without page faults, which stay a
+// syscall on pf_fd (perf_dual_monitor_read_pf).
+int perf_dual_monitor_read_self(perf_dual_monitor_t *mon,
+                                uint64_t values_p[MEV_NUM_EVENTS],
+                                uint64_t values_e[MEV_NUM_EVENTS])
+{
+    if (!mon || !values_p || !values_e) return -1;
+
+    if (perf_monitor_read_self(&mon->p, values_p) != 0) return -1;
+    if (mon->hybrid) {
+        if (perf_monitor_read_self(&mon->e, values_e) != 0) return -1;
+    } else {
+        memset(values_e, 0, sizeof(uint64_t) * MEV_NUM_EVENTS);
+        mon->e.time_running = 0;
+    }
+    return 0;
+}
@@ -29,14 +29,54 @@ typedef struct {
     int pcore;                      // 1 = P-core, 0 = E-core
     int pmu_type;                   // cpu_core or cpu_atom PMU type
     int fds[MEV_NUM_EVENTS];        // perf file descriptors, -1 if not used
+
+    // grouped mode: all fds hang off one leader and are read with a single read()
+    int grouped;                    // 1 = PERF_FORMAT_GROUP, 0 = one fd per event
+    int leader_fd;                  // group leader (also present in fds[]), -1 if ungrouped
+    int group_nr;                   // number of events in the group
+    int group_ev[MEV_NUM_EVENTS];   // event id at each position of the group read
+    uint64_t time_enabled;          // from the last read
+    uint64_t time_running;          // from the last read
+
+    // self-monitoring fast path: perf_event_mmap_page per event, read with rdpmc
+    void *mmap_pages[MEV_NUM_EVENTS];
+    int mmapped;
 } perf_monitor_t;
 
+// Both PMU sets of one thread, open at the same time on hybrid parts
+typedef struct {
+    perf_monitor_t p;               // cpu_core events, count only while on a P-core
+    perf_monitor_t e;               // cpu_atom events, count only while on an E-core
+    int hybrid;                     // 0 = no cpu_atom PMU, only p is open
+    int pf_fd;                      // thread-wide page fault counter
+} perf_dual_monitor_t;
+
 int perf_monitor_open(int cpu, perf_monitor_t *mon);
 int perf_monitor_start(perf_monitor_t *mon);
 int perf_monitor_stop_and_read(perf_monitor_t *mon, uint64_t values[MEV_NUM_EVENTS]);
 void perf_monitor_close(perf_monitor_t *mon);
 int perf_monitor_read(perf_monitor_t *mon, uint64_t values[MEV_NUM_EVENTS]);
 int perf_monitor_open_thread(pid_t tid, int cpu_hint, perf_monitor_t *mon); //used for dynamic intercept - same as _open
+int perf_monitor_open_thread_group(pid_t tid, int cpu_hint, perf_monitor_t *mon); // one leader + siblings, single read()
+
+int perf_dual_monitor_open_thread(pid_t tid, int grouped, perf_dual_monitor_t *mon);
+int perf_dual_monitor_start(perf_dual_monitor_t *mon);
+int perf_dual_monitor_read(perf_dual_monitor_t *mon,
+                           uint64_t values_p[MEV_NUM_EVENTS],
+                           uint64_t values_e[MEV_NUM_EVENTS],
+                           uint64_t *page_faults);
+void perf_dual_monitor_close(perf_dual_monitor_t *mon);
+int perf_dual_monitor_read_pf(perf_dual_monitor_t *mon, uint64_t *page_faults);
+
+// rdpmc fast path. _mmap can run on any thread of the process, the
+// _read_self calls are only valid on the thread the events are attached to
+// and do not enter the kernel. Both return -1 if rdpmc is not usable.
+int perf_monitor_mmap(perf_monitor_t *mon);
+int perf_monitor_read_self(perf_monitor_t *mon, uint64_t values[MEV_NUM_EVENTS]);
+int perf_dual_monitor_mmap(perf_dual_monitor_t *mon);
+int perf_dual_monitor_read_self(perf_dual_monitor_t *mon,
+                                uint64_t values_p[MEV_NUM_EVENTS],
+                                uint64_t values_e[MEV_NUM_EVENTS]);
 #ifdef __cplusplus
 }
 #endif
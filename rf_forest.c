@@ -0,0 +1,474 @@
+// rf_forest.c - flat structure-of-arrays random forest for inference
+#include "rf_forest.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define RF_X86 1
+#endif
+
+#define SHRINK(p, n) do { void *q = realloc((p), (n) != 0 ? (n) * sizeof(*(p)) : 1); if (q) (p) = q; } while (0)
+
+static int feature_id(const char *name, const char *const *names, int n)
+{
+    if (!name) return -1;
+    for (int i = 0; i < n; i++)
+        if (strcmp(name, names[i]) == 0) return i;
+    return -1;
+}
+
+static int is_split(const cJSON *node)
+{
+    const char *type = cJSON_GetStringValue(cJSON_GetObjectItem(node, "type"));
+    return type && strcmp(type, "leaf") != 0;
+}
+
+static int node_index(const cJSON *node, const char *key, int n)
+{
+    const cJSON *v = cJSON_GetObjectItem(node, key);
+    if (!cJSON_IsNumber(v) || v->valueint < 0 || v->valueint >= n) return -1;
+    return v->valueint;
+}
+
+// Append one tree breadth-first. src[] doubles as the BFS queue: slot i of
+// the output came from JSON node src[i - base], and children are appended
+// in pairs as their parent is dequeued. map[] catches shared or cyclic
+// child links, which a well-formed tree never has.
+static int add_tree(rf_forest_t *f, const cJSON *tree, const char *const *names,
+                    int *src, int *map)
+{
+    const cJSON *nodes = cJSON_GetObjectItem(tree, "nodes");
+    int n = cJSON_GetArraySize(nodes);
+    if (n <= 0) return -1;
+
+    const cJSON *root_json = cJSON_GetObjectItem(tree, "root");
+    int root = cJSON_IsNumber(root_json) ? root_json->valueint : 0;
+    if (root < 0 || root >= n) return -1;
+
+    for (int i = 0; i < n; i++) map[i] = -1;
+
+    // cJSON arrays are linked lists; index them once
+    const cJSON **item = malloc((size_t)n * sizeof(*item));
+    if (!item) return -1;
+    int k = 0;
+    for (const cJSON *it = nodes->child; it && k < n; it = it->next) item[k++] = it;
+
+    int base = f->n_nodes;
+    int next = base + 1;
+    src[0] = root;
+    map[root] = base;
+
+    for (int i = base; i < next; i++) {
+        const cJSON *node = item[src[i - base]];
+        int split = is_split(node);
+        int fid = split
+                ? feature_id(cJSON_GetStringValue(cJSON_GetObjectItem(node, "feature")),
+                             names, f->n_features)
+                : -1;
+
+        if (fid < 0) {
+            // a split on an unknown feature contributes no probability
+            const cJSON *value = split ? NULL : cJSON_GetObjectItem(node, "value");
+            const cJSON *p = value ? value->child : NULL;
+            float *v = f->leaf + (size_t)f->n_leaves * f->n_classes;
+            for (int c = 0; c < f->n_classes; c++) {
+                v[c] = p ? (float)p->valuedouble : 0.0f;
+                if (p) p = p->next;
+            }
+            f->feature[i] = RF_LEAF;
+            f->threshold[i] = 0.0f;
+            f->child[i] = f->n_leaves++;
+            continue;
+        }
+
+        int l = node_index(node, "left", n);
+        int r = node_index(node, "right", n);
+        const cJSON *thr = cJSON_GetObjectItem(node, "threshold");
+        if (l < 0 || r < 0 || l == r || map[l] >= 0 || map[r] >= 0 || !cJSON_IsNumber(thr)) {
+            free(item);
+            return -1;
+        }
+        map[l] = next;
+        map[r] = next + 1;
+        src[next - base] = l;
+        src[next + 1 - base] = r;
+
+        f->feature[i] = (uint16_t)fid;
+        // sklearn compares float32 features against float32 thresholds
+        f->threshold[i] = (float)thr->valuedouble;
+        f->child[i] = next;
+        next += 2;
+    }
+    free(item);
+
+    f->root[f->n_trees++] = base;
+    f->n_nodes = next;
+    return 0;
+}
+
+// Number the leaves under node i left to right from *pos, and record for
+// each split the leaves that survive when its test fails: all but those
+// of its left subtree.
+static void bv_visit(rf_forest_t *f, int32_t i, int *pos, float *values)
+{
+    if (f->feature[i] == RF_LEAF) {
+        memcpy(values + (size_t)(*pos)++ * f->n_classes, f->leaf + (size_t)f->child[i] * f->n_classes,
+               (size_t)f->n_classes * sizeof(*values));
+        return;
+    }
+    int k = f->n_bv_splits++;
+    int lo = *pos;
+    bv_visit(f, f->child[i], pos, values);
+    int hi = *pos;
+    bv_visit(f, f->child[i] + 1, pos, values);
+
+    uint64_t left = (hi - lo == 64) ? ~0ull : ((1ull << (hi - lo)) - 1) << lo;
+    f->bv_feature[k] = f->feature[i];
+    f->bv_threshold[k] = f->threshold[i];
+    f->bv_mask[k] = ~left;
+}
+
+static int build_bitvectors(rf_forest_t *f)
+{
+    f->bv_first = malloc((size_t)f->n_trees * sizeof(*f->bv_first));
+    f->bv_count = malloc((size_t)f->n_trees * sizeof(*f->bv_count));
+    f->bv_leaf_first = malloc((size_t)f->n_trees * sizeof(*f->bv_leaf_first));
+    f->bv_feature = malloc((size_t)f->n_nodes * sizeof(*f->bv_feature));
+    f->bv_threshold = malloc((size_t)f->n_nodes * sizeof(*f->bv_threshold));
+    f->bv_mask = malloc((size_t)f->n_nodes * sizeof(*f->bv_mask));
+    f->bv_value = malloc((size_t)f->n_leaves * f->n_classes * sizeof(*f->bv_value));
+    if (!f->bv_first || !f->bv_count || !f->bv_leaf_first || !f->bv_feature ||
+        !f->bv_threshold || !f->bv_mask || !f->bv_value) return -1;
+
+    for (int t = 0; t < f->n_trees; t++) {
+        // trees are stored back to back, so a tree's nodes are [root, next root)
+        int32_t end = t + 1 < f->n_trees ? f->root[t + 1] : f->n_nodes;
+        int n_leaves = 0;
+        for (int32_t i = f->root[t]; i < end; i++) n_leaves += f->feature[i] == RF_LEAF;
+
+        f->bv_first[t] = -1;
+        f->bv_count[t] = 0;
+        f->bv_leaf_first[t] = f->n_bv_leaves;
+        if (n_leaves > 64) continue;
+
+        int pos = 0;
+        f->bv_first[t] = f->n_bv_splits;
+        bv_visit(f, f->root[t], &pos, f->bv_value + (size_t)f->n_bv_leaves * f->n_classes);
+        f->bv_count[t] = f->n_bv_splits - f->bv_first[t];
+        f->n_bv_leaves += pos;
+    }
+
+    SHRINK(f->bv_feature, (size_t)f->n_bv_splits);
+    SHRINK(f->bv_threshold, (size_t)f->n_bv_splits);
+    SHRINK(f->bv_mask, (size_t)f->n_bv_splits);
+    SHRINK(f->bv_value, (size_t)f->n_bv_leaves * f->n_classes);
+    return 0;
+}
+
+
+rf_forest_t *rf_forest_from_json(const cJSON *trees, const char *const *feature_names,
+                                 int n_features, int n_classes)
+{
+    int n_trees = cJSON_GetArraySize(trees);
+    if (n_trees <= 0 || n_classes <= 0 || n_features <= 0 || n_features >= RF_LEAF) return NULL;
+
+    // JSON node counts bound the flat arrays; trimmed once everything is in
+    size_t cap = 0;
+    int max_tree = 0;
+    for (const cJSON *t = trees->child; t; t = t->next) {
+        int n = cJSON_GetArraySize(cJSON_GetObjectItem(t, "nodes"));
+        cap += (size_t)n;
+        if (n > max_tree) max_tree = n;
+    }
+    if (cap == 0 || cap > INT32_MAX) return NULL;
+
+    rf_forest_t *f = calloc(1, sizeof(*f));
+    int *src = malloc((size_t)max_tree * sizeof(int));
+    int *map = malloc((size_t)max_tree * sizeof(int));
+    if (!f || !src || !map) goto fail;
+
+    f->n_classes = n_classes;
+    f->n_features = n_features;
+    f->root = malloc((size_t)n_trees * sizeof(*f->root));
+    f->feature = malloc(cap * sizeof(*f->feature));
+    f->threshold = malloc(cap * sizeof(*f->threshold));
+    f->child = malloc(cap * sizeof(*f->child));
+    f->leaf = malloc(cap * (size_t)n_classes * sizeof(*f->leaf));
+    if (!f->root || !f->feature || !f->threshold || !f->child || !f->leaf) goto fail;
+
+    for (const cJSON *t = trees->child; t; t = t->next)
+        if (add_tree(f, t, feature_names, src, map) != 0) goto fail;
+
+    SHRINK(f->feature, (size_t)f->n_nodes);
+    SHRINK(f->threshold, (size_t)f->n_nodes);
+    SHRINK(f->child, (size_t)f->n_nodes);
+    SHRINK(f->leaf, (size_t)f->n_leaves * n_classes);
+    if (build_bitvectors(f) != 0) goto fail;
+    free(src);
+    free(map);
+    return f;
+
+fail:
+    free(src);
+    free(map);
+    rf_forest_free(f);
+    return NULL;
+}
+
+// Leaf node reached by one sample from node i
+static inline int32_t walk(const rf_forest_t *f, int32_t i, const float *x)
+{
+    uint16_t fid;
+    // NaN compares false and goes right, like the JSON walk did
+    while ((fid = f->feature[i]) != RF_LEAF)
+        i = f->child[i] + !(x[fid] <= f->threshold[i]);
+    return i;
+}
+
+static inline void add_leaf(const rf_forest_t *f, int32_t node, double *probs)
+{
+    const float *v = f->leaf + (size_t)f->child[node] * f->n_classes;
+    for (int c = 0; c < f->n_classes; c++) probs[c] += v[c];
+}
+
+void rf_forest_predict(const rf_forest_t *f, const float *x, double *probs)
+{
+    for (int c = 0; c < f->n_classes; c++) probs[c] = 0.0;
+    for (int t = 0; t < f->n_trees; t++)
+        add_leaf(f, walk(f, f->root[t], x), probs);
+    if (f->n_trees > 0)
+        for (int c = 0; c < f->n_classes; c++) probs[c] /= f->n_trees;
+}
+
+// The SIMD kernels classify a block of 16 (AVX-512) or 8 (AVX2) samples
+// with one lane per sample. The block's features are transposed into
+// columns first. Each split of a tree is then one compare against a
+// broadcast threshold, plus a masked AND of every lane's leaf set; no
+// per-lane node chasing or gathers are needed. Trees with more than 64
+// leaves are walked per sample, and each lane's leaf is then added per
+// sample, except on AVX-512 where lzcnt finds all the leaves at once.
+// Leaves are added in tree order in double, so each row of probs equals
+// the undivided rf_forest_predict() sum. Samples [0, return value) are
+// filled and the caller does the tail.
+#define RF_SIMD_MAX_CLASSES 8
+#define RF_SIMD_MAX_FEATURES 64
+
+typedef int (*batch_kernel_t)(const rf_forest_t *f, const float *x, int n, double *probs);
+
+// Add each lane's leaf for tree t; set[] holds the lanes' leaf sets
+static inline void add_block_leaves(const rf_forest_t *f, int t, const uint64_t *set,
+                                    const float *x, int s, int lanes, double *acc)
+{
+    const int nc = f->n_classes;
+    for (int k = 0; k < lanes; k++) {
+        double *a = acc + k * nc;
+        if (f->bv_first[t] < 0) {
+            add_leaf(f, walk(f, f->root[t], x + (size_t)(s + k) * f->n_features), a);
+            continue;
+        }
+        const float *v = f->bv_value + (size_t)(f->bv_leaf_first[t] + __builtin_ctzll(set[k])) * nc;
+        for (int c = 0; c < nc; c++) a[c] += v[c];
+    }
+}
+
+static inline void load_block(const rf_forest_t *f, const float *x, int s, int lanes, float *cols)
+{
+    for (int k = 0; k < lanes; k++)
+        for (int j = 0; j < f->n_features; j++)
+            cols[j * lanes + k] = x[(size_t)(s + k) * f->n_features + j];
+}
+
+static inline void store_block(const rf_forest_t *f, const double *acc, int s, int lanes, double *probs)
+{
+    memcpy(probs + (size_t)s * f->n_classes, acc, (size_t)lanes * f->n_classes * sizeof(*acc));
+}
+
+#ifdef RF_X86
+__attribute__((target("avx2")))
+static int batch_avx2(const rf_forest_t *f, const float *x, int n, double *probs)
+{
+    float cols[RF_SIMD_MAX_FEATURES * 8] __attribute__((aligned(32)));
+    uint64_t set[8] __attribute__((aligned(32)));
+    double acc[8 * RF_SIMD_MAX_CLASSES];
+
+    int s = 0;
+    for (; s + 8 <= n; s += 8) {
+        load_block(f, x, s, 8, cols);
+        memset(acc, 0, sizeof(acc));
+
+        for (int t = 0; t < f->n_trees; t++) {
+            __m256i lo = _mm256_set1_epi64x(-1), hi = lo;
+            for (int32_t j = f->bv_first[t], end = j + f->bv_count[t]; j < end; j++) {
+                __m256 xv = _mm256_load_ps(cols + f->bv_feature[j] * 8);
+                // not (x <= t), true for NaN: the test fails and the sample goes right
+                __m256i fail = _mm256_castps_si256(_mm256_cmp_ps(xv, _mm256_set1_ps(f->bv_threshold[j]),
+                                                                 _CMP_NLE_UQ));
+                __m256i mask = _mm256_set1_epi64x((long long)f->bv_mask[j]);
+                // clear the left-subtree bits of failing lanes: set &= ~(fail & ~mask)
+                lo = _mm256_andnot_si256(_mm256_andnot_si256(mask,
+                        _mm256_cvtepi32_epi64(_mm256_castsi256_si128(fail))), lo);
+                hi = _mm256_andnot_si256(_mm256_andnot_si256(mask,
+                        _mm256_cvtepi32_epi64(_mm256_extracti128_si256(fail, 1))), hi);
+            }
+            _mm256_store_si256((__m256i *)set, lo);
+            _mm256_store_si256((__m256i *)(set + 4), hi);
+            add_block_leaves(f, t, set, x, s, 8, acc);
+        }
+        store_block(f, acc, s, 8, probs);
+    }
+    return s;
+}
+
+// lowest set bit of each 64-bit lane: 63 - lzcnt(x & -x)
+__attribute__((target("avx512f,avx512cd")))
+static inline __m256i lowest_bit_avx512(__m512i set)
+{
+    __m512i low = _mm512_and_si512(set, _mm512_sub_epi64(_mm512_setzero_si512(), set));
+    return _mm512_cvtepi64_epi32(_mm512_sub_epi64(_mm512_set1_epi64(63), _mm512_lzcnt_epi64(low)));
+}
+
+__attribute__((target("avx512f,avx512cd")))
+static int batch_avx512(const rf_forest_t *f, const float *x, int n, double *probs)
+{
+    const int nc = f->n_classes;
+    const __m512i ncv = _mm512_set1_epi32(nc);
+    float cols[RF_SIMD_MAX_FEATURES * 16] __attribute__((aligned(64)));
+    uint64_t set[16] __attribute__((aligned(64)));
+    double acc[16 * RF_SIMD_MAX_CLASSES];
+
+    // leaves are summed in vector registers only when every tree is a
+    // bitvector; otherwise per lane, to keep the tree order of the sums
+    int vector_leaves = f->n_bv_leaves == f->n_leaves;
+
+    int s = 0;
+    for (; s + 16 <= n; s += 16) {
+        load_block(f, x, s, 16, cols);
+        __m512d sum[RF_SIMD_MAX_CLASSES][2];
+        for (int c = 0; c < nc; c++) sum[c][0] = sum[c][1] = _mm512_setzero_pd();
+        memset(acc, 0, sizeof(acc));
+
+        for (int t = 0; t < f->n_trees; t++) {
+            __m512i lo = _mm512_set1_epi64(-1), hi = lo;
+            for (int32_t j = f->bv_first[t], end = j + f->bv_count[t]; j < end; j++) {
+                __m512 xv = _mm512_load_ps(cols + f->bv_feature[j] * 16);
+                // not (x <= t), true for NaN: the test fails and the sample goes right
+                __mmask16 fail = _mm512_cmp_ps_mask(xv, _mm512_set1_ps(f->bv_threshold[j]), _CMP_NLE_UQ);
+                __m512i mask = _mm512_set1_epi64((long long)f->bv_mask[j]);
+                lo = _mm512_mask_and_epi64(lo, (__mmask8)fail, lo, mask);
+                hi = _mm512_mask_and_epi64(hi, (__mmask8)(fail >> 8), hi, mask);
+            }
+            if (!vector_leaves) {
+                _mm512_store_si512(set, lo);
+                _mm512_store_si512(set + 8, hi);
+                add_block_leaves(f, t, set, x, s, 16, acc);
+                continue;
+            }
+
+            __m512i leaf = _mm512_inserti64x4(_mm512_castsi256_si512(lowest_bit_avx512(lo)),
+                                              lowest_bit_avx512(hi), 1);
+            __m512i off = _mm512_mullo_epi32(_mm512_add_epi32(leaf, _mm512_set1_epi32(f->bv_leaf_first[t])), ncv);
+            for (int c = 0; c < nc; c++) {
+                __m512 v = _mm512_i32gather_ps(_mm512_add_epi32(off, _mm512_set1_epi32(c)), f->bv_value, 4);
+                sum[c][0] = _mm512_add_pd(sum[c][0], _mm512_cvtps_pd(_mm512_castps512_ps256(v)));
+                sum[c][1] = _mm512_add_pd(sum[c][1],
+                    _mm512_cvtps_pd(_mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(v), 1))));
+            }
+        }
+
+        if (vector_leaves) {
+            for (int c = 0; c < nc; c++) {
+                double lanes[16];
+                _mm512_storeu_pd(lanes, sum[c][0]);
+                _mm512_storeu_pd(lanes + 8, sum[c][1]);
+                for (int k = 0; k < 16; k++) acc[k * nc + c] = lanes[k];
+            }
+        }
+        store_block(f, acc, s, 16, probs);
+    }
+    return s;
+}
+#endif
+
+static pthread_once_t g_kernel_once = PTHREAD_ONCE_INIT;
+static batch_kernel_t g_kernel = NULL;
+static const char *g_isa = "scalar";
+
+static void select_kernel(void)
+{
+    const char *cap = getenv("RF_FOREST_ISA");
+    if (cap && strcmp(cap, "scalar") == 0) return;
+#ifdef RF_X86
+    __builtin_cpu_init();
+    if ((!cap || strcmp(cap, "avx2") != 0) &&
+        __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512cd")) {
+        g_kernel = batch_avx512;
+        g_isa = "avx512";
+    } else if (__builtin_cpu_supports("avx2")) {
+        g_kernel = batch_avx2;
+        g_isa = "avx2";
+    }
+#endif
+}
+
+const char *rf_forest_isa(void)
+{
+    pthread_once(&g_kernel_once, select_kernel);
+    return g_isa;
+}
+
+void rf_forest_predict_batch(const rf_forest_t *f, const float *x, int n, double *probs)
+{
+    if (n <= 0) return;
+    pthread_once(&g_kernel_once, select_kernel);
+
+    const int nc = f->n_classes, nf = f->n_features;
+    int done = (g_kernel && nc <= RF_SIMD_MAX_CLASSES && nf <= RF_SIMD_MAX_FEATURES)
+             ? g_kernel(f, x, n, probs) : 0;
+
+    for (int s = done; s < n; s++) {
+        double *p = probs + (size_t)s * nc;
+        for (int c = 0; c < nc; c++) p[c] = 0.0;
+        for (int t = 0; t < f->n_trees; t++)
+            add_leaf(f, walk(f, f->root[t], x + (size_t)s * nf), p);
+    }
+
+    if (f->n_trees > 0)
+        for (size_t i = 0; i < (size_t)n * nc; i++) probs[i] /= f->n_trees;
+}
+
+size_t rf_forest_bytes(const rf_forest_t *f)
+{
+    if (!f) return 0;
+    return sizeof(*f)
+         + (size_t)f->n_trees * sizeof(*f->root)
+         + (size_t)f->n_nodes * (sizeof(*f->feature) + sizeof(*f->threshold) + sizeof(*f->child))
+         + (size_t)f->n_trees * (sizeof(*f->bv_first) + sizeof(*f->bv_count) + sizeof(*f->bv_leaf_first))
+         + (size_t)f->n_bv_splits * (sizeof(*f->bv_feature) + sizeof(*f->bv_threshold) + sizeof(*f->bv_mask))
+         + (size_t)f->n_bv_leaves * f->n_classes * sizeof(*f->bv_value)
+         + (size_t)f->n_leaves * f->n_classes * sizeof(*f->leaf);
+}
+
+void rf_forest_free(rf_forest_t *f)
+{
+    if (!f) return;
+    if (f->map) {
+        munmap(f->map, f->map_len);
+        free(f);
+        return;
+    }
+    free(f->root);
+    free(f->feature);
+    free(f->threshold);
+    free(f->child);
+    free(f->leaf);
+    free(f->bv_first);
+    free(f->bv_count);
+    free(f->bv_leaf_first);
+    free(f->bv_feature);
+    free(f->bv_threshold);
+    free(f->bv_mask);
+    free(f->bv_value);
+    free(f);
+}
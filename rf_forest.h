@@ -0,0 +1,81 @@
+#ifndef RF_FOREST_H
+#define RF_FOREST_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "cJSON.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RF_LEAF 0xffff              // feature id marking a leaf node
+
+// A random forest flattened for inference. Nodes of every tree live in one
+// set of parallel arrays, each tree laid out breadth-first so the two
+// children of a split are adjacent: right = child + 1. A leaf's child is
+// an index into leaf[], which holds n_classes probabilities per leaf.
+typedef struct {
+    int n_trees;
+    int n_nodes;
+    int n_leaves;
+    int n_classes;
+    int n_features;
+    int32_t *root;                  // per tree: index of its root node
+    uint16_t *feature;              // per node: split feature, RF_LEAF for leaves
+    float *threshold;               // per node: go left when x <= threshold
+    int32_t *child;                 // per node: left child, or leaf index
+    float *leaf;                    // n_leaves * n_classes
+
+    // The same trees as bitvectors for the batch kernels (QuickScorer): a
+    // tree's leaves are numbered left to right, and a split whose test fails
+    // (x > threshold, or NaN) clears the leaves of its left subtree. The
+    // sample's leaf is the lowest bit left after all splits are applied.
+    // Only trees with at most 64 leaves have this form.
+    int32_t *bv_first;              // per tree: first split in bv_*, -1 if not compiled
+    int32_t *bv_count;              // per tree: number of splits
+    int32_t *bv_leaf_first;         // per tree: first leaf in bv_value
+    uint16_t *bv_feature;           // per split
+    float *bv_threshold;            // per split
+    uint64_t *bv_mask;              // per split: leaves kept when the test fails
+    float *bv_value;                // leaf probabilities, left to right, n_classes each
+    int n_bv_splits;
+    int n_bv_leaves;
+
+    void *map;                      // set when the arrays live in a model file mapping
+    size_t map_len;
+} rf_forest_t;
+
+// Build a forest from the exported "trees" array: each tree has "root" and
+// "nodes", a node is {"type":"leaf","value":[...]} or {"type":"split",
+// "feature":<name>,"threshold":t,"left":i,"right":j}. Feature names are
+// resolved against feature_names[0..n_features). Nodes unreachable from the
+// root are dropped; a split on an unknown feature becomes an all-zero leaf.
+// Returns NULL on allocation failure or a malformed tree.
+rf_forest_t *rf_forest_from_json(const cJSON *trees, const char *const *feature_names,
+                                 int n_features, int n_classes);
+
+// Sum of leaf probabilities over all trees divided by n_trees.
+// x holds n_features values, probs receives n_classes.
+void rf_forest_predict(const rf_forest_t *f, const float *x, double *probs);
+
+// Classify n samples at once: x is n rows of n_features, probs receives n
+// rows of n_classes, each equal to what rf_forest_predict() returns. Splits
+// are tested for 16 (AVX-512) or 8 (AVX2) samples per instruction where the
+// CPU supports it, else samples walk the trees one at a time.
+// $RF_FOREST_ISA=scalar|avx2|avx512 caps the kernel used.
+void rf_forest_predict_batch(const rf_forest_t *f, const float *x, int n, double *probs);
+
+// Name of the kernel rf_forest_predict_batch() runs on this CPU
+const char *rf_forest_isa(void);
+
+// Bytes held by the forest, on the heap or in a model file mapping
+size_t rf_forest_bytes(const rf_forest_t *f);
+
+void rf_forest_free(rf_forest_t *f);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // RF_FOREST_H
@@ -15,10 +15,11 @@ PICFLAGS=(-fPIC)
 
 echo "[DEMO] building perf backend + monitor..."
 "${CC}" "${CFLAGS[@]}" "${PICFLAGS[@]}" -c perf_backend.c -o perf_backend.o
-"${CC}" "${CFLAGS[@]}" "${PICFLAGS[@]}" -DQUIET_MONITOR -DMONITOR_SPLIT_DEBUG -shared -o libmonitor.so libmonitor.c perf_backend.o -ldl -lpthread
+"${CC}" "${CFLAGS[@]}" "${PICFLAGS[@]}" -c topology.c -o topology.o
+"${CC}" "${CFLAGS[@]}" "${PICFLAGS[@]}" -DQUIET_MONITOR -DMONITOR_SPLIT_DEBUG -shared -o libmonitor.so libmonitor.c perf_backend.o topology.o -ldl -lpthread
 
 echo "[DEMO] building scheduler..."
-"${CC}" "${CFLAGS[@]}" -I. -o scheduler scheduler.c libclassifier.c cJSON.c -lpthread -lm
+"${CC}" "${CFLAGS[@]}" -I. -o scheduler scheduler.c topology.c cgroup_backend.c cpuload.c libclassifier.c rf_forest.c model_format.c cJSON.c -lpthread -lm
 
 # Build workload if source exists and binary is missing/outdated
 if [[ -f "${WORKLOAD}.c" ]]; then
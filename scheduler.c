@@ -15,10 +15,23 @@
 #include <signal.h>
 #include <math.h>
 #include "monitor.h"
+#include "topology.h"
+#include "telemetry_ring.h"
+#include "cgroup_backend.h"
+#include "cpuload.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <pthread.h>
 #include <stdint.h>
 #include "cJSON.h"
+#include "model_format.h"
 #include <ctype.h>
-//#include "libclassifier.h"
+#ifdef USE_COMPILED_MODELS
+#include "compiled_models.h"
+#endif
+#include "libclassifier.h"
 
 
 
@@ -29,8 +42,19 @@
 #define COMPUTE_CORESET "0,1,2,3,4,5,6,7"
 #define IO_CORESET "8-15"
 #define MEMORY_CORESET "0,1,2,3,4,5,6,7"
-#define MAX_QUEUE_SIZE 2048
-#define SCHEDULER_SLEEP_MILLISECONDS 100
+#define SCHEDULER_DEFAULT_MAX_PROCESSES 65536   // SCHEDULER_MAX_PROCESSES overrides
+#define SCHEDULER_SLEEP_MILLISECONDS 100   // housekeeping tick; decisions are event driven
+#define SCHEDULER_MAX_EVENTS 64
+#define SCHEDULER_EWMA_TAU_MILLISECONDS 200   // SCHEDULER_EWMA_TAU_MILLISECONDS overrides
+
+// epoll tags: the kind of source in the high half, a pid in the low half
+#define EV_LISTEN 1ull
+#define EV_TICK   2ull
+#define EV_RING   3ull
+#define EV_TAG(kind, pid) (((kind) << 32) | (uint32_t)(pid))
+
+#define SCHED_EVAL_DELAY_MILLISECONDS 50   // let threads migrate before sampling PSR
+#define SCHED_EVAL_QUEUE_SIZE 1024
 #ifndef QUIET_SCHEDULER
 #define SCHEDULER_PRINTF(fmt, ...) \
     printf("\033[33m[SCHEDULER]\033[0m: " fmt, ##__VA_ARGS__)
@@ -60,6 +84,11 @@ typedef struct {
     int total_threads;
 } PsrSummary;
 
+// Feature order of the LinearModel5 weights
+static const char *linear5_features[5] = {
+    "cycles_per_ms", "IPC", "Cache_Miss_Ratio", "MemStall_per_Mem", "MemStall_per_Inst"
+};
+
 static double clamp_nonneg(double v) { return (v < 0.0) ? 0.0 : v; }
 static int json_features_ok(const cJSON *root);
 static double predict5(const LinearModel5 *m,
@@ -104,8 +133,43 @@ static int json_get_double(const cJSON *obj, const char *key, double *out) {
     return 0;
 }
 
+// Coefficients in LinearModel5 order, from compile_models.py or a .bin model
+static void linear_model5_coef(const double c[6], LinearModel5 *out) {
+    out->intercept       = c[0];
+    out->w_cycles_per_ms = c[1];
+    out->w_ipc           = c[2];
+    out->w_cmr           = c[3];
+    out->w_mspm          = c[4];
+    out->w_mspi          = c[5];
+    out->loaded = 1;
+}
+
+// The .bin written by model_convert next to json_path, if there and current
+static int load_linear_model5_bin(const char *json_path, LinearModel5 *out) {
+    char bin[256];
+    size_t len = strlen(json_path);
+    if (len > 5 && strcmp(json_path + len - 5, ".json") == 0) len -= 5;
+    snprintf(bin, sizeof(bin), "%.*s%s", (int)len, json_path, MODEL_FILE_EXT);
+    if (model_is_stale(bin, json_path)) {
+        SCHEDULER_PRINTF("%s is older than %s, ignoring it\n", bin, json_path);
+        return -1;
+    }
+
+    double c[6];
+    if (model_read_linear(bin, linear5_features, 5, c) != 0) {
+        if (errno != ENOENT) {
+            SCHEDULER_PERROR("Ignoring %s: %s\n", bin, strerror(errno));
+        }
+        return -1;
+    }
+    linear_model5_coef(c, out);
+    SCHEDULER_PRINTF("Loaded %s\n", bin);
+    return 0;
+}
+
 static int load_linear_model5(const char *json_path, LinearModel5 *out) {
     memset(out, 0, sizeof(*out));
+    if (load_linear_model5_bin(json_path, out) == 0) return 0;
 
     char *txt = read_entire_file(json_path);
     if (!txt) {
@@ -161,20 +225,85 @@ typedef struct {
 typedef struct {
     pid_t pid;
     MonitorData current_data;
-    MonitorData *history;
-    int history_count;
-    int history_capacity;
-    MonitorData last_used;
-    int has_last_used;
+    PerformanceRatios ewma;   // time-decayed average of every window's ratios
+    double ewma_last_ms;      // exec_time_ms of the last folded window
+    int ewma_samples;
     int startup_flag;
     char predicted_class[16];
     int last_on_p;   // 1 = currently considered on P, 0 = on E
     int has_last_on_p;
-    
+
+    TelemetryRing *ring;  // shared-memory telemetry from the monitor, NULL = socket only
+    int ring_efd;         // doorbell eventfd of the ring, -1 if none
+    int has_new_data;     // telemetry arrived since the last decision
+
+    unsigned applied_mask_id; // AffinityMask the threads below carry, 0 = none yet
+    int applied_threads;      // monitored thread count when task/ was last walked
+    pid_t *applied_tids;      // sorted tids already set to applied_mask_id
+    int applied_ntids;
+    int applied_cap;
+    int cgroup_state;         // 1 = in its own cgroup leaf, 0 = not yet, -1 = attach failed
+
+    double yP;                // latest model scores (inst/ms on P and on E)
+    double yE;
+    int scored;               // yP/yE are valid inputs for the global pass
+    int pending_eval;         // new decision not yet applied by the global pass
+    const char *placement;    // P_CORESET / E_CORESET from the last global pass
+
+    pid_t light_tids[MAX_THREAD_SAMPLES];  // sorted; threads the last window found nearly idle
+    int n_light;
+    pid_t split_tids[MAX_THREAD_SAMPLES];  // sorted; threads currently pinned to E apart from the process
+    int n_split;
+
+    pid_t serial_tid;         // thread carrying most of the process's instructions
+    int serial_streak;        // consecutive windows it did so
+    pid_t boosted_tid;        // thread currently pinned to P apart from the process, 0 = none
+
+    int gang_threads;         // size of a barrier-style team in the last window, 0 = none
+    int gang_split;           // that team ran on both P and E cores
+
+    int hash_next;        // next slot in the pid bucket, or in the free list
+    int live_prev;        // neighbours in the live list (insertion order)
+    int live_next;
 } QueueEntry;
 
-static QueueEntry queue[MAX_QUEUE_SIZE];
-static int queue_size = 0;
+// Process table: stable slots indexed by a pid hash. Lookup, insert and
+// removal are O(1); iteration walks the live list only.
+static QueueEntry *queue = NULL;        // g_queue_cap slots, never moved
+static int g_queue_cap = 0;
+static int *g_pid_buckets = NULL;       // head slot + 1 per bucket, 0 = empty
+static unsigned g_pid_bucket_mask = 0;
+static int g_free_head = -1;            // slots released by remove_queue_entry()
+static int g_queue_used = 0;            // slots below this have been claimed at least once
+static int g_live_head = -1;
+static int g_live_tail = -1;
+static int queue_size = 0;              // live entries
+static int g_epoll_fd = -1;
+static int g_actuator_cgroup = 0;       // SCHED_ACTUATOR=cgroup: cpuset.cpus per process leaf
+static int g_global_placement = 1;      // SCHED_GLOBAL_PLACEMENT=0: per-process decisions only
+static int g_use_cpuload = 1;           // SCHED_CPULOAD=0: ignore live core load
+static int g_thread_placement = 1;      // SCHED_THREAD_PLACEMENT=0: whole processes only
+static double g_light_thread_fraction = 0.1;  // SCHED_LIGHT_THREAD_FRACTION: of the busiest thread's cycles
+static double g_serial_share = 0.8;     // SCHED_SERIAL_SHARE: instruction share of a serial bottleneck, 0 = off
+#define SERIAL_MIN_WINDOWS 2            // windows in a row before the serial thread is boosted
+#define SERIAL_RELEASE_MARGIN 0.2       // boost ends below g_serial_share - margin
+#define GANG_MIN_THREADS 3              // smallest team treated as a gang
+#define GANG_TOLERANCE 0.3              // members' inst and IPC within 30% of the team median
+static int g_gang_placement = 1;        // SCHED_GANG_PLACEMENT=0: no team detection
+static int g_classifier = 0;            // SCHED_CLASSIFIER=1: classify each cycle's windows in one batch
+static int g_classifier_onnx = 0;       // SCHED_CLASSIFIER_BACKEND=onnx: ONNX Runtime instead of the forest
+static int g_forest_ready = 0;          // forest classifier loaded
+static int g_onnx_ready = 0;            // ONNX classifier loaded
+static int g_cascade = 0;               // SCHED_CASCADE=1: classify only windows the linear models cannot call
+static double g_cascade_band = 0.15;    // SCHED_CASCADE_BAND: |yP-yE|/max(yP,yE) below which the forest runs
+static double g_cascade_vote_band = 0.2;  // SCHED_CASCADE_VOTE_BAND: forest vote margin below which ONNX runs
+static MonitorData *g_cascade_data = NULL;  // windows handed to the next stage
+static int *g_cascade_idx = NULL;       // their index in the batch
+static unsigned char *g_cascade_stage = NULL;  // per batch entry: the model that settled it
+enum { CASCADE_LINEAR, CASCADE_FOREST, CASCADE_ONNX };
+static QueueEntry **g_batch = NULL;     // entries with a fresh window this cycle
+static MonitorData *g_batch_data = NULL;
+static int g_batch_cap = 0;
 static int compute_threads = 0;
 static int io_threads = 0;
 static int memory_threads = 0;
@@ -182,9 +311,11 @@ static DynamicCoreMasks prev_masks = { {0}, {0}, {0} };
 
 
 
-#define P_CORESET   "0-7"
-#define E_CORESET   "8-15"
-#define ALL_CORESET "0-15"
+// Loaded once from sysfs (see topology.c); pointers are stable, so
+// chosen == P_CORESET comparisons keep working.
+#define P_CORESET   (topology_p_coreset())
+#define E_CORESET   (topology_e_coreset())
+#define ALL_CORESET (topology_all_coreset())
 
 static int g_phase_is_P = 1;
 static uint64_t g_next_switch_ns = 0;
@@ -213,7 +344,7 @@ void get_current_core(pid_t pid, int *core, int *is_pcore) {
     for (int i = 0; i < CPU_SETSIZE; i++) {
         if (CPU_ISSET(i, &cpuset)) {
             *core = i;
-            *is_pcore = (i < 8) ? 1 : 0; // Assume 0-7 are P-cores, 8-16 are E-cores
+            *is_pcore = topology_is_pcore(i);
             return;
         }
     }
@@ -229,44 +360,174 @@ void set_thread_priority(pid_t tid, int priority, const char *class, int core, i
     }
 }
 
+static inline unsigned pid_bucket(pid_t pid) {
+    return ((uint32_t)pid * 2654435761u) & g_pid_bucket_mask;
+}
+
+static int init_process_table(void) {
+    int cap = SCHEDULER_DEFAULT_MAX_PROCESSES;
+    const char *env = getenv("SCHEDULER_MAX_PROCESSES");
+    if (env) {
+        int v = atoi(env);
+        if (v > 0) cap = v;
+    }
+
+    unsigned nbuckets = 1;
+    while (nbuckets < (unsigned)cap) nbuckets <<= 1;
+
+    // calloc, and nothing below writes a slot before it is claimed: the
+    // cap reserves address space, pages are only touched as it fills
+    queue = calloc((size_t)cap, sizeof(QueueEntry));
+    g_pid_buckets = calloc(nbuckets, sizeof(int));
+    if (!queue || !g_pid_buckets) {
+        free(queue);
+        free(g_pid_buckets);
+        queue = NULL;
+        g_pid_buckets = NULL;
+        return -1;
+    }
+    g_pid_bucket_mask = nbuckets - 1;
+    g_queue_cap = cap;
+    g_queue_used = 0;
+    g_free_head = -1;
+    g_live_head = g_live_tail = -1;
+    queue_size = 0;
+    return 0;
+}
+
+static QueueEntry *lookup_queue_entry(pid_t pid) {
+    if (!g_pid_buckets) return NULL;
+    for (int i = g_pid_buckets[pid_bucket(pid)] - 1; i >= 0; i = queue[i].hash_next) {
+        if (queue[i].pid == pid) return &queue[i];
+    }
+    return NULL;
+}
+
+// First live entry, and the one after e; NULL at the end
+static inline QueueEntry *queue_first(void) {
+    return g_live_head >= 0 ? &queue[g_live_head] : NULL;
+}
+
+static inline QueueEntry *queue_next(const QueueEntry *e) {
+    return e->live_next >= 0 ? &queue[e->live_next] : NULL;
+}
+
 static void init_queue_entry(QueueEntry *entry) {
     entry->pid = 0;
     memset(&entry->current_data, 0, sizeof(MonitorData));
-    entry->history = NULL;
-    entry->history_count = 0;
-    entry->history_capacity = 0;
-    memset(&entry->last_used, 0, sizeof(MonitorData));
-    entry->has_last_used = 0;
+    memset(&entry->ewma, 0, sizeof(entry->ewma));
+    entry->ewma_last_ms = 0.0;
+    entry->ewma_samples = 0;
     entry->startup_flag = 0;
     entry->last_on_p = 1;
     entry->has_last_on_p = 0;
+    entry->ring = NULL;
+    entry->ring_efd = -1;
+    entry->has_new_data = 0;
+    entry->applied_mask_id = 0;
+    entry->applied_threads = -1;
+    entry->applied_tids = NULL;
+    entry->applied_ntids = 0;
+    entry->applied_cap = 0;
+    entry->cgroup_state = 0;
+    entry->yP = 0.0;
+    entry->yE = 0.0;
+    entry->scored = 0;
+    entry->pending_eval = 0;
+    entry->placement = NULL;
+    entry->n_light = 0;
+    entry->n_split = 0;
+    entry->serial_tid = 0;
+    entry->serial_streak = 0;
+    entry->boosted_tid = 0;
+    entry->gang_threads = 0;
+    entry->gang_split = 0;
 }
 
-// Safe queue entry removal
-static void remove_queue_entry(int index) {
-    SCHEDULER_PRINTF("Removing PID %d from queue\n", queue[index].pid);
-    if (queue[index].history) {
-        free(queue[index].history);
-        queue[index].history = NULL;
+static void detach_ring(QueueEntry *entry) {
+    if (entry->ring) {
+        munmap(entry->ring, sizeof(TelemetryRing));
+        entry->ring = NULL;
     }
-    for (int i = index; i < queue_size - 1; i++) {
-        queue[i] = queue[i + 1];
+    if (entry->ring_efd >= 0) {
+        close(entry->ring_efd);
+        entry->ring_efd = -1;
+    }
+}
+
+// Claim a slot for pid, a released one first, else the next never-used
+// one, and link it into its bucket and the live list
+static QueueEntry *insert_queue_entry(pid_t pid) {
+    int idx;
+    if (g_free_head >= 0) {
+        idx = g_free_head;
+        g_free_head = queue[idx].hash_next;
+    } else if (g_queue_used < g_queue_cap) {
+        idx = g_queue_used++;
+    } else {
+        return NULL;
+    }
+    QueueEntry *entry = &queue[idx];
+
+    init_queue_entry(entry);
+    entry->pid = pid;
+
+    unsigned b = pid_bucket(pid);
+    entry->hash_next = g_pid_buckets[b] - 1;
+    g_pid_buckets[b] = idx + 1;
+
+    entry->live_prev = g_live_tail;
+    entry->live_next = -1;
+    if (g_live_tail >= 0) queue[g_live_tail].live_next = idx;
+    else g_live_head = idx;
+    g_live_tail = idx;
+
+    queue_size++;
+    return entry;
+}
+
+// Safe queue entry removal; iterators must fetch queue_next() first
+static void remove_queue_entry(QueueEntry *entry) {
+    SCHEDULER_PRINTF("Removing PID %d from queue\n", entry->pid);
+    int idx = (int)(entry - queue);
+
+    detach_ring(entry);
+    free(entry->applied_tids);
+    if (entry->cgroup_state == 1) cgroup_release_process(entry->pid);
+
+    int *head = &g_pid_buckets[pid_bucket(entry->pid)];
+    if (*head == idx + 1) {
+        *head = entry->hash_next + 1;
+    } else {
+        int i = *head - 1;
+        while (i >= 0 && queue[i].hash_next != idx) i = queue[i].hash_next;
+        if (i >= 0) queue[i].hash_next = entry->hash_next;
     }
-    init_queue_entry(&queue[queue_size - 1]);
+
+    if (entry->live_prev >= 0) queue[entry->live_prev].live_next = entry->live_next;
+    else g_live_head = entry->live_next;
+    if (entry->live_next >= 0) queue[entry->live_next].live_prev = entry->live_prev;
+    else g_live_tail = entry->live_prev;
+
+    init_queue_entry(entry);
+    entry->hash_next = g_free_head;
+    g_free_head = idx;
     queue_size--;
 }
 
 static void free_queue_entry(QueueEntry *entry) {
-    if (entry->history) {
-        free(entry->history);
-        entry->history = NULL;
-    }
-    entry->history_count = 0;
-    entry->history_capacity = 0;
+    detach_ring(entry);
+    free(entry->applied_tids);
+    entry->applied_tids = NULL;
+    entry->applied_ntids = 0;
+    entry->applied_cap = 0;
+    entry->applied_mask_id = 0;
+    if (entry->cgroup_state == 1) cgroup_release_process(entry->pid);
+    entry->cgroup_state = 0;
+    memset(&entry->ewma, 0, sizeof(entry->ewma));
+    entry->ewma_samples = 0;
     entry->pid = 0;
     memset(&entry->current_data, 0, sizeof(MonitorData));
-    memset(&entry->last_used, 0, sizeof(MonitorData));
-    entry->has_last_used = 0;
     entry->startup_flag = 0;
 }
 
@@ -371,7 +632,34 @@ static int read_processor_from_tid(pid_t tid, int *out_cpu) {
     return -1;
 }
 
-static PsrSummary summarize_psr_for_process(pid_t pid) {
+// Allowed CPUs of tid as a cpulist ("0-7,16"), "?" if it cannot be read
+static void format_thread_affinity(pid_t tid, char *out, size_t len) {
+    int ncpus = topology_nr_cpus();
+    size_t setsize = CPU_ALLOC_SIZE(ncpus);
+    cpu_set_t *set = CPU_ALLOC(ncpus);
+    snprintf(out, len, "?");
+    if (!set) return;
+    CPU_ZERO_S(setsize, set);
+    if (sched_getaffinity(tid, setsize, set) == 0) {
+        size_t used = 0;
+        out[0] = '\0';
+        for (int c = 0; c < ncpus && used < len; c++) {
+            if (!CPU_ISSET_S(c, setsize, set)) continue;
+            int end = c;
+            while (end + 1 < ncpus && CPU_ISSET_S(end + 1, setsize, set)) end++;
+            int w = end > c ? snprintf(out + used, len - used, "%s%d-%d", used ? "," : "", c, end)
+                            : snprintf(out + used, len - used, "%s%d", used ? "," : "", c);
+            if (w < 0) break;
+            used += (size_t)w;
+            c = end;
+        }
+    }
+    CPU_FREE(set);
+}
+
+// PSR of every thread of pid; with log_threads also one SCHED_EVAL_THREAD
+// line per thread with its PSR and allowed CPUs
+static PsrSummary summarize_psr_for_process(pid_t pid, int log_threads) {
     PsrSummary sum = {0};
 
     char task_path[256];
@@ -390,10 +678,16 @@ static PsrSummary summarize_psr_for_process(pid_t pid) {
         int cpu = -1;
         if (read_processor_from_tid(tid, &cpu) != 0) continue;
 
+        if (log_threads) {
+            char affinity[256];
+            format_thread_affinity(tid, affinity, sizeof(affinity));
+            printf("SCHED_EVAL_THREAD pid=%d tid=%d psr=%d affinity=%s\n", pid, tid, cpu, affinity);
+        }
+
         sum.total_threads++;
-        if (0 <= cpu && cpu <= 7) sum.p_threads++;
-        else if (8 <= cpu && cpu <= 15) sum.e_threads++;
-        else sum.other_threads++;
+        if (cpu < 0 || cpu >= topology_nr_cpus()) sum.other_threads++;
+        else if (topology_is_pcore(cpu)) sum.p_threads++;
+        else sum.e_threads++;
     }
     closedir(dir);
     return sum;
@@ -650,9 +944,7 @@ static void compute_dynamic_coresets(DynamicCoreMasks *masks) {
 }
 
 static int json_features_ok(const cJSON *root) {
-    static const char *need[5] = {
-        "cycles_per_ms", "IPC", "Cache_Miss_Ratio", "MemStall_per_Mem", "MemStall_per_Inst"
-    };
+    const char *const *need = linear5_features;
 
     const cJSON *arr = cJSON_GetObjectItemCaseSensitive((cJSON*)root, "features");
     if (!cJSON_IsArray(arr)) return 0;
@@ -784,39 +1076,79 @@ int init_csv() {
     return 0;
 }
 
+// Parsed placement masks keyed by coreset string. Decisions only ever pick
+// from a handful of coresets, so each one is parsed once and processes
+// compare the id of the mask they were last given.
+#define AFFINITY_MASK_CACHE 16
+
+typedef struct {
+    char *coreset;
+    cpu_set_t *set;
+    size_t size;
+    unsigned id;            // never reused, 0 = empty slot
+} AffinityMask;
+
+static AffinityMask g_affinity_masks[AFFINITY_MASK_CACHE];
+static unsigned g_affinity_next_id = 1;
+static unsigned g_affinity_victim = 0;
+
+static const AffinityMask *affinity_mask_for(const char *coreset) {
+    for (int i = 0; i < AFFINITY_MASK_CACHE; i++) {
+        AffinityMask *m = &g_affinity_masks[i];
+        if (m->id && strcmp(m->coreset, coreset) == 0) return m;
+    }
+
+    int nr_cpus = topology_nr_cpus();
+    size_t size = CPU_ALLOC_SIZE(nr_cpus);
+    cpu_set_t *set = CPU_ALLOC(nr_cpus);
+    char *key = strdup(coreset);
+    if (!set || !key) {
+        SCHEDULER_PERROR("Failed to allocate memory for coreset\n");
+        if (set) CPU_FREE(set);
+        free(key);
+        return NULL;
+    }
+    CPU_ZERO_S(size, set);
+    if (topology_parse_cpulist(coreset, set, size) <= 0) {
+        SCHEDULER_PERROR("Invalid coreset %s\n", coreset);
+        CPU_FREE(set);
+        free(key);
+        return NULL;
+    }
+
+    AffinityMask *m = &g_affinity_masks[g_affinity_victim];
+    g_affinity_victim = (g_affinity_victim + 1) % AFFINITY_MASK_CACHE;
+    if (m->id) {
+        CPU_FREE(m->set);
+        free(m->coreset);
+    }
+    m->coreset = key;
+    m->set = set;
+    m->size = size;
+    m->id = g_affinity_next_id++;
+    return m;
+}
+
+static void free_affinity_masks(void) {
+    for (int i = 0; i < AFFINITY_MASK_CACHE; i++) {
+        AffinityMask *m = &g_affinity_masks[i];
+        if (!m->id) continue;
+        CPU_FREE(m->set);
+        free(m->coreset);
+        m->id = 0;
+    }
+}
+
 void set_affinity(pid_t pid, const char *coreset) {
     if (!coreset || !coreset[0]) {
         SCHEDULER_PERROR("Empty coreset for PID %d\n", pid);
         return;
     }
     SCHEDULER_PRINTF("Setting affinity for PID %d to coreset %s\n", pid, coreset);
-    
-    cpu_set_t cpuset;
-    CPU_ZERO(&cpuset);
-    
-    char *copy = strdup(coreset);
-    if (!copy) {
-        SCHEDULER_PERROR("Failed to allocate memory for coreset\n");
-        return;
-    }
-    char *token = strtok(copy, ",");
-    while (token) {
-        if (strchr(token, '-')) {
-            int start, end;
-            if (sscanf(token, "%d-%d", &start, &end) == 2) {
-                for (int i = start; i <= end && i < MAX_CORES; i++) {
-                    if (i >= 0) CPU_SET(i, &cpuset);
-                }
-            }
-        } else {
-            int cpu = atoi(token);
-            if (cpu >= 0 && cpu < MAX_CORES) CPU_SET(cpu, &cpuset);
-        }
-        token = strtok(NULL, ",");
-    }
-    free(copy);
-    
-    if (sched_setaffinity(pid, sizeof(cpu_set_t), &cpuset) == -1) {
+
+    const AffinityMask *m = affinity_mask_for(coreset);
+    if (!m) return;
+    if (sched_setaffinity(pid, m->size, m->set) == -1) {
         SCHEDULER_PERROR("Failed to set affinity for PID %d: %s\n", pid, strerror(errno));
     }
 }
@@ -849,16 +1181,211 @@ void set_affinity_for_all_threads(pid_t pid, const char *coreset) {
     closedir(dir);
 }
 
-void verify_affinity(pid_t pid) {
-    if (!is_process_alive(pid)) {
-        SCHEDULER_PRINTF("PID %d not alive, skipping verification\n", pid);
+static int cmp_tid(const void *a, const void *b) {
+    pid_t x = *(const pid_t *)a, y = *(const pid_t *)b;
+    return (x > y) - (x < y);
+}
+
+// cgroup actuator: one cpuset.cpus write per decision covers every thread,
+// including ones created later. Returns 1 if written, 0 if unchanged, -1 if
+// this process cannot be managed through cgroups.
+static int apply_placement_cgroup(QueueEntry *e, const AffinityMask *m) {
+    if (e->cgroup_state == 0) {
+        if (cgroup_attach_process(e->pid) != 0) {
+            SCHEDULER_PERROR("Cannot move PID %d into %s/%d (%s), using sched_setaffinity\n",
+                             e->pid, cgroup_backend_root(), e->pid, strerror(errno));
+            e->cgroup_state = -1;
+            return -1;
+        }
+        e->cgroup_state = 1;
+    }
+    if (m->id == e->applied_mask_id) return 0;
+    if (cgroup_set_cpus(e->pid, m->coreset) != 0) {
+        SCHEDULER_PERROR("Failed to write cpuset.cpus=%s for PID %d: %s\n",
+                         m->coreset, e->pid, strerror(errno));
+        return 0;
+    }
+    e->applied_mask_id = m->id;
+    return 1;
+}
+
+// Give every thread of the process the chosen coreset, touching only what
+// changed: nothing when the decision and the thread count are unchanged,
+// only threads not yet seen when just the thread count moved. Threads
+// inherit their creator's mask, so this mostly catches races at clone time.
+// Returns the number of threads whose affinity was written, -1 on error.
+static int apply_placement(QueueEntry *e, const char *coreset, int thread_count) {
+    const AffinityMask *m = affinity_mask_for(coreset);
+    if (!m) return -1;
+
+    if (g_actuator_cgroup && e->cgroup_state >= 0) {
+        int rc = apply_placement_cgroup(e, m);
+        if (rc >= 0) return rc ? (thread_count > 0 ? thread_count : 1) : 0;
+    }
+
+    int same_mask = (m->id == e->applied_mask_id);
+    if (same_mask && thread_count == e->applied_threads) return 0;
+
+    char task_path[64];
+    snprintf(task_path, sizeof(task_path), "/proc/%d/task", e->pid);
+    DIR *dir = opendir(task_path);
+    if (!dir) {
+        SCHEDULER_PERROR("Failed to open task directory for PID %d: %s\n", e->pid, strerror(errno));
+        return -1;
+    }
+
+    // the old set is consulted while the new one (live tids only) is built
+    pid_t *old = e->applied_tids;
+    int old_n = e->applied_ntids;
+    pid_t *tids = NULL;
+    int ntids = 0, cap = 0, written = 0, failed = 0;
+
+    struct dirent *de;
+    while ((de = readdir(dir)) != NULL) {
+        if (de->d_name[0] == '.') continue;
+        pid_t tid = atoi(de->d_name);
+        if (tid <= 0) continue;
+
+        if (!same_mask || !bsearch(&tid, old, old_n, sizeof(pid_t), cmp_tid)) {
+            if (sched_setaffinity(tid, m->size, m->set) == -1) {
+                if (errno != ESRCH) {
+                    SCHEDULER_PERROR("Failed to set affinity for TID %d: %s\n", tid, strerror(errno));
+                    failed = 1;
+                }
+                continue;
+            }
+            written++;
+        }
+
+        if (ntids == cap) {
+            int ncap = cap ? cap * 2 : 16;
+            pid_t *grown = realloc(tids, ncap * sizeof(pid_t));
+            if (!grown) break;
+            tids = grown;
+            cap = ncap;
+        }
+        tids[ntids++] = tid;
+    }
+    closedir(dir);
+
+    qsort(tids, ntids, sizeof(pid_t), cmp_tid);
+    free(old);
+    e->applied_tids = tids;
+    e->applied_ntids = ntids;
+    e->applied_cap = cap;
+    e->applied_mask_id = m->id;
+    // a thread we could not write stays out of tids; -1 makes the next
+    // decision walk task/ again instead of taking the unchanged shortcut
+    e->applied_threads = failed ? -1 : thread_count;
+    return written;
+}
+
+/* --- Asynchronous placement verifier ---
+ * process_queue() only submits (pid, scores, coreset). A background thread
+ * waits SCHED_EVAL_DELAY_MILLISECONDS after each decision, samples the PSR
+ * of the process's threads from /proc and prints the SCHED_EVAL line,
+ * preceded by a SCHED_EVAL_THREAD line per thread with its PSR and
+ * affinity (what ps -mo psr used to show). SCHED_EVAL=0 turns evaluation
+ * off, SCHED_EVAL_THREADS=0 only the per-thread lines.
+ */
+typedef struct {
+    pid_t pid;
+    double yP;
+    double yE;
+    uint64_t due_ns;
+    char chosen[128];
+} EvalRequest;
+
+static EvalRequest g_eval_queue[SCHED_EVAL_QUEUE_SIZE];
+static unsigned g_eval_head = 0;        // next request to run
+static unsigned g_eval_tail = 0;        // next free slot
+static unsigned long g_eval_dropped = 0;
+static int g_eval_enabled = 1;
+static int g_eval_threads = 1;          // SCHED_EVAL_THREADS=0: summary line only
+static int g_eval_started = 0;
+static int g_eval_stop = 0;
+static pthread_t g_eval_thread;
+static pthread_mutex_t g_eval_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_eval_cond = PTHREAD_COND_INITIALIZER;
+
+static void eval_submit(pid_t pid, double yP, double yE, const char *chosen) {
+    if (!g_eval_started) return;
+
+    pthread_mutex_lock(&g_eval_lock);
+    if (g_eval_tail - g_eval_head >= SCHED_EVAL_QUEUE_SIZE) {
+        // the verifier is behind; never make the decision loop wait for it
+        g_eval_dropped++;
+        pthread_mutex_unlock(&g_eval_lock);
         return;
     }
-    char cmd[256];
-    snprintf(cmd, sizeof(cmd), "ps -mo pid,tid,psr,cmd -p %d", pid);
-    SCHEDULER_PRINTF("Verifying affinity for PID %d:\n", pid);
-    if (system(cmd) != 0) {
-        SCHEDULER_PERROR("Failed to execute ps command for PID %d\n", pid);
+    EvalRequest *req = &g_eval_queue[g_eval_tail % SCHED_EVAL_QUEUE_SIZE];
+    req->pid = pid;
+    req->yP = yP;
+    req->yE = yE;
+    req->due_ns = nsec_now() + SCHED_EVAL_DELAY_MILLISECONDS * 1000000ull;
+    snprintf(req->chosen, sizeof(req->chosen), "%s", chosen ? chosen : "-");
+    g_eval_tail++;
+    pthread_cond_signal(&g_eval_cond);
+    pthread_mutex_unlock(&g_eval_lock);
+}
+
+static void *eval_thread_main(void *unused) {
+    (void)unused;
+    while (1) {
+        pthread_mutex_lock(&g_eval_lock);
+        while (g_eval_head == g_eval_tail && !g_eval_stop) {
+            pthread_cond_wait(&g_eval_cond, &g_eval_lock);
+        }
+        if (g_eval_head == g_eval_tail) {
+            pthread_mutex_unlock(&g_eval_lock);
+            break;
+        }
+        EvalRequest req = g_eval_queue[g_eval_head % SCHED_EVAL_QUEUE_SIZE];
+        g_eval_head++;
+        pthread_mutex_unlock(&g_eval_lock);
+
+        // requests are FIFO with a fixed delay, so due times only increase
+        uint64_t now = nsec_now();
+        if (req.due_ns > now) {
+            uint64_t wait = req.due_ns - now;
+            struct timespec ts = { (time_t)(wait / 1000000000ull), (long)(wait % 1000000000ull) };
+            while (nanosleep(&ts, &ts) == -1 && errno == EINTR) { }
+        }
+        if (!is_process_alive(req.pid)) continue;
+
+        PsrSummary actual = summarize_psr_for_process(req.pid, g_eval_threads);
+        printf("SCHED_EVAL pid=%d yP=%.6f yE=%.6f chosen=%s actual_P=%d actual_E=%d actual_other=%d total=%d\n",
+               req.pid, req.yP, req.yE, req.chosen,
+               actual.p_threads, actual.e_threads, actual.other_threads, actual.total_threads);
+    }
+    return NULL;
+}
+
+static void eval_start(void) {
+    const char *ev = getenv("SCHED_EVAL");
+    if (ev && atoi(ev) == 0) g_eval_enabled = 0;
+    ev = getenv("SCHED_EVAL_THREADS");
+    if (ev && atoi(ev) == 0) g_eval_threads = 0;
+    if (!g_eval_enabled) return;
+
+    int rc = pthread_create(&g_eval_thread, NULL, eval_thread_main, NULL);
+    if (rc != 0) {
+        SCHEDULER_PERROR("Failed to start SCHED_EVAL verifier: %s\n", strerror(rc));
+        return;
+    }
+    g_eval_started = 1;
+}
+
+static void eval_stop(void) {
+    if (!g_eval_started) return;
+    pthread_mutex_lock(&g_eval_lock);
+    g_eval_stop = 1;
+    pthread_cond_signal(&g_eval_cond);
+    pthread_mutex_unlock(&g_eval_lock);
+    pthread_join(g_eval_thread, NULL);
+    g_eval_started = 0;
+    if (g_eval_dropped) {
+        SCHEDULER_PRINTF("SCHED_EVAL verifier dropped %lu requests\n", g_eval_dropped);
     }
 }
 
@@ -896,6 +1423,44 @@ void write_to_csv(const MonitorData *data, long class_time_cjson, const char *pr
 }
 
 
+static double g_ewma_tau_ms = SCHEDULER_EWMA_TAU_MILLISECONDS;
+
+static inline void ewma_step(double *avg, double x, double alpha) {
+    if (isnan(x) || isinf(x)) x = 0.0;
+    *avg += alpha * (x - *avg);
+}
+
+// Fold one monitor window into the process's running ratios. The weight of
+// a window grows with its length, so a burst of short windows counts no
+// more than one long window covering the same time: O(1) time and memory.
+// The first measured window seeds the average; the all-zero startup record
+// is never folded in.
+static void ewma_fold(QueueEntry *entry, const MonitorData *data) {
+    const PerformanceRatios *x = &data->ratios;
+    PerformanceRatios *avg = &entry->ewma;
+    double alpha = 1.0;
+
+    if (entry->ewma_samples > 0) {
+        double dt = data->exec_time_ms - entry->ewma_last_ms;
+        if (!(dt > 0.0)) dt = g_ewma_tau_ms;   // restarted clock or missing timestamps
+        alpha = 1.0 - exp(-dt / g_ewma_tau_ms);
+    }
+
+    ewma_step(&avg->IPC, x->IPC, alpha);
+    ewma_step(&avg->Cache_Miss_Ratio, x->Cache_Miss_Ratio, alpha);
+    ewma_step(&avg->Uop_per_Cycle, x->Uop_per_Cycle, alpha);
+    ewma_step(&avg->MemStallCycle_per_Mem_Inst, x->MemStallCycle_per_Mem_Inst, alpha);
+    ewma_step(&avg->MemStallCycle_per_Inst, x->MemStallCycle_per_Inst, alpha);
+    ewma_step(&avg->Fault_Rate_per_mem_instr, x->Fault_Rate_per_mem_instr, alpha);
+    ewma_step(&avg->RChar_per_Cycle, x->RChar_per_Cycle, alpha);
+    ewma_step(&avg->WChar_per_Cycle, x->WChar_per_Cycle, alpha);
+    ewma_step(&avg->RBytes_per_Cycle, x->RBytes_per_Cycle, alpha);
+    ewma_step(&avg->WBytes_per_Cycle, x->WBytes_per_Cycle, alpha);
+
+    entry->ewma_last_ms = data->exec_time_ms;
+    entry->ewma_samples++;
+}
+
 static int add_to_queue(pid_t pid, MonitorData data, int startup_flag) {
     if (!is_process_alive(pid)) {
         SCHEDULER_PRINTF("PID %d does not exist, not adding/updating queue\n", pid);
@@ -903,60 +1468,130 @@ static int add_to_queue(pid_t pid, MonitorData data, int startup_flag) {
     }
 
     // Update existing entry
-    for (int i = 0; i < queue_size; i++) {
-        if (queue[i].pid == pid) {
-            SCHEDULER_PRINTF("Updating PID %d in queue\n", pid);
-
-            if (queue[i].history_count >= queue[i].history_capacity) {
-                int new_capacity = (queue[i].history_capacity == 0) ? 4 : queue[i].history_capacity * 2;
-                MonitorData *new_history = realloc(queue[i].history, new_capacity * sizeof(MonitorData));
-                if (!new_history) {
-                    SCHEDULER_PERROR("Failed to allocate history for PID %d\n", pid);
-                    return -1;
-                }
-                queue[i].history = new_history;
-                queue[i].history_capacity = new_capacity;
-            }
+    QueueEntry *entry = lookup_queue_entry(pid);
+    if (entry) {
+        SCHEDULER_PRINTF("Updating PID %d in queue\n", pid);
 
-            queue[i].history[queue[i].history_count++] = data;
-            queue[i].current_data = data;
+        if (!startup_flag) ewma_fold(entry, &data);
+        entry->current_data = data;
+        entry->has_new_data = 1;
 
-            // IMPORTANT: do NOT keep re-setting startup_flag to 1 forever.
-            // If startup_flag passed in is 1 only on first sample, fine.
-            // Otherwise consider: queue[i].startup_flag &= startup_flag; or just ignore updates.
-            queue[i].startup_flag = startup_flag;
+        // IMPORTANT: do NOT keep re-setting startup_flag to 1 forever.
+        // If startup_flag passed in is 1 only on first sample, fine.
+        // Otherwise consider: entry->startup_flag &= startup_flag; or just ignore updates.
+        entry->startup_flag = startup_flag;
 
-            // DO NOT reset last_on_p / has_last_on_p here (keeps hysteresis stable)
-            return 0;
-        }
+        // DO NOT reset last_on_p / has_last_on_p here (keeps hysteresis stable)
+        return 0;
     }
 
     // Add new entry
-    if (queue_size >= MAX_QUEUE_SIZE) {
-        SCHEDULER_PERROR("Queue full, cannot add PID %d\n", pid);
+    entry = insert_queue_entry(pid);
+    if (!entry) {
+        SCHEDULER_PERROR("Queue full (%d processes), cannot add PID %d\n", g_queue_cap, pid);
         return -1;
     }
 
     SCHEDULER_PRINTF("Adding PID %d to queue\n", pid);
 
-    init_queue_entry(&queue[queue_size]);
-    queue[queue_size].pid = pid;
+    if (!startup_flag) ewma_fold(entry, &data);
+    entry->current_data = data;
+    entry->startup_flag = startup_flag;
+    entry->has_new_data = 1;
 
-    queue[queue_size].history = malloc(4 * sizeof(MonitorData));
-    if (!queue[queue_size].history) {
-        SCHEDULER_PERROR("Failed to allocate history for PID %d\n", pid);
-        return -1;
+    // hysteresis state is initialized by init_queue_entry()
+    return 0;
+}
+
+// Map the ring a monitor handed over with its startup notification.
+// Takes ownership of both fds.
+static void attach_ring(pid_t pid, int ring_fd, int efd) {
+    QueueEntry *entry = lookup_queue_entry(pid);
+
+    struct stat st;
+    void *p = MAP_FAILED;
+    if (entry && fstat(ring_fd, &st) == 0 && st.st_size >= (off_t)sizeof(TelemetryRing)) {
+        p = mmap(NULL, sizeof(TelemetryRing), PROT_READ | PROT_WRITE, MAP_SHARED, ring_fd, 0);
+    }
+    close(ring_fd);
+
+    if (p == MAP_FAILED || !telemetry_ring_valid((TelemetryRing *)p, pid)) {
+        SCHEDULER_PERROR("Ignoring telemetry ring from PID %d, staying on socket\n", pid);
+        if (p != MAP_FAILED) munmap(p, sizeof(TelemetryRing));
+        if (efd >= 0) close(efd);
+        return;
     }
 
-    queue[queue_size].history_capacity = 4;
-    queue[queue_size].history[0] = data;
-    queue[queue_size].history_count = 1;
-    queue[queue_size].current_data = data;
-    queue[queue_size].startup_flag = startup_flag;
+    detach_ring(entry);     // a restarted monitor with a reused pid
+    entry->ring = (TelemetryRing *)p;
+    entry->ring_efd = efd;
 
-    // hysteresis state should already be initialized by init_queue_entry()
-    queue_size++;
-    return 0;
+    // closing the eventfd in detach_ring() also drops it from the epoll set
+    if (efd >= 0 && g_epoll_fd >= 0) {
+        struct epoll_event ev = { .events = EPOLLIN, .data.u64 = EV_TAG(EV_RING, pid) };
+        if (epoll_ctl(g_epoll_fd, EPOLL_CTL_ADD, efd, &ev) != 0) {
+            SCHEDULER_PERROR("epoll_ctl ring PID %d: %s\n", pid, strerror(errno));
+        }
+    }
+    __atomic_store_n(&entry->ring->consumer_attached, 1, __ATOMIC_RELEASE);
+    SCHEDULER_PRINTF("Attached telemetry ring for PID %d\n", pid);
+}
+
+// Pull every pending record out of the shared rings
+static void drain_rings(void) {
+    for (QueueEntry *e = queue_first(); e; e = queue_next(e)) {
+        TelemetryRing *r = e->ring;
+        if (!r) continue;
+
+        pid_t pid = e->pid;
+        MonitorData data;
+        while (telemetry_ring_pop(r, &data)) {
+            // add_to_queue() only updates this entry in place, e stays valid
+            if (add_to_queue(pid, data, 0) != 0) break;
+        }
+        if (e->ring_efd >= 0) {
+            uint64_t n;
+            while (read(e->ring_efd, &n, sizeof(n)) == sizeof(n)) { }
+        }
+    }
+}
+
+// Ask every ring for a doorbell before the loop sleeps. Returns 1 if some
+// ring received records meanwhile and must be drained first.
+static int arm_rings(void) {
+    int pending = 0;
+    for (QueueEntry *e = queue_first(); e; e = queue_next(e)) {
+        if (e->ring && telemetry_ring_arm(e->ring)) pending = 1;
+    }
+    return pending;
+}
+
+// Read the leading pid of a monitor message, collecting any fds passed with it
+static ssize_t recv_pid(int fd, pid_t *pid, int *fds, int *nfds) {
+    char cbuf[CMSG_SPACE(2 * sizeof(int))];
+    struct iovec iov = { .iov_base = pid, .iov_len = sizeof(*pid) };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cbuf;
+    msg.msg_controllen = sizeof(cbuf);
+
+    *nfds = 0;
+    ssize_t n = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+    if (n <= 0) return n;
+
+    for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+        if (cm->cmsg_level != SOL_SOCKET || cm->cmsg_type != SCM_RIGHTS) continue;
+        int count = (int)((cm->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+        for (int k = 0; k < count; k++) {
+            int f;
+            memcpy(&f, CMSG_DATA(cm) + k * sizeof(int), sizeof(int));
+            if (*nfds < 2) fds[(*nfds)++] = f;
+            else close(f);
+        }
+    }
+    return n;
 }
 
 
@@ -1022,77 +1657,6 @@ static int add_to_queue(pid_t pid, MonitorData data, int startup_flag) {
 //     return 0;
 // }
 
-static void compute_weighted_ratios(pid_t pid, MonitorData *data, MonitorData *history, 
-                                   int history_count, MonitorData *last_used, int has_last_used) {
-    if (!is_process_alive(pid)) {
-        SCHEDULER_PRINTF("PID %d not alive, skipping ratio computation\n", pid);
-        return;
-    }
-
-    double denominator = 1.0;
-    double weights[history_count + has_last_used + 1];
-    weights[0] = 1.0;
-    for (int i = 0; i < history_count; i++) {
-        weights[i + 1] = 1.0 / (1 << (i + 1));
-        denominator += weights[i + 1];
-    }
-    if (has_last_used) {
-        weights[history_count + 1] = 1.0 / (1 << (history_count + 1));
-        denominator += weights[history_count + 1];
-    }
-
-    double ipc = data->ratios.IPC * weights[0];
-    double cache_miss = data->ratios.Cache_Miss_Ratio * weights[0];
-    double uop_per_cycle = data->ratios.Uop_per_Cycle * weights[0];
-    double mem_stall_per_mem = data->ratios.MemStallCycle_per_Mem_Inst * weights[0];
-    double mem_stall_per_inst = data->ratios.MemStallCycle_per_Inst * weights[0];
-    double fault_rate = data->ratios.Fault_Rate_per_mem_instr * weights[0];
-    double rchar_per_cycle = data->ratios.RChar_per_Cycle * weights[0];
-    double wchar_per_cycle = data->ratios.WChar_per_Cycle * weights[0];
-    double rbytes_per_cycle = data->ratios.RBytes_per_Cycle * weights[0];
-    double wbytes_per_cycle = data->ratios.WBytes_per_Cycle * weights[0];
-
-    for (int i = 0; i < history_count; i++) {
-        ipc += history[i].ratios.IPC * weights[i + 1];
-        cache_miss += history[i].ratios.Cache_Miss_Ratio * weights[i + 1];
-        uop_per_cycle += history[i].ratios.Uop_per_Cycle * weights[i + 1];
-        mem_stall_per_mem += history[i].ratios.MemStallCycle_per_Mem_Inst * weights[i + 1];
-        mem_stall_per_inst += history[i].ratios.MemStallCycle_per_Inst * weights[i + 1];
-        fault_rate += history[i].ratios.Fault_Rate_per_mem_instr * weights[i + 1];
-        rchar_per_cycle += history[i].ratios.RChar_per_Cycle * weights[i + 1];
-        wchar_per_cycle += history[i].ratios.WChar_per_Cycle * weights[i + 1];
-        rbytes_per_cycle += history[i].ratios.RBytes_per_Cycle * weights[i + 1];
-        wbytes_per_cycle += history[i].ratios.WBytes_per_Cycle * weights[i + 1];
-    }
-
-    if (has_last_used) {
-        ipc += last_used->ratios.IPC * weights[history_count + 1];
-        cache_miss += last_used->ratios.Cache_Miss_Ratio * weights[history_count + 1];
-        uop_per_cycle += last_used->ratios.Uop_per_Cycle * weights[history_count + 1];
-        mem_stall_per_mem += last_used->ratios.MemStallCycle_per_Mem_Inst * weights[history_count + 1];
-        mem_stall_per_inst += last_used->ratios.MemStallCycle_per_Inst * weights[history_count + 1];
-        fault_rate += last_used->ratios.Fault_Rate_per_mem_instr * weights[history_count + 1];
-        rchar_per_cycle += last_used->ratios.RChar_per_Cycle * weights[history_count + 1];
-        wchar_per_cycle += last_used->ratios.WChar_per_Cycle * weights[history_count + 1];
-        rbytes_per_cycle += last_used->ratios.RBytes_per_Cycle * weights[history_count + 1];
-        wbytes_per_cycle += last_used->ratios.WBytes_per_Cycle * weights[history_count + 1];
-    }
-
-    data->ratios.IPC = isnan(ipc) || isinf(ipc) ? 0.0 : ipc / denominator;
-    data->ratios.Cache_Miss_Ratio = isnan(cache_miss) || isinf(cache_miss) ? 0.0 : cache_miss / denominator;
-    data->ratios.Uop_per_Cycle = isnan(uop_per_cycle) || isinf(uop_per_cycle) ? 0.0 : uop_per_cycle / denominator;
-    data->ratios.MemStallCycle_per_Mem_Inst = isnan(mem_stall_per_mem) || isinf(mem_stall_per_mem) ? 0.0 : mem_stall_per_mem / denominator;
-    data->ratios.MemStallCycle_per_Inst = isnan(mem_stall_per_inst) || isinf(mem_stall_per_inst) ? 0.0 : mem_stall_per_inst / denominator;
-    data->ratios.Fault_Rate_per_mem_instr = isnan(fault_rate) || isinf(fault_rate) ? 0.0 : fault_rate / denominator;
-    data->ratios.RChar_per_Cycle = isnan(rchar_per_cycle) || isinf(rchar_per_cycle) ? 0.0 : rchar_per_cycle / denominator;
-    data->ratios.WChar_per_Cycle = isnan(wchar_per_cycle) || isinf(wchar_per_cycle) ? 0.0 : wchar_per_cycle / denominator;
-    data->ratios.RBytes_per_Cycle = isnan(rbytes_per_cycle) || isinf(rbytes_per_cycle) ? 0.0 : rbytes_per_cycle / denominator;
-    data->ratios.WBytes_per_Cycle = isnan(wbytes_per_cycle) || isinf(wbytes_per_cycle) ? 0.0 : wbytes_per_cycle / denominator;
-
-    if (!is_process_alive(pid)) {
-        memset(&data->ratios, 0, sizeof(data->ratios));
-    }
-}
 
 
 // linear models
@@ -1127,6 +1691,37 @@ static int tree_prefers_P(const MonitorData *d) {
 }
 
 
+static int g_p_capacity = 0;
+static int g_e_capacity = 0;
+
+// Fraction of a core a new thread can expect on one side: 1 while the side
+// has idle CPUs, capacity / demand once its runqueues back up.
+static double core_load_slowdown(int pcore) {
+    int cap = pcore ? g_p_capacity : g_e_capacity;
+    if (!g_use_cpuload || !cpuload_ready() || cap <= 0) return 1.0;
+    double demand = cpuload_demand(pcore);
+    return demand > cap ? cap / demand : 1.0;
+}
+
+// Predicted inst/ms on P and E from the linear models; -1 when the window's
+// features are not finite
+static int linear_scores(const MonitorData *d, double *yP, double *yE) {
+    const double dt_ms = 100.0;     // see choose_placement_coreset_model()
+    const double cycles_per_ms = (double)d->total_values[2] / dt_ms;
+    const double ipc  = d->ratios.IPC;
+    const double cmr  = d->ratios.Cache_Miss_Ratio;
+    const double mspm = d->ratios.MemStallCycle_per_Mem_Inst;
+    const double mspi = d->ratios.MemStallCycle_per_Inst;
+
+    if (!isfinite(ipc) || !isfinite(cmr) || !isfinite(mspm) || !isfinite(mspi) ||
+        !isfinite(cycles_per_ms)) {
+        return -1;
+    }
+    *yP = predict5(&g_model_P, cycles_per_ms, ipc, cmr, mspm, mspi);
+    *yE = predict5(&g_model_E, cycles_per_ms, ipc, cmr, mspm, mspi);
+    return 0;
+}
+
 static const char *choose_placement_coreset_model(pid_t pid,
                                                   MonitorData *d,
                                                   int *last_on_p,
@@ -1148,8 +1743,8 @@ static const char *choose_placement_coreset_model(pid_t pid,
     const double mspm = d->ratios.MemStallCycle_per_Mem_Inst;
     const double mspi = d->ratios.MemStallCycle_per_Inst;
 
-    if (!isfinite(ipc) || !isfinite(cmr) || !isfinite(mspm) || !isfinite(mspi) ||
-        !isfinite(cycles_per_ms) || dt_ms <= 0.0) {
+    double yhatP, yhatE;
+    if (linear_scores(d, &yhatP, &yhatE) != 0) {
 
         if (out_yP) *out_yP = 0.0;
         if (out_yE) *out_yE = 0.0;
@@ -1158,9 +1753,6 @@ static const char *choose_placement_coreset_model(pid_t pid,
         return ALL_CORESET;
     }
 
-    const double yhatP = predict5(&g_model_P, cycles_per_ms, ipc, cmr, mspm, mspi);
-    const double yhatE = predict5(&g_model_E, cycles_per_ms, ipc, cmr, mspm, mspi);
-
     if (out_yP) *out_yP = yhatP;
     if (out_yE) *out_yE = yhatE;
 
@@ -1169,19 +1761,23 @@ static const char *choose_placement_coreset_model(pid_t pid,
         cycles_per_ms, ipc, cmr, mspm, mspi, yhatP, yhatE, (*last_on_p ? 'P' : 'E')
     );
 
+    // discount a side by how oversubscribed its cores currently are
+    const double effP = yhatP * core_load_slowdown(1);
+    const double effE = yhatE * core_load_slowdown(0);
+
     // hysteresis initialization
     if (!*has_last_on_p) {
-        *last_on_p = (yhatP >= yhatE) ? 1 : 0;
+        *last_on_p = (effP >= effE) ? 1 : 0;
         *has_last_on_p = 1;
     }
 
     const char *chosen;
     if (*last_on_p == 0) {
         // currently on E: switch only if P clearly better
-        chosen = (yhatP > (1.0 + HYST) * yhatE) ? P_CORESET : E_CORESET;
+        chosen = (effP > (1.0 + HYST) * effE) ? P_CORESET : E_CORESET;
     } else {
         // currently on P: switch only if E clearly better
-        chosen = (yhatE > (1.0 + HYST) * yhatP) ? E_CORESET : P_CORESET;
+        chosen = (effE > (1.0 + HYST) * effP) ? E_CORESET : P_CORESET;
     }
 
 
@@ -1236,53 +1832,544 @@ static const char *choose_placement_coreset_model(pid_t pid,
 
 
 
-static void process_queue(DynamicCoreMasks *masks) {
-    SCHEDULER_PRINTF("Processing queue with %d entries\n", queue_size);
+/* --- Per-thread placement ---
+ * A process placed on P keeps its busy threads there, but threads that used
+ * less than g_light_thread_fraction of the busiest thread's cycles in the
+ * last window (I/O helpers, pollers) are pinned to the E cores on their own.
+ * Only the sampled threads (the busiest MAX_THREAD_SAMPLES) are split off;
+ * everything else follows the process. With the cgroup actuator the leaf's
+ * cpuset bounds every thread, so splitting is left to the affinity path.
+ */
+/* --- Serial bottleneck ---
+ * Between parallel regions one thread (main, reducer) often retires nearly
+ * all of the process's instructions while the workers wait. When a single
+ * sampled thread carries g_serial_share of the instructions for
+ * SERIAL_MIN_WINDOWS windows in a row, it is pinned to P even though the
+ * process as a whole sits on E (or ALL); its idle workers stay put.
+ */
+static void track_serial_thread(QueueEntry *e, const MonitorData *d, int n) {
+    unsigned long long total = 0, top = 0;
+    pid_t top_tid = 0;
+    for (int i = 0; i < n; i++) {
+        total += d->threads[i].inst_retired;
+        if (d->threads[i].inst_retired > top) {
+            top = d->threads[i].inst_retired;
+            top_tid = d->threads[i].tid;
+        }
+    }
+    double share = total ? (double)top / (double)total : 0.0;
 
-    int i = 0;
-    while (i < queue_size) {
-        pid_t pid = queue[i].pid;
+    if (g_serial_share > 0.0 && n >= 2 && share >= g_serial_share) {
+        if (top_tid == e->serial_tid) {
+            e->serial_streak++;
+        } else if (e->boosted_tid && share < g_serial_share + SERIAL_RELEASE_MARGIN) {
+            // a different thread only barely dominates: keep the current boost
+        } else {
+            e->serial_tid = top_tid;
+            e->serial_streak = 1;
+        }
+    } else if (!e->boosted_tid || share < g_serial_share - SERIAL_RELEASE_MARGIN) {
+        e->serial_tid = 0;
+        e->serial_streak = 0;
+    }
+}
 
-        if (!is_process_alive(pid)) {
-            SCHEDULER_PRINTF("Process PID %d died, removing from queue\n", pid);
-            remove_queue_entry(i);
-            continue;
+static int serial_boost_wanted(const QueueEntry *e, const char *placement) {
+    return e->serial_tid && e->serial_streak >= SERIAL_MIN_WINDOWS &&
+           placement != P_CORESET && P_CORESET[0] && e->cgroup_state != 1;
+}
+
+static void apply_serial_boost(QueueEntry *e, const char *placement, int mask_changed) {
+    if (mask_changed) e->boosted_tid = 0;   // apply_placement() rewrote every thread
+
+    pid_t want = serial_boost_wanted(e, placement) ? e->serial_tid : 0;
+    if (want == e->boosted_tid) return;
+
+    if (e->boosted_tid) {
+        const AffinityMask *home = affinity_mask_for(placement);
+        if (home && sched_setaffinity(e->boosted_tid, home->size, home->set) == 0) {
+            SCHEDULER_PRINTF("PID %d thread %d -> %s (serial phase over)\n", e->pid, e->boosted_tid, placement);
+        }
+        e->boosted_tid = 0;
+    }
+    if (want) {
+        const AffinityMask *p_mask = affinity_mask_for(P_CORESET);
+        if (!p_mask) return;
+        if (sched_setaffinity(want, p_mask->size, p_mask->set) == 0) {
+            SCHEDULER_PRINTF("PID %d thread %d -> %s (serial bottleneck)\n", e->pid, want, P_CORESET);
+            e->boosted_tid = want;
+        } else if (errno != ESRCH) {
+            SCHEDULER_PERROR("Failed to set affinity for TID %d: %s\n", want, strerror(errno));
+        }
+    }
+}
+
+/* --- Gang placement ---
+ * Threads of an OpenMP/pthread team retire similar instruction counts at a
+ * similar IPC each window. Split across P and E, the E members reach every
+ * barrier late and the team runs at E speed, so a detected team is always
+ * placed as a whole: never split off as light threads, and never left on
+ * ALL_CORESET for the kernel to spread over both core types.
+ */
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static int placement_threads(const QueueEntry *e);
+
+static void detect_gang(QueueEntry *e, const MonitorData *d, int n, unsigned char *member) {
+    memset(member, 0, n);
+    e->gang_threads = 0;
+    e->gang_split = 0;
+    if (!g_gang_placement || n < GANG_MIN_THREADS) return;
+
+    double inst[MAX_THREAD_SAMPLES], ipc[MAX_THREAD_SAMPLES];
+    double sorted_inst[MAX_THREAD_SAMPLES], sorted_ipc[MAX_THREAD_SAMPLES];
+    int m = 0;
+    for (int i = 0; i < n; i++) {
+        if (!d->threads[i].inst_retired || !d->threads[i].core_cycles) continue;
+        inst[m] = (double)d->threads[i].inst_retired;
+        ipc[m] = inst[m] / (double)d->threads[i].core_cycles;
+        m++;
+    }
+    if (m < GANG_MIN_THREADS) return;
+
+    memcpy(sorted_inst, inst, m * sizeof(double));
+    memcpy(sorted_ipc, ipc, m * sizeof(double));
+    qsort(sorted_inst, m, sizeof(double), cmp_double);
+    qsort(sorted_ipc, m, sizeof(double), cmp_double);
+    double med_inst = sorted_inst[m / 2];
+    double med_ipc = sorted_ipc[m / 2];
+
+    int members = 0, on_p = 0, on_e = 0;
+    for (int i = 0, k = 0; i < n; i++) {
+        if (!d->threads[i].inst_retired || !d->threads[i].core_cycles) continue;
+        if (fabs(inst[k] - med_inst) <= GANG_TOLERANCE * med_inst &&
+            fabs(ipc[k] - med_ipc) <= GANG_TOLERANCE * med_ipc) {
+            member[i] = 1;
+            members++;
+            if (d->threads[i].pcore) on_p++;
+            else                     on_e++;
         }
+        k++;
+    }
+    if (members < GANG_MIN_THREADS) {
+        memset(member, 0, n);
+        return;
+    }
+    // only the MAX_THREAD_SAMPLES busiest threads are sampled; when that many
+    // came in, the team can be larger, so size it by the runnable threads
+    if (n == MAX_THREAD_SAMPLES) {
+        int runnable = placement_threads(e);
+        if (runnable > members) members = runnable;
+    }
+    e->gang_threads = members;
+    e->gang_split = on_p && on_e;
+}
+
+// Core type for a team that has no P/E decision yet: P if it fits there
+static const char *gang_side(const QueueEntry *e) {
+    if (!E_CORESET[0] || e->gang_threads <= g_p_capacity) return P_CORESET;
+    if (e->gang_threads <= g_e_capacity || !P_CORESET[0]) return E_CORESET;
+    return g_p_capacity >= g_e_capacity ? P_CORESET : E_CORESET;
+}
+
+static void classify_thread_samples(QueueEntry *e, const MonitorData *d) {
+    e->n_light = 0;
+    if (!g_thread_placement || d->thread_sample_count < 2) {
+        e->serial_tid = 0;
+        e->serial_streak = 0;
+        e->gang_threads = 0;
+        e->gang_split = 0;
+        return;
+    }
+
+    int n = d->thread_sample_count < MAX_THREAD_SAMPLES ? d->thread_sample_count : MAX_THREAD_SAMPLES;
+    unsigned char member[MAX_THREAD_SAMPLES];
+    track_serial_thread(e, d, n);
+    detect_gang(e, d, n, member);
+    if (e->gang_split) {
+        SCHEDULER_PRINTF("PID %d: %d-thread team straddles P and E, placing it as a gang\n",
+                         e->pid, e->gang_threads);
+    }
+
+    unsigned long long busiest = 0;
+    for (int i = 0; i < n; i++) {
+        if (d->threads[i].core_cycles > busiest) busiest = d->threads[i].core_cycles;
+    }
+    if (busiest == 0) return;
+
+    for (int i = 0; i < n; i++) {
+        if (member[i]) continue;   // never split a team member from its gang
+        if ((double)d->threads[i].core_cycles < g_light_thread_fraction * (double)busiest) {
+            e->light_tids[e->n_light++] = d->threads[i].tid;
+        }
+    }
+    qsort(e->light_tids, e->n_light, sizeof(pid_t), cmp_tid);
+}
+
+static int thread_split_allowed(const QueueEntry *e, const char *placement) {
+    return g_thread_placement && placement == P_CORESET && E_CORESET[0] &&
+           e->cgroup_state != 1;
+}
+
+// Reconcile the E-pinned threads of a process with its latest light set.
+// mask_changed: apply_placement() just rewrote every thread, dropping the pins.
+static void apply_thread_split(QueueEntry *e, const char *placement, int mask_changed) {
+    if (mask_changed) e->n_split = 0;
+
+    int want = thread_split_allowed(e, placement) ? e->n_light : 0;
+    if (want == 0 && e->n_split == 0) return;
+
+    const AffinityMask *e_mask = affinity_mask_for(E_CORESET);
+    const AffinityMask *home = affinity_mask_for(placement);
+    if (!e_mask || !home) return;
+
+    // newly light threads go to E
+    for (int i = 0; i < want; i++) {
+        pid_t tid = e->light_tids[i];
+        if (bsearch(&tid, e->split_tids, e->n_split, sizeof(pid_t), cmp_tid)) continue;
+        if (sched_setaffinity(tid, e_mask->size, e_mask->set) == 0) {
+            SCHEDULER_PRINTF("PID %d thread %d -> %s (light)\n", e->pid, tid, E_CORESET);
+        } else if (errno != ESRCH) {
+            SCHEDULER_PERROR("Failed to set affinity for TID %d: %s\n", tid, strerror(errno));
+        }
+    }
+    // threads that got busy again rejoin the process
+    for (int i = 0; i < e->n_split; i++) {
+        pid_t tid = e->split_tids[i];
+        if (want && bsearch(&tid, e->light_tids, want, sizeof(pid_t), cmp_tid)) continue;
+        if (sched_setaffinity(tid, home->size, home->set) == 0) {
+            SCHEDULER_PRINTF("PID %d thread %d -> %s (rejoined)\n", e->pid, tid, placement);
+        }
+    }
+
+    memcpy(e->split_tids, e->light_tids, want * sizeof(pid_t));
+    e->n_split = want;
+}
+
+// CPUs a process needs on its own side: its threads' summed time on
+// P and E over the window, rounded up, so blocked threads cost nothing.
+// Without residency (first window, no counters) every thread counts. Either
+// way the light threads split off to E are left out; the global pass charges
+// them to E.
+static int placement_threads(const QueueEntry *e) {
+    const MonitorData *d = &e->current_data;
+    int threads = d->thread_count > 0 ? d->thread_count : 1;
+    double busy_ms = d->p_time_ms + d->e_time_ms;
+    if (d->dt_ms > 0.0 && busy_ms > 0.0) {
+        double runnable = ceil(busy_ms / d->dt_ms);
+        if (runnable < threads) threads = (int)runnable;
+    }
+    if (g_thread_placement && e->cgroup_state != 1 && e->n_light > 0) {
+        threads -= e->n_light;
+    }
+    return threads > 0 ? threads : 1;
+}
 
-        MonitorData data = queue[i].current_data;
-        int startup_flag = queue[i].startup_flag;
+/* --- Global P/E placement ---
+ * Per-process decisions send every process that prefers P to P, however
+ * many there are. This pass looks at all scored processes together and
+ * fills P- and E-core capacity (one runnable thread per CPU) greedily by
+ * predicted speedup per thread, which maximizes the summed predicted
+ * inst/ms for this fractional-knapsack shaped problem. Processes that do
+ * not fit anywhere go to the side that ends up least oversubscribed.
+ * Load from unmanaged work (busy time and runqueue waits not explained by
+ * our own threads, see cpuload.c) is charged to each side up front, so
+ * saturated P cores repel moves and work spills to idle E cores.
+ */
+typedef struct {
+    QueueEntry *e;
+    int threads;
+    double gain;          // (yP - yE) per thread, with a bonus for staying put
+} PlacementCandidate;
+
+static PlacementCandidate *g_candidates = NULL;
+static int g_candidates_cap = 0;
+
+static void init_placement_capacity(void) {
+    const topology_t *t = topology_get();
+    g_p_capacity = g_e_capacity = 0;
+    for (int c = 0; c < t->nr_cpus; c++) {
+        if (!t->cpu[c].present || !t->cpu[c].online) continue;
+        if (t->cpu[c].pcore) g_p_capacity++;
+        else                 g_e_capacity++;
+    }
+}
 
-        // restore latest topology counts from history if available
-        if (queue[i].history_count > 0) {
-            int latest_idx = queue[i].history_count - 1;
-            data.pthread_count = queue[i].history[latest_idx].pthread_count;
-            data.pcore_count   = queue[i].history[latest_idx].pcore_count;
-            data.ecore_count   = queue[i].history[latest_idx].ecore_count;
+static int cmp_candidate_gain(const void *a, const void *b) {
+    double x = ((const PlacementCandidate *)a)->gain;
+    double y = ((const PlacementCandidate *)b)->gain;
+    return (x < y) - (x > y);   // descending
+}
+
+static void global_placement_pass(void) {
+    if (g_candidates_cap < queue_size) {
+        PlacementCandidate *grown = realloc(g_candidates, queue_size * sizeof(*grown));
+        if (!grown) {
+            SCHEDULER_PERROR("Failed to allocate placement candidates\n");
+            return;
         }
+        g_candidates = grown;
+        g_candidates_cap = queue_size;
+    }
+
+    int n = 0;
+    for (QueueEntry *e = queue_first(); e; e = queue_next(e)) {
+        if (!e->scored) continue;
+        int threads = placement_threads(e);
+        double yP = e->yP, yE = e->yE;
+        // same hysteresis as the per-process decision, relative to the last pass
+        if (e->placement == P_CORESET)      yP *= 1.0 + HYST;
+        else if (e->placement == E_CORESET) yE *= 1.0 + HYST;
+        g_candidates[n].e = e;
+        g_candidates[n].threads = threads;
+        g_candidates[n].gain = (yP - yE) / threads;
+        n++;
+    }
+    if (n == 0) return;
+    qsort(g_candidates, n, sizeof(*g_candidates), cmp_candidate_gain);
+
+    double load_p = 0.0, load_e = 0.0;
+    if (g_use_cpuload && cpuload_ready()) {
+        int managed_p = 0, managed_e = 0;
+        for (int i = 0; i < n; i++) {
+            if (g_candidates[i].e->placement == P_CORESET)      managed_p += g_candidates[i].threads;
+            else if (g_candidates[i].e->placement == E_CORESET) managed_e += g_candidates[i].threads;
+        }
+        load_p = fmax(0.0, cpuload_demand(1) - managed_p);
+        load_e = fmax(0.0, cpuload_demand(0) - managed_e);
+    }
+    const double background_p = load_p, background_e = load_e;
+
+    for (int i = 0; i < n; i++) {
+        PlacementCandidate *c = &g_candidates[i];
+        int on_p;
+        if (g_e_capacity == 0)                                  on_p = 1;
+        else if (g_p_capacity == 0)                             on_p = 0;
+        else if (c->gain > 0.0 && load_p + c->threads <= g_p_capacity) on_p = 1;
+        else if (load_e + c->threads <= g_e_capacity)           on_p = 0;
+        else if (load_p + c->threads <= g_p_capacity)           on_p = 1;
+        else {
+            double over_p = (load_p + c->threads) / g_p_capacity;
+            double over_e = (load_e + c->threads) / g_e_capacity;
+            on_p = (over_p < over_e) || (over_p == over_e && c->gain > 0.0);
+        }
+        if (on_p) load_p += c->threads;
+        else      load_e += c->threads;
+        if (on_p && thread_split_allowed(c->e, P_CORESET)) load_e += c->e->n_light;
+        if (!on_p && serial_boost_wanted(c->e, E_CORESET)) load_p += 1;
+
+        QueueEntry *e = c->e;
+        const char *placement = on_p ? P_CORESET : E_CORESET;
+        int changed = (placement != e->placement);
+        e->placement = placement;
+        e->last_on_p = on_p;
+        e->has_last_on_p = 1;
+
+        if (!changed && !e->pending_eval) continue;
+        unsigned old_mask = e->applied_mask_id;
+        int written = apply_placement(e, placement, e->current_data.thread_count);
+        if (written > 0) {
+            SCHEDULER_PRINTF("PID %d placement -> %s (%d threads)\n", e->pid, placement, written);
+        }
+        apply_thread_split(e, placement, e->applied_mask_id != old_mask);
+        apply_serial_boost(e, placement, e->applied_mask_id != old_mask);
+        eval_submit(e->pid, e->yP, e->yE, placement);
+        e->pending_eval = 0;
+    }
+    SCHEDULER_PRINTF("Global placement: %d processes, P load %.1f/%d (background %.1f), E load %.1f/%d (background %.1f)\n",
+                     n, load_p, g_p_capacity, background_p, load_e, g_e_capacity, background_e);
+}
 
-        // compute weighted ratios if we have history / last_used
-        if (queue[i].history_count > 0 || queue[i].has_last_used) {
-            compute_weighted_ratios(pid, &data, queue[i].history,
-                                    queue[i].history_count,
-                                    &queue[i].last_used,
-                                    queue[i].has_last_used);
+static int reserve_batch(int n) {
+    if (n <= g_batch_cap) return 0;
+    int cap = g_batch_cap ? g_batch_cap : 64;
+    while (cap < n) cap *= 2;
+    QueueEntry **b = realloc(g_batch, (size_t)cap * sizeof(*b));
+    if (!b) return -1;
+    g_batch = b;
+    MonitorData *d = realloc(g_batch_data, (size_t)cap * sizeof(*d));
+    if (!d) return -1;
+    g_batch_data = d;
+    if (g_cascade) {
+        MonitorData *cd = realloc(g_cascade_data, (size_t)cap * sizeof(*cd));
+        if (!cd) return -1;
+        g_cascade_data = cd;
+        int *idx = realloc(g_cascade_idx, (size_t)cap * sizeof(*idx));
+        if (!idx) return -1;
+        g_cascade_idx = idx;
+        unsigned char *stage = realloc(g_cascade_stage, (size_t)cap * sizeof(*stage));
+        if (!stage) return -1;
+        g_cascade_stage = stage;
+    }
+    g_batch_cap = cap;
+    return 0;
+}
+
+static void classify_batch(MonitorData *data, int n) {
+#ifdef USE_ONNX
+    if (g_classifier_onnx) {
+        classify_workload_onnx_batch(data, n);
+        return;
+    }
+#endif
+    classify_workload_cjson_batch(data, n);
+}
+
+static const char *class_of(const MonitorData *d, int onnx) {
+    double compute = onnx ? d->compute_prob_onnx : d->compute_prob_cjson;
+    double io = onnx ? d->io_prob_onnx : d->io_prob_cjson;
+    double memory = onnx ? d->memory_prob_onnx : d->memory_prob_cjson;
+    if (compute >= io && compute >= memory)
+        return "Compute";
+    return io >= memory ? "I/O" : "Memory";
+}
+
+// Forest vote margin: top class probability minus the runner-up
+static double vote_margin(const MonitorData *d) {
+    double p[3] = {d->compute_prob_cjson, d->io_prob_cjson, d->memory_prob_cjson};
+    double top = fmax(p[0], fmax(p[1], p[2]));
+    double second = p[0] + p[1] + p[2] - top - fmin(p[0], fmin(p[1], p[2]));
+    return top - second;
+}
+
+// Cheapest model first. The linear models settle every window whose yP/yE
+// margin is at least g_cascade_band; the forest classifies the rest in one
+// batch, and ONNX re-classifies the forest's close votes when loaded.
+static void run_cascade(int n) {
+    int m = 0;
+    for (int i = 0; i < n; i++) {
+        g_cascade_stage[i] = CASCADE_LINEAR;
+        double yP, yE;
+        if (g_batch[i]->startup_flag || linear_scores(&g_batch_data[i], &yP, &yE) != 0) continue;
+        double hi = fmax(yP, yE);
+        if (hi > 0.0 && fabs(yP - yE) / hi >= g_cascade_band) continue;
+        g_cascade_idx[m] = i;
+        g_cascade_data[m++] = g_batch_data[i];
+    }
+    if (m == 0) {
+        SCHEDULER_PRINTF("Cascade: %d windows, all settled by the linear models\n", n);
+        return;
+    }
+
+    int k = 0;
+    if (g_forest_ready) {
+        classify_workload_cjson_batch(g_cascade_data, m);
+        for (int j = 0; j < m; j++) {
+            MonitorData *d = &g_batch_data[g_cascade_idx[j]];
+            d->compute_prob_cjson = g_cascade_data[j].compute_prob_cjson;
+            d->io_prob_cjson = g_cascade_data[j].io_prob_cjson;
+            d->memory_prob_cjson = g_cascade_data[j].memory_prob_cjson;
+            g_cascade_stage[g_cascade_idx[j]] = CASCADE_FOREST;
+            // k <= j, so this only overwrites windows already read
+            if (g_onnx_ready && vote_margin(d) < g_cascade_vote_band) {
+                g_cascade_idx[k] = g_cascade_idx[j];
+                g_cascade_data[k++] = *d;
+            }
         }
+    } else if (g_onnx_ready) {
+        k = m;
+    }
+#ifdef USE_ONNX
+    if (k > 0) {
+        classify_workload_onnx_batch(g_cascade_data, k);
+        for (int j = 0; j < k; j++) {
+            MonitorData *d = &g_batch_data[g_cascade_idx[j]];
+            d->compute_prob_onnx = g_cascade_data[j].compute_prob_onnx;
+            d->io_prob_onnx = g_cascade_data[j].io_prob_onnx;
+            d->memory_prob_onnx = g_cascade_data[j].memory_prob_onnx;
+            g_cascade_stage[g_cascade_idx[j]] = CASCADE_ONNX;
+        }
+    }
+#endif
+    SCHEDULER_PRINTF("Cascade: %d windows, %d to the forest, %d to ONNX\n", n, g_forest_ready ? m : 0, k);
+}
+
+static const char *cascade_class(int i, const MonitorData *d) {
+    switch (g_cascade_stage[i]) {
+    case CASCADE_FOREST: return class_of(d, 0);
+    case CASCADE_ONNX:   return class_of(d, 1);
+    default:             return "Linear";
+    }
+}
+
+// A window the linear models could not call goes by its class: Compute
+// and Memory lean to P, I/O to E. The preferred side's score is lifted just
+// past the other side's hysteresis so the global pass follows it too, while
+// the gain stays below that of the confident windows.
+static const char *cascade_settle(QueueEntry *e, const char *cls, double *yP, double *yE) {
+    const double lean = (1.0 + HYST) * 1.01;
+    int prefer_p = strcmp(cls, "I/O") != 0;
+    // + 1 inst/ms still breaks a tie when both models predict nothing
+    if (prefer_p) *yP = fmax(*yP, fmax(*yE * lean, *yE + 1.0));
+    else          *yE = fmax(*yE, fmax(*yP * lean, *yP + 1.0));
+    e->last_on_p = prefer_p;
+    e->has_last_on_p = 1;
+    return prefer_p ? P_CORESET : E_CORESET;
+}
 
-        if (!is_process_alive(pid)) {
-            SCHEDULER_PRINTF("Process PID %d died during computation, removing\n", pid);
-            remove_queue_entry(i);
+static void process_queue(DynamicCoreMasks *masks) {
+    SCHEDULER_PRINTF("Processing queue with %d entries\n", queue_size);
+
+    // gather every fresh window first so the classifier sees them as one batch
+    int n = 0;
+    QueueEntry *next;
+    for (QueueEntry *e = queue_first(); e; e = next) {
+        next = queue_next(e);
+
+        // decisions are driven by new telemetry only
+        if (!e->has_new_data) continue;
+        e->has_new_data = 0;
+
+        if (!is_process_alive(e->pid)) {
+            SCHEDULER_PRINTF("Process PID %d died, removing from queue\n", e->pid);
+            remove_queue_entry(e);
+            continue;
+        }
+        if (reserve_batch(n + 1) != 0) {
+            SCHEDULER_PERROR("Out of memory for the decision batch, PID %d waits a cycle\n", e->pid);
+            e->has_new_data = 1;
             continue;
         }
 
-        // timing (your current code measures ~0us because start/end are back-to-back)
+        MonitorData *data = &g_batch_data[n];
+        *data = e->current_data;
+        // counts come from the latest window, ratios from the running average
+        data->ratios = e->ewma;
+        classify_thread_samples(e, data);
+        g_batch[n++] = e;
+    }
+
+    long class_time_cjson = 0;
+    if ((g_classifier || g_cascade) && n > 0) {
         struct timespec start_time, end_time;
         clock_gettime(CLOCK_MONOTONIC, &start_time);
-        // ... if you actually do classification work, put it here ...
+        if (g_cascade) {
+            run_cascade(n);
+        } else {
+            classify_batch(g_batch_data, n);
+        }
         clock_gettime(CLOCK_MONOTONIC, &end_time);
-        long class_time_cjson = (end_time.tv_sec - start_time.tv_sec) * 1000000
-                              + (end_time.tv_nsec - start_time.tv_nsec) / 1000;
+        // per-process share of the batch, in microseconds
+        class_time_cjson = ((end_time.tv_sec - start_time.tv_sec) * 1000000
+                         + (end_time.tv_nsec - start_time.tv_nsec) / 1000) / n;
+    }
+
+    int rescored = 0;
+    for (int i = 0; i < n; i++) {
+        QueueEntry *e = g_batch[i];
+        MonitorData data = g_batch_data[i];
+        pid_t pid = e->pid;
+        int startup_flag = e->startup_flag;
 
         const char *predicted_class = "N/A";
+        if (g_cascade) {
+            predicted_class = cascade_class(i, &data);
+        } else if (g_classifier) {
+            predicted_class = class_of(&data, g_classifier_onnx);
+        }
 
         double yP = 0.0, yE = 0.0;
         const char *chosen_coreset = NULL;
@@ -1293,39 +2380,56 @@ static void process_queue(DynamicCoreMasks *masks) {
             chosen_coreset = choose_placement_coreset_model(
                 pid,
                 &data,
-                &queue[i].last_on_p,
-                &queue[i].has_last_on_p,
+                &e->last_on_p,
+                &e->has_last_on_p,
                 &yP, &yE
             );
+            if (g_cascade && g_cascade_stage[i] != CASCADE_LINEAR && chosen_coreset != ALL_CORESET) {
+                chosen_coreset = cascade_settle(e, predicted_class, &yP, &yE);
+            }
+        }
+
+        // a team left on ALL_CORESET would be spread over both core types
+        if (!startup_flag && chosen_coreset == ALL_CORESET && e->gang_threads) {
+            chosen_coreset = gang_side(e);
         }
 
         write_to_csv(&data, class_time_cjson, predicted_class);
 
-        // apply placement once
-        set_affinity_for_all_threads(pid, chosen_coreset);
-        SCHEDULER_PRINTF("PID %d placement -> %s\n", pid, chosen_coreset);
-        verify_affinity(pid);
+        // a P/E preference is settled by the global pass below; startup and
+        // unscorable windows (ALL_CORESET) are applied directly
+        e->yP = yP;
+        e->yE = yE;
+        e->scored = g_global_placement && chosen_coreset != ALL_CORESET;
+        if (e->scored) {
+            e->pending_eval = 1;
+            rescored = 1;
+        } else {
+            e->placement = NULL;
 
-        // evaluation logging: wait then measure actual PSR distribution
-        usleep(50 * 1000);
-        PsrSummary actual = summarize_psr_for_process(pid);
-        printf("SCHED_EVAL pid=%d yP=%.6f yE=%.6f chosen=%s actual_P=%d actual_E=%d actual_other=%d total=%d\n",
-               pid, yP, yE, chosen_coreset,
-               actual.p_threads, actual.e_threads, actual.other_threads, actual.total_threads);
+            // apply placement only where it changed
+            unsigned old_mask = e->applied_mask_id;
+            int written = apply_placement(e, chosen_coreset, data.thread_count);
+            if (written > 0) {
+                SCHEDULER_PRINTF("PID %d placement -> %s (%d threads)\n", pid, chosen_coreset, written);
+            }
+            apply_thread_split(e, chosen_coreset, e->applied_mask_id != old_mask);
+            apply_serial_boost(e, chosen_coreset, e->applied_mask_id != old_mask);
 
-        // update queue state
-        queue[i].startup_flag = 0;
-        queue[i].last_used = data;
-        queue[i].has_last_used = 1;
-        queue[i].current_data = data;
-        queue[i].history_count = 0;
+            // evaluation (actual PSR distribution) is sampled out of band
+            eval_submit(pid, yP, yE, chosen_coreset);
+        }
 
-        strncpy(queue[i].predicted_class, predicted_class,
-                sizeof(queue[i].predicted_class) - 1);
-        queue[i].predicted_class[sizeof(queue[i].predicted_class) - 1] = '\0';
+        // update queue state
+        e->startup_flag = 0;
+        e->current_data = data;
 
-        i++;
+        strncpy(e->predicted_class, predicted_class,
+                sizeof(e->predicted_class) - 1);
+        e->predicted_class[sizeof(e->predicted_class) - 1] = '\0';
     }
+
+    if (rescored) global_placement_pass();
 }
 
 
@@ -1477,18 +2581,95 @@ static void process_queue(DynamicCoreMasks *masks) {
         //}
 
 
+// SCHED_CLASSIFIER=1 classifies every window with the forest, or with ONNX
+// under SCHED_CLASSIFIER_BACKEND=onnx. SCHED_CASCADE=1 runs the forest, and
+// ONNX when its model is there, only on windows the linear models leave open.
+static void init_classifiers(void) {
+    const char *clf = getenv("SCHED_CLASSIFIER");
+    const char *cascade = getenv("SCHED_CASCADE");
+    g_classifier = clf && atoi(clf) > 0;
+    g_cascade = cascade && atoi(cascade) > 0;
+    if (!g_classifier && !g_cascade) return;
+
+    const char *band = getenv("SCHED_CASCADE_BAND");
+    if (band && atof(band) >= 0.0) g_cascade_band = atof(band);
+    const char *vote_band = getenv("SCHED_CASCADE_VOTE_BAND");
+    if (vote_band && atof(vote_band) >= 0.0) g_cascade_vote_band = atof(vote_band);
+
+    const char *model = getenv("SCHED_MODEL_PATH");
+    const char *backend = getenv("SCHED_CLASSIFIER_BACKEND");
+    int want_onnx = g_classifier && backend && strcmp(backend, "onnx") == 0;
+#ifdef USE_ONNX
+    const char *onnx_model = model && *model ? model : MODEL_PATH_ONNX;
+    char onnx_file[512];
+    snprintf(onnx_file, sizeof(onnx_file), "%s.onnx", onnx_model);
+    // a session that fails to load exits the process, so only try a readable model
+    if ((want_onnx || g_cascade) && access(onnx_file, R_OK) == 0 &&
+        init_classifier_onnx(onnx_model) == 0) {
+        g_onnx_ready = 1;
+        g_classifier_onnx = want_onnx;
+    } else if (want_onnx) {
+        SCHEDULER_PERROR("Cannot load the ONNX classifier from %s, using the forest\n", onnx_file);
+    }
+#else
+    if (want_onnx) {
+        SCHEDULER_PERROR("Built without ONNX Runtime, using the forest classifier\n");
+    }
+#endif
+
+    if (!g_classifier_onnx || g_cascade) {
+        const char *forest_model = model && *model ? model : MODEL_PATH_CJSON;
+        if (init_classifier_cjson(forest_model) == 0) {
+            g_forest_ready = 1;
+        } else {
+            SCHEDULER_PERROR("Cannot load the classifier from %s, running without it\n", forest_model);
+            g_classifier = 0;
+        }
+    }
+    if (g_cascade) {
+        SCHEDULER_PRINTF("Inference cascade: linear, forest below a %.2f margin%s\n", g_cascade_band,
+                         g_onnx_ready ? ", ONNX below a forest vote margin" : "");
+    }
+}
+
 void cleanup_scheduler(int server_fd) {
     SCHEDULER_PRINTF("Cleaning up scheduler\n");
-    //cleanup_classifier_cjson();
+    eval_stop();
+    if (g_forest_ready) cleanup_classifier_cjson();
+#ifdef USE_ONNX
+    if (g_onnx_ready) cleanup_classifier_onnx();
+#endif
+    free(g_cascade_data);
+    free(g_cascade_idx);
+    free(g_cascade_stage);
 
     if (server_fd >= 0) {
         close(server_fd);
     }
     unlink(SOCKET_PATH);
-    for (int i = 0; i < MAX_QUEUE_SIZE; i++) {
-        free_queue_entry(&queue[i]);
-    }
+    for (QueueEntry *e = queue_first(); e; e = queue_next(e)) {
+        free_queue_entry(e);
+    }
+    free(queue);
+    free(g_pid_buckets);
+    free(g_candidates);
+    g_candidates = NULL;
+    g_candidates_cap = 0;
+    free(g_batch);
+    free(g_batch_data);
+    g_batch = NULL;
+    g_batch_data = NULL;
+    g_batch_cap = 0;
+    free_affinity_masks();
+    queue = NULL;
+    g_pid_buckets = NULL;
+    g_free_head = g_live_head = g_live_tail = -1;
+    g_queue_used = 0;
     queue_size = 0;
+    if (g_epoll_fd >= 0) {
+        close(g_epoll_fd);
+        g_epoll_fd = -1;
+    }
 }
 
 
@@ -1498,26 +2679,153 @@ void cleanup_scheduler(int server_fd) {
 
 
 
+static ssize_t read_full(int fd, void *buf, size_t len) {
+    size_t got = 0;
+    while (got < len) {
+        ssize_t n = read(fd, (char *)buf + got, len - got);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        got += (size_t)n;
+    }
+    return (ssize_t)got;
+}
+
+// Read every pending connection from the listening socket.
+// Returns 1 when a shutdown request was received.
+static int accept_monitor_messages(int server_fd) {
+    while (1) {
+        int client_fd = accept(server_fd, NULL, NULL);
+        if (client_fd == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            SCHEDULER_PERROR("Error accepting connection: %s\n", strerror(errno));
+            continue;
+        }
+
+        pid_t pid;
+        int ring_fds[2];
+        int n_ring_fds = 0;
+        ssize_t bytes_read = recv_pid(client_fd, &pid, ring_fds, &n_ring_fds);
+        if (bytes_read != sizeof(pid)) {
+            SCHEDULER_PERROR("Failed to read PID\n");
+            for (int k = 0; k < n_ring_fds; k++) close(ring_fds[k]);
+            close(client_fd);
+            continue;
+        }
+
+        if (pid == -1) {
+            SCHEDULER_PRINTF("Received shutdown request\n");
+            for (int k = 0; k < n_ring_fds; k++) close(ring_fds[k]);
+            close(client_fd);
+            return 1;
+        }
+
+        int startup_flag;
+        MonitorData data;
+        // the record carries per-thread samples, so it may arrive in pieces
+        bytes_read = read_full(client_fd, &startup_flag, sizeof(int));
+        bytes_read += read_full(client_fd, &data, sizeof(MonitorData));
+
+        if (bytes_read != sizeof(int) + sizeof(MonitorData)) {
+            SCHEDULER_PERROR("Incomplete data received for PID %d\n", pid);
+            for (int k = 0; k < n_ring_fds; k++) close(ring_fds[k]);
+            close(client_fd);
+            continue;
+        }
+
+        int added = add_to_queue(pid, data, startup_flag);
+        if (n_ring_fds == 2 && startup_flag && added == 0) {
+            attach_ring(pid, ring_fds[0], ring_fds[1]);
+        } else {
+            for (int k = 0; k < n_ring_fds; k++) close(ring_fds[k]);
+        }
+        close(client_fd);
+    }
+    return 0;
+}
+
 int main(int argc, char *argv[]) {
     if (argc != 2) {
         SCHEDULER_PERROR("Usage: %s <coreset>\n", argv[0]);
         return 1;
     }
 
-    for (int i = 0; i < MAX_QUEUE_SIZE; i++) {
-        init_queue_entry(&queue[i]);
-    }
+    const char *tau = getenv("SCHEDULER_EWMA_TAU_MILLISECONDS");
+    if (tau && atof(tau) > 0.0) g_ewma_tau_ms = atof(tau);
+
+    const char *gp = getenv("SCHED_GLOBAL_PLACEMENT");
+    if (gp && atoi(gp) == 0) g_global_placement = 0;
+    init_placement_capacity();
+    SCHEDULER_PRINTF("Placement: %s, capacity P=%d E=%d\n",
+                     g_global_placement ? "global" : "per-process", g_p_capacity, g_e_capacity);
+
+    const char *tp = getenv("SCHED_THREAD_PLACEMENT");
+    if (tp && atoi(tp) == 0) g_thread_placement = 0;
+    const char *ltf = getenv("SCHED_LIGHT_THREAD_FRACTION");
+    if (ltf && atof(ltf) > 0.0) g_light_thread_fraction = atof(ltf);
 
-    set_affinity(getpid(), argv[1]);
+    const char *ss = getenv("SCHED_SERIAL_SHARE");
+    if (ss) g_serial_share = atof(ss);
+
+    const char *gang = getenv("SCHED_GANG_PLACEMENT");
+    if (gang && atoi(gang) == 0) g_gang_placement = 0;
+
+    // Bind before the classifiers start: threads inherit the mask of the thread
+    // that creates them, so the ONNX intra-op pool stays on this coreset too
+    set_affinity_for_all_threads(getpid(), argv[1]);
     SCHEDULER_PRINTF("Scheduler bound to coreset %s\n", argv[1]);
 
+    init_classifiers();
+
+    const char *cl = getenv("SCHED_CPULOAD");
+    if (cl && atoi(cl) == 0) g_use_cpuload = 0;
+    if (g_use_cpuload) {
+        if (cpuload_init(NULL) != 0) {
+            SCHEDULER_PERROR("Cannot read /proc/stat, placement ignores core load\n");
+            g_use_cpuload = 0;
+        } else if (!cpuload_has_runqueue()) {
+            SCHEDULER_PRINTF("No /proc/schedstat, core load uses busy time only\n");
+        }
+    }
+
+    const char *actuator = getenv("SCHED_ACTUATOR");
+    if (actuator && strcmp(actuator, "cgroup") == 0) {
+        if (cgroup_backend_init(NULL) == 0) {
+            g_actuator_cgroup = 1;
+            SCHEDULER_PRINTF("Actuator: cgroup v2 cpusets under %s\n", cgroup_backend_root());
+        } else {
+            SCHEDULER_PERROR("Cannot set up cgroup root %s (%s), using sched_setaffinity\n",
+                             cgroup_backend_root(), strerror(errno));
+        }
+    }
+
+    if (init_process_table() != 0) {
+        SCHEDULER_PERROR("Failed to allocate the process table\n");
+        return 1;
+    }
+
+    // TOPOLOGY_SYSFS_ROOT can point at a fake sysfs tree to test other layouts
+    if (topology_init(NULL) != 0) {
+        SCHEDULER_PERROR("No CPUs found in sysfs, assuming 16 CPUs of one class\n");
+    }
+    SCHEDULER_PRINTF("Topology: P=%s E=%s ALL=%s hybrid=%d\n",
+                     P_CORESET, E_CORESET, ALL_CORESET, topology_is_hybrid());
+
     // if (init_classifier_cjson(MODEL_PATH_CJSON) != 0) {
     //     SCHEDULER_PERROR("Failed to initialize CJSON classifier\n");
     //     return 1;
     // }
 
-    if (load_linear_model5("model_P.json", &g_model_P) != 0) return 1;
-    if (load_linear_model5("model_E.json", &g_model_E) != 0) return 1;
+#ifdef USE_COMPILED_MODELS
+    if (compiled_have_linear) {
+        linear_model5_coef(compiled_linear_P, &g_model_P);
+        linear_model5_coef(compiled_linear_E, &g_model_E);
+        SCHEDULER_PRINTF("Using the compiled-in linear models\n");
+    }
+#endif
+    if (!g_model_P.loaded && load_linear_model5("model_P.json", &g_model_P) != 0) return 1;
+    if (!g_model_E.loaded && load_linear_model5("model_E.json", &g_model_E) != 0) return 1;
 
     SCHEDULER_PRINTF("Loaded models:\n");
     SCHEDULER_PRINTF(" P: b=%.3f w_cycles/ms=%.6f w_ipc=%.3f w_cmr=%.3f w_mspm=%.3f w_mspi=%.3f\n",
@@ -1563,59 +2871,83 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
-    SCHEDULER_PRINTF("Running, listening on %s\n", SOCKET_PATH);
+    g_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    int tick_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (g_epoll_fd < 0 || tick_fd < 0) {
+        SCHEDULER_PERROR("epoll/timerfd: %s\n", strerror(errno));
+        cleanup_scheduler(server_fd);
+        return 1;
+    }
 
-    while (1) {
-        while (1) {
-            int client_fd = accept(server_fd, NULL, NULL);
-            if (client_fd == -1) {
-                if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                    break;
-                }
-                SCHEDULER_PERROR("Error accepting connection: %s\n", strerror(errno));
-                continue;
-            }
+    struct itimerspec tick;
+    tick.it_interval.tv_sec = SCHEDULER_SLEEP_MILLISECONDS / 1000;
+    tick.it_interval.tv_nsec = (SCHEDULER_SLEEP_MILLISECONDS % 1000) * 1000000L;
+    tick.it_value = tick.it_interval;
+    timerfd_settime(tick_fd, 0, &tick, NULL);
 
-            pid_t pid;
-            ssize_t bytes_read = read(client_fd, &pid, sizeof(pid));
-            if (bytes_read != sizeof(pid)) {
-                SCHEDULER_PERROR("Failed to read PID\n");
-                close(client_fd);
-                continue;
-            }
+    struct epoll_event ev = { .events = EPOLLIN, .data.u64 = EV_TAG(EV_LISTEN, 0) };
+    epoll_ctl(g_epoll_fd, EPOLL_CTL_ADD, server_fd, &ev);
+    ev.data.u64 = EV_TAG(EV_TICK, 0);
+    epoll_ctl(g_epoll_fd, EPOLL_CTL_ADD, tick_fd, &ev);
 
-            if (pid == -1) {
-                SCHEDULER_PRINTF("Received shutdown request\n");
-                close(client_fd);
-                cleanup_scheduler(server_fd);
-                return 0;
-            }
+    eval_start();
+    SCHEDULER_PRINTF("Running, listening on %s\n", SOCKET_PATH);
 
-            int startup_flag;
-            MonitorData data;
-            bytes_read = read(client_fd, &startup_flag, sizeof(int));
-            bytes_read += read(client_fd, &data, sizeof(MonitorData));
+    DynamicCoreMasks masks;
+    compute_dynamic_coresets(&masks);
 
-            if (bytes_read != sizeof(int) + sizeof(MonitorData)) {
-                SCHEDULER_PERROR("Incomplete data received for PID %d\n", pid);
-                close(client_fd);
-                continue;
-            }
+    while (1) {
+        struct epoll_event events[SCHEDULER_MAX_EVENTS];
+        int n = epoll_wait(g_epoll_fd, events, SCHEDULER_MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            SCHEDULER_PERROR("epoll_wait: %s\n", strerror(errno));
+            break;
+        }
 
-            add_to_queue(pid, data, startup_flag);
-            close(client_fd);
+        int tick_fired = 0;
+        for (int e = 0; e < n; e++) {
+            uint64_t kind = events[e].data.u64 >> 32;
+            if (kind == EV_LISTEN) {
+                if (accept_monitor_messages(server_fd) == 1) {
+                    close(tick_fd);
+                    cleanup_scheduler(server_fd);
+                    return 0;
+                }
+            } else if (kind == EV_TICK) {
+                uint64_t expirations;
+                ssize_t rc = read(tick_fd, &expirations, sizeof(expirations));
+                (void)rc;
+                tick_fired = 1;
+            }
+            // EV_RING: the doorbell is cleared by drain_rings() below
         }
 
-        DynamicCoreMasks masks;
-        compute_dynamic_coresets(&masks);
-        SCHEDULER_PRINTF("Computed coresets: Compute=%s, I/O=%s, Memory=%s\n",
-                         masks.compute_coreset, masks.io_coreset, masks.memory_coreset);
-        log_core_allocation(&masks);
-        process_queue(&masks);
+        if (tick_fired) {
+            // housekeeping only: drop dead processes and refresh the core masks
+            QueueEntry *next;
+            for (QueueEntry *e = queue_first(); e; e = next) {
+                next = queue_next(e);
+                if (!is_process_alive(e->pid)) {
+                    SCHEDULER_PRINTF("Process PID %d died, removing from queue\n", e->pid);
+                    remove_queue_entry(e);
+                }
+            }
+            if (g_use_cpuload) cpuload_sample();
+            compute_dynamic_coresets(&masks);
+            SCHEDULER_PRINTF("Computed coresets: Compute=%s, I/O=%s, Memory=%s\n",
+                             masks.compute_coreset, masks.io_coreset, masks.memory_coreset);
+            log_core_allocation(&masks);
+        }
 
-        usleep(SCHEDULER_SLEEP_MILLISECONDS * 1000);
+        // decide for every process with fresh telemetry, then re-arm the doorbells
+        do {
+            drain_rings();
+            process_queue(&masks);
+        } while (arm_rings());
     }
 
+    close(tick_fd);
     cleanup_scheduler(server_fd);
     return 0;
 }
\ No newline at end of file
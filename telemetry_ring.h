@@ -0,0 +1,105 @@
+#ifndef TELEMETRY_RING_H
+#define TELEMETRY_RING_H
+
+// Single-producer/single-consumer ring of MonitorData records shared by
+// libmonitor (producer, one per process) and the scheduler (consumer).
+// The ring lives in a memfd that the monitor creates and hands to the
+// scheduler once, with an eventfd doorbell, over the startup message.
+// Publishing a record is a copy and a release store: no syscalls unless
+// the consumer has asked to be woken up.
+
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include "monitor.h"
+
+#define TELEMETRY_RING_MAGIC 0x544c4d52u      // "TLMR"
+#define TELEMETRY_RING_SLOTS 64               // power of two
+#define TELEMETRY_RING_MEMFD_NAME "libmonitor-telemetry"
+
+typedef struct {
+    uint32_t magic;
+    uint32_t slots;
+    uint32_t record_size;                     // sizeof(MonitorData) of the producer
+    int32_t  pid;                             // producing process
+
+    // producer side
+    __attribute__((aligned(64))) uint64_t head;   // next slot to write
+    uint64_t dropped;                         // records lost to a full ring
+
+    // consumer side
+    __attribute__((aligned(64))) uint64_t tail;   // next slot to read
+    uint32_t consumer_attached;               // set once the scheduler has mapped the ring
+    uint32_t consumer_waiting;                // consumer is idle, ring the doorbell
+
+    __attribute__((aligned(64))) MonitorData records[TELEMETRY_RING_SLOTS];
+} TelemetryRing;
+
+static inline void telemetry_ring_init(TelemetryRing *r, pid_t pid)
+{
+    r->slots = TELEMETRY_RING_SLOTS;
+    r->record_size = sizeof(MonitorData);
+    r->pid = pid;
+    r->head = 0;
+    r->dropped = 0;
+    r->tail = 0;
+    r->consumer_attached = 0;
+    r->consumer_waiting = 0;
+    __atomic_store_n(&r->magic, TELEMETRY_RING_MAGIC, __ATOMIC_RELEASE);
+}
+
+// Consumer-side sanity check of a freshly mapped ring
+static inline int telemetry_ring_valid(const TelemetryRing *r, pid_t pid)
+{
+    return __atomic_load_n(&r->magic, __ATOMIC_ACQUIRE) == TELEMETRY_RING_MAGIC &&
+           r->slots == TELEMETRY_RING_SLOTS &&
+           r->record_size == sizeof(MonitorData) &&
+           r->pid == pid;
+}
+
+// Producer: returns 0 on success, -1 if the ring is full (record dropped)
+static inline int telemetry_ring_push(TelemetryRing *r, const MonitorData *d)
+{
+    uint64_t head = r->head;
+    uint64_t tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+    if (head - tail >= TELEMETRY_RING_SLOTS) {
+        r->dropped++;
+        return -1;
+    }
+    r->records[head & (TELEMETRY_RING_SLOTS - 1)] = *d;
+    __atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+// Producer: wake the consumer only if it went to sleep on the doorbell
+static inline void telemetry_ring_doorbell(TelemetryRing *r, int efd)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (efd >= 0 && __atomic_exchange_n(&r->consumer_waiting, 0, __ATOMIC_SEQ_CST)) {
+        uint64_t one = 1;
+        ssize_t rc = write(efd, &one, sizeof(one));
+        (void)rc;
+    }
+}
+
+// Consumer: returns 1 and copies the oldest record, 0 if the ring is empty
+static inline int telemetry_ring_pop(TelemetryRing *r, MonitorData *out)
+{
+    uint64_t tail = r->tail;
+    uint64_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+    if (tail == head) return 0;
+    *out = r->records[tail & (TELEMETRY_RING_SLOTS - 1)];
+    __atomic_store_n(&r->tail, tail + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+// Consumer: ask for a doorbell before sleeping. Returns 1 if records
+// arrived in the meantime, in which case the consumer should not sleep.
+static inline int telemetry_ring_arm(TelemetryRing *r)
+{
+    __atomic_store_n(&r->consumer_waiting, 1, __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    return __atomic_load_n(&r->head, __ATOMIC_SEQ_CST) != r->tail;
+}
+
+#endif // TELEMETRY_RING_H
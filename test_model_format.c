@@ -0,0 +1,356 @@
+// test_model_format - binary model round trip and forest kernel agreement
+//
+//   test_model_format [forest.json ...]      (default: workload_classifier.json)
+//
+// Each forest is built from its JSON export, written with
+// model_write_forest() and mapped back; every array of the mapping must
+// match the heap forest byte for byte. Random rows, with NaNs, infinities
+// and values sitting exactly on split thresholds, are then classified by
+// rf_forest_predict() and rf_forest_predict_batch() on both forests under
+// every RF_FOREST_ISA kernel, and all results must be bit-identical.
+// Files that are corrupt, truncated, of the wrong kind or for other
+// features, and forests whose layout breaks the mapper's invariants, must
+// be rejected. Exits non-zero on any failure.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "cJSON.h"
+#include "rf_forest.h"
+#include "model_format.h"
+
+#define TEST_ROWS 1003          // not a multiple of 8 or 16: exercises the scalar tail
+
+static int g_checks = 0;
+static int g_failures = 0;
+
+#define CHECK(cond, ...) do {                       \
+        g_checks++;                                 \
+        if (!(cond)) {                              \
+            g_failures++;                           \
+            printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+            printf(__VA_ARGS__);                    \
+            printf("\n");                           \
+        }                                           \
+    } while (0)
+
+static cJSON *parse_file(const char *path) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        fprintf(stderr, "Failed to open %s: %s\n", path, strerror(errno));
+        return NULL;
+    }
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    char *data = malloc(size + 1);
+    if (!data) {
+        fclose(fp);
+        return NULL;
+    }
+    size_t got = fread(data, 1, size, fp);
+    data[got] = '\0';
+    fclose(fp);
+
+    cJSON *json = cJSON_Parse(data);
+    free(data);
+    if (!json) fprintf(stderr, "Failed to parse JSON in %s\n", path);
+    return json;
+}
+
+static int copy_file(const char *from, const char *to, long truncate_to, long flip_at) {
+    FILE *in = fopen(from, "rb");
+    if (!in) return -1;
+    fseek(in, 0, SEEK_END);
+    long size = ftell(in);
+    fseek(in, 0, SEEK_SET);
+    unsigned char *buf = malloc(size);
+    int ok = buf && fread(buf, 1, size, in) == (size_t)size;
+    fclose(in);
+    if (!ok) {
+        free(buf);
+        return -1;
+    }
+    if (flip_at >= 0 && flip_at < size) buf[flip_at] ^= 0x40;
+    if (truncate_to >= 0 && truncate_to < size) size = truncate_to;
+    FILE *out = fopen(to, "wb");
+    ok = out && fwrite(buf, 1, size, out) == (size_t)size;
+    if (out && fclose(out) != 0) ok = 0;
+    free(buf);
+    return ok ? 0 : -1;
+}
+
+static long file_size(const char *path) {
+    FILE *fp = fopen(path, "rb");
+    if (!fp) return -1;
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fclose(fp);
+    return size;
+}
+
+#define SAME_ARRAY(field, count) \
+    CHECK(memcmp(a->field, b->field, (size_t)(count) * sizeof(*a->field)) == 0, \
+          "%s: " #field " differs after the round trip", name)
+
+static void check_same_layout(const char *name, const rf_forest_t *a, const rf_forest_t *b) {
+    int same_counts = a->n_trees == b->n_trees && a->n_nodes == b->n_nodes &&
+                      a->n_leaves == b->n_leaves && a->n_classes == b->n_classes &&
+                      a->n_features == b->n_features && a->n_bv_splits == b->n_bv_splits &&
+                      a->n_bv_leaves == b->n_bv_leaves;
+    CHECK(same_counts, "%s: counts differ after the round trip", name);
+    if (!same_counts) return;
+    size_t nc = (size_t)a->n_classes;
+    SAME_ARRAY(root, a->n_trees);
+    SAME_ARRAY(feature, a->n_nodes);
+    SAME_ARRAY(threshold, a->n_nodes);
+    SAME_ARRAY(child, a->n_nodes);
+    SAME_ARRAY(leaf, a->n_leaves * nc);
+    SAME_ARRAY(bv_first, a->n_trees);
+    SAME_ARRAY(bv_count, a->n_trees);
+    SAME_ARRAY(bv_leaf_first, a->n_trees);
+    SAME_ARRAY(bv_feature, a->n_bv_splits);
+    SAME_ARRAY(bv_threshold, a->n_bv_splits);
+    SAME_ARRAY(bv_mask, a->n_bv_splits);
+    SAME_ARRAY(bv_value, a->n_bv_leaves * nc);
+}
+
+// Rows that hit every branch kind: ordinary values over a wide range, NaN
+// (always goes right), infinities, and features equal to a split threshold
+// of that feature (x <= threshold goes left)
+static float *make_rows(const rf_forest_t *f, int n) {
+    int nf = f->n_features;
+    float *x = malloc((size_t)n * nf * sizeof(*x));
+    if (!x) return NULL;
+    srand(12345);
+    for (int i = 0; i < n * nf; i++) {
+        int feat = i % nf;
+        int kind = rand() % 10;
+        if (kind == 0) {
+            x[i] = NAN;
+        } else if (kind == 1) {
+            x[i] = rand() % 2 ? INFINITY : -INFINITY;
+        } else if (kind <= 4) {
+            // a threshold this feature is split on, found by probing random nodes
+            x[i] = (float)(rand() % 1000) / 100.0f;
+            for (int tries = 0; tries < 64; tries++) {
+                int node = rand() % f->n_nodes;
+                if (f->feature[node] == feat) {
+                    x[i] = f->threshold[node];
+                    break;
+                }
+            }
+        } else {
+            x[i] = (float)(rand() % 100000) / (float)(rand() % 1000 + 1) * (rand() % 2 ? 1.0f : 1e-4f);
+        }
+    }
+    return x;
+}
+
+// Classify rows with the kernel selected by isa in a child process (the
+// kernel is chosen once per process) and compare against the scalar walk
+static void check_isa(const char *name, const char *isa, const rf_forest_t *heap,
+                      const rf_forest_t *mapped, const float *x, int n) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+        CHECK(0, "%s: fork failed: %s", name, strerror(errno));
+        return;
+    }
+    if (pid == 0) {
+        setenv("RF_FOREST_ISA", isa, 1);
+        int nc = heap->n_classes, nf = heap->n_features;
+        double *ref = malloc((size_t)n * nc * sizeof(*ref));
+        double *batch_heap = malloc((size_t)n * nc * sizeof(*batch_heap));
+        double *batch_mapped = malloc((size_t)n * nc * sizeof(*batch_mapped));
+        if (!ref || !batch_heap || !batch_mapped) _exit(2);
+
+        for (int i = 0; i < n; i++) rf_forest_predict(heap, x + (size_t)i * nf, ref + (size_t)i * nc);
+        rf_forest_predict_batch(heap, x, n, batch_heap);
+        rf_forest_predict_batch(mapped, x, n, batch_mapped);
+
+        int bad = 0;
+        size_t row_bytes = (size_t)nc * sizeof(double);
+        for (int i = 0; i < n; i++) {
+            double single_mapped[64];
+            rf_forest_predict(mapped, x + (size_t)i * nf, single_mapped);
+            const double *want = ref + (size_t)i * nc;
+            if (memcmp(want, single_mapped, row_bytes) != 0 ||
+                memcmp(want, batch_heap + (size_t)i * nc, row_bytes) != 0 ||
+                memcmp(want, batch_mapped + (size_t)i * nc, row_bytes) != 0) {
+                if (bad++ < 3) printf("FAIL %s: row %d differs under %s\n", name, i, rf_forest_isa());
+            }
+        }
+        printf("%s: %d rows, kernel %s (asked %s): %d mismatches\n", name, n, rf_forest_isa(), isa, bad);
+        fflush(stdout);
+        _exit(bad ? 1 : 0);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0, "%s: %s kernel disagrees with the tree walk",
+          name, isa);
+}
+
+// A layout the mapper must refuse: write f as it is now and map it back
+static void check_rejected_layout(const char *name, const char *what, const char *path,
+                                  const rf_forest_t *f, const char *const *names) {
+    rf_forest_t *m = NULL;
+    if (model_write_forest(path, f, names) == 0) m = model_map_forest(path, names, f->n_features);
+    CHECK(!m && errno == EINVAL, "%s: forest with %s was mapped", name, what);
+    rf_forest_free(m);
+}
+
+static void check_forest(const char *json_path) {
+    cJSON *json = parse_file(json_path);
+    CHECK(json != NULL, "%s: cannot read", json_path);
+    if (!json) return;
+
+    const cJSON *nf_item = cJSON_GetObjectItem(json, "n_features");
+    const cJSON *nc_item = cJSON_GetObjectItem(json, "n_classes");
+    const cJSON *names_item = cJSON_GetObjectItem(json, "feature_names");
+    int nf = cJSON_IsNumber(nf_item) ? nf_item->valueint : 0;
+    int nc = cJSON_IsNumber(nc_item) ? nc_item->valueint : 0;
+    const char **names = nf > 0 ? calloc(nf, sizeof(*names)) : NULL;
+    for (int i = 0; names && i < nf; i++) {
+        const cJSON *it = cJSON_GetArrayItem(names_item, i);
+        names[i] = cJSON_IsString(it) ? it->valuestring : "";
+    }
+    rf_forest_t *heap = names && nc > 0 && nc <= 64
+        ? rf_forest_from_json(cJSON_GetObjectItem(json, "trees"), names, nf, nc) : NULL;
+    CHECK(heap != NULL, "%s: no forest in the export", json_path);
+    if (!heap) {
+        free(names);
+        cJSON_Delete(json);
+        return;
+    }
+
+    char path[256], bad_path[256];
+    snprintf(path, sizeof(path), "/tmp/test_model_format.%d%s", (int)getpid(), MODEL_FILE_EXT);
+    snprintf(bad_path, sizeof(bad_path), "/tmp/test_model_format.%d.bad%s", (int)getpid(), MODEL_FILE_EXT);
+
+    CHECK(model_write_forest(path, heap, names) == 0, "%s: write failed: %s", json_path, strerror(errno));
+    rf_forest_t *mapped = model_map_forest(path, names, nf);
+    CHECK(mapped != NULL, "%s: freshly written forest was rejected", json_path);
+    if (mapped) {
+        check_same_layout(json_path, heap, mapped);
+
+        const char *mapped_names[256];
+        CHECK(nf <= 256 && model_forest_feature_names(mapped, mapped_names, nf) == 0,
+              "%s: no feature names in the mapping", json_path);
+        for (int i = 0; i < nf && i < 256; i++)
+            CHECK(strcmp(mapped_names[i], names[i]) == 0, "%s: feature %d renamed", json_path, i);
+
+        float *x = make_rows(heap, TEST_ROWS);
+        CHECK(x != NULL, "out of memory");
+        if (x) {
+            check_isa(json_path, "scalar", heap, mapped, x, TEST_ROWS);
+            check_isa(json_path, "avx2", heap, mapped, x, TEST_ROWS);
+            check_isa(json_path, "avx512", heap, mapped, x, TEST_ROWS);
+        }
+        free(x);
+    }
+
+    // files the mapper must refuse
+    errno = 0;
+    CHECK(!model_map_forest("/tmp/test_model_format.missing.bin", names, nf) && errno == ENOENT,
+          "%s: missing file not reported as ENOENT", json_path);
+    const char *wrong[256];
+    for (int i = 0; i < nf && i < 256; i++) wrong[i] = names[i];
+    wrong[nf / 2] = "not-a-feature";
+    CHECK(!model_map_forest(path, wrong, nf) && errno == EINVAL, "%s: wrong feature names accepted", json_path);
+    CHECK(!model_map_forest(path, names, nf - 1) && errno == EINVAL, "%s: wrong feature count accepted", json_path);
+
+    long size = file_size(path);
+    CHECK(copy_file(path, bad_path, -1, size - 1) == 0 && !model_map_forest(bad_path, names, nf) &&
+          errno == EINVAL, "%s: corrupted file accepted", json_path);
+    CHECK(copy_file(path, bad_path, size / 2, -1) == 0 && !model_map_forest(bad_path, names, nf) &&
+          errno == EINVAL, "%s: truncated file accepted", json_path);
+    CHECK(copy_file(path, bad_path, -1, 0) == 0 && !model_map_forest(bad_path, names, nf) &&
+          errno == EINVAL, "%s: bad magic accepted", json_path);
+
+    // layouts that would let a walk loop or index out of bounds
+    int split = -1;
+    for (int i = 0; i < heap->n_nodes && split < 0; i++)
+        if (heap->feature[i] != RF_LEAF) split = i;
+    if (split >= 0) {
+        int32_t child = heap->child[split];
+        heap->child[split] = split;
+        check_rejected_layout(json_path, "a split pointing back at itself", bad_path, heap, names);
+        heap->child[split] = heap->n_nodes;
+        check_rejected_layout(json_path, "a child past the last node", bad_path, heap, names);
+        heap->child[split] = child;
+
+        uint16_t feature = heap->feature[split];
+        heap->feature[split] = (uint16_t)nf;
+        check_rejected_layout(json_path, "a split on an unknown feature", bad_path, heap, names);
+        heap->feature[split] = feature;
+    }
+    int leaf = -1;
+    for (int i = 0; i < heap->n_nodes && leaf < 0; i++)
+        if (heap->feature[i] == RF_LEAF) leaf = i;
+    if (leaf >= 0) {
+        int32_t child = heap->child[leaf];
+        heap->child[leaf] = heap->n_leaves;
+        check_rejected_layout(json_path, "a leaf index past the leaf table", bad_path, heap, names);
+        heap->child[leaf] = child;
+    }
+    if (heap->n_bv_splits > 0) {
+        for (int t = 0; t < heap->n_trees; t++) {
+            if (heap->bv_first[t] < 0 || heap->bv_count[t] == 0) continue;
+            int leaves = (t + 1 < heap->n_trees ? heap->bv_leaf_first[t + 1] : heap->n_bv_leaves) -
+                         heap->bv_leaf_first[t];
+            uint64_t *mask = &heap->bv_mask[heap->bv_first[t]];
+            uint64_t saved = *mask;
+            *mask &= ~(1ull << (leaves - 1));
+            check_rejected_layout(json_path, "a bitvector clearing the rightmost leaf", bad_path, heap, names);
+            *mask = saved;
+            break;
+        }
+    }
+    // the restored forest is accepted again
+    rf_forest_t *again = NULL;
+    if (model_write_forest(bad_path, heap, names) == 0) again = model_map_forest(bad_path, names, nf);
+    CHECK(again != NULL, "%s: restored forest rejected", json_path);
+    rf_forest_free(again);
+
+    unlink(path);
+    unlink(bad_path);
+    rf_forest_free(mapped);
+    rf_forest_free(heap);
+    free(names);
+    cJSON_Delete(json);
+}
+
+static void check_linear(void) {
+    const char *names[] = {"cycles_per_ms", "IPC", "Cache_Miss_Ratio"};
+    const double coef[] = {-1.5, 0.25, 1e-9, 3.0};
+    char path[256];
+    snprintf(path, sizeof(path), "/tmp/test_model_format.%d.linear%s", (int)getpid(), MODEL_FILE_EXT);
+
+    CHECK(model_write_linear(path, coef, names, 3) == 0, "linear: write failed: %s", strerror(errno));
+    double back[4] = {0};
+    CHECK(model_read_linear(path, names, 3, back) == 0 && memcmp(back, coef, sizeof(coef)) == 0,
+          "linear: coefficients differ after the round trip");
+    const char *swapped[] = {"IPC", "cycles_per_ms", "Cache_Miss_Ratio"};
+    CHECK(model_read_linear(path, swapped, 3, back) != 0 && errno == EINVAL,
+          "linear: reordered features accepted");
+    CHECK(model_read_linear(path, names, 2, back) != 0 && errno == EINVAL,
+          "linear: wrong feature count accepted");
+    CHECK(!model_map_forest(path, NULL, 0) && errno == EINVAL, "linear: mapped as a forest");
+    unlink(path);
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        check_forest("workload_classifier.json");
+    } else {
+        for (int i = 1; i < argc; i++) check_forest(argv[i]);
+    }
+    check_linear();
+
+    printf("model format: %d checks, %d failures\n", g_checks, g_failures);
+    return g_failures ? 1 : 0;
+}
@@ -0,0 +1,337 @@
+#define _GNU_SOURCE
+// topology.c - one-time CPU topology table (core type, PMU, SMT, L2, L3)
+#include "topology.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <pthread.h>
+
+#define TOPO_LEGACY_CPUS 16             // CPU count assumed when sysfs says nothing
+#define TOPO_DEFAULT_PMU_CORE 4
+#define TOPO_DEFAULT_PMU_ATOM 10
+
+static topology_t g_topo;
+static int g_topo_loaded = 0;
+static pthread_mutex_t g_topo_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int read_line_file(const char *path, char *buf, size_t len)
+{
+    FILE *f = fopen(path, "r");
+    if (!f) return -1;
+    if (!fgets(buf, (int)len, f)) {
+        fclose(f);
+        return -1;
+    }
+    fclose(f);
+    buf[strcspn(buf, "\n")] = '\0';
+    return 0;
+}
+
+static int read_int_file(const char *path, int *out)
+{
+    char buf[64];
+    if (read_line_file(path, buf, sizeof(buf)) != 0) return -1;
+    char *end = NULL;
+    long v = strtol(buf, &end, 10);
+    if (end == buf) return -1;
+    *out = (int)v;
+    return 0;
+}
+
+int topology_parse_cpulist(const char *list, cpu_set_t *set, size_t setsize)
+{
+    int added = 0;
+    const char *p = list;
+
+    while (*p) {
+        while (*p == ',' || isspace((unsigned char)*p)) p++;
+        if (!*p) break;
+        if (!isdigit((unsigned char)*p)) return -1;
+
+        char *end = NULL;
+        long start = strtol(p, &end, 10);
+        long stop = start;
+        p = end;
+        if (*p == '-') {
+            p++;
+            if (!isdigit((unsigned char)*p)) return -1;
+            stop = strtol(p, &end, 10);
+            p = end;
+        }
+        if (stop < start) return -1;
+        if (*p && *p != ',' && !isspace((unsigned char)*p)) return -1;
+        if (stop >= (long)(setsize * 8)) return -1;
+
+        for (long c = start; c <= stop; c++) {
+            if (!CPU_ISSET_S((int)c, setsize, set)) {
+                CPU_SET_S((int)c, setsize, set);
+                added++;
+            }
+        }
+    }
+    return added;
+}
+
+// Lowest CPU of a cpulist file, -1 if absent
+static int first_cpu_of_list_file(const char *path)
+{
+    char buf[TOPO_CPULIST_LEN];
+    if (read_line_file(path, buf, sizeof(buf)) != 0) return -1;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (topology_parse_cpulist(buf, &set, sizeof(set)) <= 0) return -1;
+    for (int c = 0; c < CPU_SETSIZE; c++) {
+        if (CPU_ISSET(c, &set)) return c;
+    }
+    return -1;
+}
+
+static int load_list_file(const char *path, cpu_set_t *set)
+{
+    char buf[TOPO_CPULIST_LEN];
+    CPU_ZERO(set);
+    if (read_line_file(path, buf, sizeof(buf)) != 0) return -1;
+    return topology_parse_cpulist(buf, set, sizeof(*set));
+}
+
+// Render the online CPUs with pcore == want (or all if want < 0) as a cpulist
+static void format_cpulist(const topology_t *t, int want, char *out, size_t len)
+{
+    size_t n = 0;
+    out[0] = '\0';
+    int c = 0;
+    while (c < t->nr_cpus) {
+        const topo_cpu_t *tc = &t->cpu[c];
+        if (!tc->online || (want >= 0 && tc->pcore != want)) { c++; continue; }
+        int start = c;
+        while (c + 1 < t->nr_cpus && t->cpu[c + 1].online &&
+               (want < 0 || t->cpu[c + 1].pcore == want)) {
+            c++;
+        }
+        int w;
+        if (start == c) w = snprintf(out + n, len - n, "%s%d", n ? "," : "", start);
+        else            w = snprintf(out + n, len - n, "%s%d-%d", n ? "," : "", start, c);
+        if (w < 0 || (size_t)w >= len - n) break;
+        n += (size_t)w;
+        c++;
+    }
+}
+
+static void load_legacy_layout(topology_t *t)
+{
+    t->nr_cpus = TOPO_LEGACY_CPUS;
+    for (int c = 0; c < TOPO_LEGACY_CPUS; c++) {
+        t->cpu[c].present = 1;
+        t->cpu[c].online = 1;
+        t->cpu[c].pcore = 1;
+        t->cpu[c].pmu_type = t->pmu_core;
+        t->cpu[c].core_id = c;
+        t->cpu[c].l2_id = -1;
+        t->cpu[c].l3_id = -1;
+    }
+}
+
+static void load_caches(topology_t *t, const char *cpu_dir, int c)
+{
+    char path[512];
+    for (int idx = 0; idx < 16; idx++) {
+        int level;
+        snprintf(path, sizeof(path), "%s/cache/index%d/level", cpu_dir, idx);
+        if (read_int_file(path, &level) != 0) continue;
+
+        char type[32];
+        snprintf(path, sizeof(path), "%s/cache/index%d/type", cpu_dir, idx);
+        if (read_line_file(path, type, sizeof(type)) == 0 && strcmp(type, "Instruction") == 0) {
+            continue;
+        }
+
+        snprintf(path, sizeof(path), "%s/cache/index%d/shared_cpu_list", cpu_dir, idx);
+        int first = first_cpu_of_list_file(path);
+        if (first < 0) continue;
+        if (level == 2) t->cpu[c].l2_id = first;
+        else if (level == 3) t->cpu[c].l3_id = first;
+    }
+}
+
+static int load_topology(topology_t *t, const char *root)
+{
+    char path[512];
+    cpu_set_t present, online, pset, eset;
+
+    memset(t, 0, sizeof(*t));
+    snprintf(t->root, sizeof(t->root), "%s", root);
+    t->pmu_core = TOPO_DEFAULT_PMU_CORE;
+    t->pmu_atom = TOPO_DEFAULT_PMU_ATOM;
+
+    snprintf(path, sizeof(path), "%s/devices/system/cpu/present", root);
+    if (load_list_file(path, &present) <= 0) {
+        snprintf(path, sizeof(path), "%s/devices/system/cpu/possible", root);
+        if (load_list_file(path, &present) <= 0) {
+            load_legacy_layout(t);
+            return -1;
+        }
+    }
+    snprintf(path, sizeof(path), "%s/devices/system/cpu/online", root);
+    if (load_list_file(path, &online) <= 0) online = present;
+
+    int core_type = 0, atom_type = 0, cpu_type = 0;
+    snprintf(path, sizeof(path), "%s/devices/cpu_core/type", root);
+    int have_core = (read_int_file(path, &core_type) == 0);
+    snprintf(path, sizeof(path), "%s/devices/cpu_atom/type", root);
+    int have_atom = (read_int_file(path, &atom_type) == 0);
+    snprintf(path, sizeof(path), "%s/devices/cpu/type", root);
+    int have_cpu = (read_int_file(path, &cpu_type) == 0);
+
+    t->hybrid = have_core && have_atom;
+    if (have_core) t->pmu_core = core_type;
+    else if (have_cpu) t->pmu_core = cpu_type;
+    if (have_atom) t->pmu_atom = atom_type;
+    else if (have_cpu) t->pmu_atom = cpu_type;
+
+    // core kind: hybrid PMU cpumasks, then the per-CPU core_type file; with
+    // neither, every CPU is one class (P) and the host is treated as non-hybrid
+    int have_psets = 0, have_types = 0;
+    if (t->hybrid) {
+        snprintf(path, sizeof(path), "%s/devices/cpu_core/cpus", root);
+        int np = load_list_file(path, &pset);
+        snprintf(path, sizeof(path), "%s/devices/cpu_atom/cpus", root);
+        int ne = load_list_file(path, &eset);
+        have_psets = (np > 0 && ne >= 0);
+    }
+
+    for (int c = 0; c < CPU_SETSIZE && c < TOPO_MAX_CPUS; c++) {
+        if (!CPU_ISSET(c, &present)) continue;
+        topo_cpu_t *tc = &t->cpu[c];
+        tc->present = 1;
+        tc->online = CPU_ISSET(c, &online) ? 1 : 0;
+        tc->core_id = c;
+        tc->l2_id = -1;
+        tc->l3_id = -1;
+        if (c + 1 > t->nr_cpus) t->nr_cpus = c + 1;
+
+        char cpu_dir[384];
+        snprintf(cpu_dir, sizeof(cpu_dir), "%s/devices/system/cpu/cpu%d", root, c);
+
+        int ct;
+        if (have_psets) {
+            tc->pcore = CPU_ISSET(c, &pset) ? 1 : 0;
+        } else {
+            snprintf(path, sizeof(path), "%s/topology/core_type", cpu_dir);
+            if (read_int_file(path, &ct) == 0 && (ct == 1 || ct == 2)) {
+                tc->pcore = (ct == 1);
+                have_types = 1;
+            } else {
+                tc->pcore = 1;
+            }
+        }
+        tc->pmu_type = tc->pcore ? t->pmu_core : t->pmu_atom;
+
+        snprintf(path, sizeof(path), "%s/topology/core_cpus_list", cpu_dir);
+        int sib = first_cpu_of_list_file(path);
+        if (sib < 0) {
+            snprintf(path, sizeof(path), "%s/topology/thread_siblings_list", cpu_dir);
+            sib = first_cpu_of_list_file(path);
+        }
+        if (sib >= 0) tc->core_id = sib;
+
+        load_caches(t, cpu_dir, c);
+    }
+    if (!have_psets && !have_types) t->hybrid = 0;
+    return 0;
+}
+
+int topology_init(const char *sysfs_root)
+{
+    if (__atomic_load_n(&g_topo_loaded, __ATOMIC_ACQUIRE)) return 0;
+
+    pthread_mutex_lock(&g_topo_lock);
+    int rc = 0;
+    if (!g_topo_loaded) {
+        const char *root = sysfs_root;
+        if (!root || !*root) root = getenv("TOPOLOGY_SYSFS_ROOT");
+        if (!root || !*root) root = "/sys";
+
+        rc = load_topology(&g_topo, root);
+        format_cpulist(&g_topo, 1, g_topo.p_list, sizeof(g_topo.p_list));
+        format_cpulist(&g_topo, 0, g_topo.e_list, sizeof(g_topo.e_list));
+        format_cpulist(&g_topo, -1, g_topo.all_list, sizeof(g_topo.all_list));
+        __atomic_store_n(&g_topo_loaded, 1, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&g_topo_lock);
+    return rc;
+}
+
+const topology_t *topology_get(void)
+{
+    if (!__atomic_load_n(&g_topo_loaded, __ATOMIC_ACQUIRE)) topology_init(NULL);
+    return &g_topo;
+}
+
+static inline const topo_cpu_t *topo_cpu(int cpu)
+{
+    const topology_t *t = topology_get();
+    if (cpu < 0 || cpu >= t->nr_cpus || !t->cpu[cpu].present) return NULL;
+    return &t->cpu[cpu];
+}
+
+int topology_nr_cpus(void) { return topology_get()->nr_cpus; }
+int topology_is_hybrid(void) { return topology_get()->hybrid; }
+
+// Unknown CPUs count as P, the class every CPU gets on a non-hybrid host
+int topology_is_pcore(int cpu)
+{
+    const topo_cpu_t *tc = topo_cpu(cpu);
+    return tc ? tc->pcore : cpu >= 0;
+}
+
+int topology_pmu_type(int cpu)
+{
+    const topo_cpu_t *tc = topo_cpu(cpu);
+    if (tc) return tc->pmu_type;
+    return topology_pmu_type_for(topology_is_pcore(cpu));
+}
+
+int topology_pmu_type_for(int pcore)
+{
+    const topology_t *t = topology_get();
+    return pcore ? t->pmu_core : t->pmu_atom;
+}
+
+int topology_core_id(int cpu)
+{
+    const topo_cpu_t *tc = topo_cpu(cpu);
+    return tc ? tc->core_id : cpu;
+}
+
+int topology_l2_id(int cpu)
+{
+    const topo_cpu_t *tc = topo_cpu(cpu);
+    return tc ? tc->l2_id : -1;
+}
+
+int topology_l3_id(int cpu)
+{
+    const topo_cpu_t *tc = topo_cpu(cpu);
+    return tc ? tc->l3_id : -1;
+}
+
+const char *topology_p_coreset(void) { return topology_get()->p_list; }
+const char *topology_e_coreset(void) { return topology_get()->e_list; }
+const char *topology_all_coreset(void) { return topology_get()->all_list; }
+
+void topology_print(void)
+{
+    const topology_t *t = topology_get();
+    printf("[TOPOLOGY] root=%s cpus=%d hybrid=%d pmu_core=%d pmu_atom=%d\n",
+           t->root, t->nr_cpus, t->hybrid, t->pmu_core, t->pmu_atom);
+    printf("[TOPOLOGY] P=%s E=%s ALL=%s\n",
+           t->p_list[0] ? t->p_list : "-", t->e_list[0] ? t->e_list : "-", t->all_list);
+    for (int c = 0; c < t->nr_cpus; c++) {
+        const topo_cpu_t *tc = &t->cpu[c];
+        if (!tc->present) continue;
+        printf("[TOPOLOGY] cpu%d %s online=%d pmu=%d core=%d l2=%d l3=%d\n",
+               c, tc->pcore ? "P" : "E", tc->online, tc->pmu_type,
+               tc->core_id, tc->l2_id, tc->l3_id);
+    }
+}
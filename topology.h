@@ -0,0 +1,67 @@
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+#include <sched.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TOPO_MAX_CPUS 1024
+#define TOPO_CPULIST_LEN 4096
+
+typedef struct {
+    int present;                    // 1 if the CPU exists under the sysfs root
+    int online;                     // 1 if listed in devices/system/cpu/online
+    int pcore;                      // 1 = P-core, 0 = E-core
+    int pmu_type;                   // perf attr.type of this CPU's core PMU
+    int core_id;                    // lowest CPU of its SMT sibling set
+    int l2_id;                      // lowest CPU sharing its L2, -1 if unknown
+    int l3_id;                      // lowest CPU sharing its L3, -1 if unknown
+} topo_cpu_t;
+
+typedef struct {
+    int nr_cpus;                    // highest present CPU + 1
+    int hybrid;                     // 1 if both cpu_core and cpu_atom PMUs exist
+    int pmu_core;                   // perf type of cpu_core (or "cpu" on non-hybrid)
+    int pmu_atom;                   // perf type of cpu_atom
+    char root[256];                 // sysfs root the table was loaded from
+    char p_list[TOPO_CPULIST_LEN];  // cpulist of online P-cores, e.g. "0-7"
+    char e_list[TOPO_CPULIST_LEN];  // cpulist of online E-cores
+    char all_list[TOPO_CPULIST_LEN];
+    topo_cpu_t cpu[TOPO_MAX_CPUS];
+} topology_t;
+
+// Load the table once. sysfs_root == NULL uses $TOPOLOGY_SYSFS_ROOT, else "/sys".
+// Later calls are no-ops; returns 0 on success, -1 if no CPU was found
+// (the table is then filled with the legacy 0-7 P / 8-15 E layout).
+int topology_init(const char *sysfs_root);
+
+// All lookups load the table on first use with the default root.
+const topology_t *topology_get(void);
+int topology_nr_cpus(void);
+int topology_is_hybrid(void);
+int topology_is_pcore(int cpu);
+int topology_pmu_type(int cpu);
+int topology_pmu_type_for(int pcore);
+int topology_core_id(int cpu);
+int topology_l2_id(int cpu);
+int topology_l3_id(int cpu);
+
+// cpulists ("0-7,16") of the online CPUs of each kind
+const char *topology_p_coreset(void);
+const char *topology_e_coreset(void);
+const char *topology_all_coreset(void);
+
+// Parse a cpulist string ("0-3,8,10-11") into a set of setsize bytes
+// (CPU_ALLOC_SIZE). Returns the number of CPUs added, -1 on a malformed
+// list or a CPU that does not fit in the set.
+int topology_parse_cpulist(const char *list, cpu_set_t *set, size_t setsize);
+
+void topology_print(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TOPOLOGY_H